@@ -19,14 +19,47 @@ SOURCES += main.cpp\
     panorama3d.cpp \
     glwidget.cpp \
     glmesh.cpp \
-    meshworker.cpp
+    meshworker.cpp \
+    benchmark.cpp \
+    e57reader.cpp \
+    lasschema.cpp \
+    objwriter.cpp \
+    panoramastore.cpp \
+    parsecache.cpp \
+    plyschema.cpp \
+    pointbuffer.cpp \
+    pointcache.cpp \
+    projectionkernel.cpp \
+    projectionkernel_sse2.cpp \
+    projectionkernel_avx2.cpp \
+    projectionkernel_avx512.cpp \
+    resolutionestimator.cpp \
+    scangrid.cpp \
+    structuredscan.cpp \
+    xybformat.cpp
 
 HEADERS  += mainwindow.h \
     importworker.h \
     panorama3d.h \
     glwidget.h \
     glmesh.h \
-    meshworker.h
+    meshworker.h \
+    asciiparser.h \
+    benchmark.h \
+    e57reader.h \
+    lasschema.h \
+    objwriter.h \
+    panoramastore.h \
+    parsecache.h \
+    plyschema.h \
+    pointbuffer.h \
+    pointcache.h \
+    projectionkernel.h \
+    projectionkernel_impl.h \
+    resolutionestimator.h \
+    scangrid.h \
+    structuredscan.h \
+    xybformat.h
 
 FORMS    += mainwindow.ui
 
@@ -0,0 +1,210 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASCIIPARSER_H
+#define ASCIIPARSER_H
+
+#include <QtGlobal>
+
+#include <cstring>
+#include <cmath>
+#include <climits>
+
+/*
+ * Allocation-free tokenizer and number parser for ASCII point clouds.
+ *
+ * All functions work on raw bytes (e.g. a memory mapped file), never build a
+ * QString and ignore the current locale: the decimal separator is always '.'.
+ * Columns are separated by blanks; commas only separate columns when the caller
+ * asks for it (comma separated exports, detected from the first line).
+ */
+namespace AsciiParser
+{
+    //Maximum number of columns a point cloud line can have (9 = Agisoft Photoscan)
+    const int MaxTokens = 16;
+
+    inline bool isBlank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    inline bool isSeparator(char c, bool commas)
+    {
+        return isBlank(c) || (commas && c == ',');
+    }
+
+    //Whether the columns of a line are separated by commas
+    inline bool hasCommas(const char *begin, const char *end)
+    {
+        return memchr(begin, ',', end - begin) != NULL;
+    }
+
+    inline bool isDigit(char c)
+    {
+        return (unsigned char)(c - '0') < 10;
+    }
+
+    //Returns the end of the current line (the '\n' or end), never reads past end
+    inline const char *findLineEnd(const char *cursor, const char *end)
+    {
+        const char *newline = (const char *)memchr(cursor, '\n', end - cursor);
+        return newline ? newline : end;
+    }
+
+    //Returns the beginning of the line after the next count lines
+    inline const char *skipLines(const char *cursor, const char *end, qint64 count)
+    {
+        for(qint64 i = 0; i < count && cursor < end; i++)
+        {
+            const char *lineEnd = findLineEnd(cursor, end);
+            cursor = (lineEnd < end) ? lineEnd + 1 : end;
+        }
+        return cursor;
+    }
+
+    //Splits [begin, end) at blanks (and commas) and stores the first character of every token
+    inline int tokenize(const char *begin, const char *end, const char **tokens, int maxTokens, bool commas = false)
+    {
+        int count = 0;
+        const char *cursor = begin;
+
+        while(cursor < end)
+        {
+            while(cursor < end && isSeparator(*cursor, commas)) cursor++;
+            if(cursor >= end) break;
+
+            if(count < maxTokens)
+                tokens[count] = cursor;
+            count++;
+
+            while(cursor < end && !isSeparator(*cursor, commas)) cursor++;
+        }
+
+        return count;
+    }
+
+    //Parses a decimal floating point number like "-59.4362", "1e-3" or "+.5"
+    inline bool parseFloat(const char *cursor, const char *end, float &value)
+    {
+        static const double powersOfTen[] = {
+            1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        bool negative = false;
+        if(cursor < end && (*cursor == '-' || *cursor == '+'))
+        {
+            negative = (*cursor == '-');
+            cursor++;
+        }
+
+        //Up to 18 significant digits fit into the mantissa, the rest only shifts the exponent
+        quint64 mantissa = 0;
+        int exponent = 0;
+        bool digits = false;
+
+        while(cursor < end && isDigit(*cursor))
+        {
+            if(mantissa < 100000000000000000ULL)
+                mantissa = mantissa * 10 + (*cursor - '0');
+            else
+                exponent++;
+            digits = true;
+            cursor++;
+        }
+
+        if(cursor < end && *cursor == '.')
+        {
+            cursor++;
+            while(cursor < end && isDigit(*cursor))
+            {
+                if(mantissa < 100000000000000000ULL)
+                {
+                    mantissa = mantissa * 10 + (*cursor - '0');
+                    exponent--;
+                }
+                digits = true;
+                cursor++;
+            }
+        }
+
+        if(!digits)
+            return false;
+
+        if(cursor < end && (*cursor == 'e' || *cursor == 'E'))
+        {
+            cursor++;
+            bool negativeExponent = false;
+            if(cursor < end && (*cursor == '-' || *cursor == '+'))
+            {
+                negativeExponent = (*cursor == '-');
+                cursor++;
+            }
+            int explicitExponent = 0;
+            while(cursor < end && isDigit(*cursor))
+            {
+                if(explicitExponent < 10000)
+                    explicitExponent = explicitExponent * 10 + (*cursor - '0');
+                cursor++;
+            }
+            exponent += negativeExponent ? -explicitExponent : explicitExponent;
+        }
+
+        double result = (double)mantissa;
+        if(exponent < 0 && exponent >= -22)
+            result /= powersOfTen[-exponent];
+        else if(exponent > 0 && exponent <= 22)
+            result *= powersOfTen[exponent];
+        else if(exponent != 0)
+            result *= std::pow(10.0, exponent);
+
+        value = (float)(negative ? -result : result);
+        return true;
+    }
+
+    //Parses an integer like "59"; a fractional part ("59.0") is accepted and truncated,
+    //values outside the range of int are rejected
+    inline bool parseInt(const char *cursor, const char *end, int &value)
+    {
+        bool negative = false;
+        if(cursor < end && (*cursor == '-' || *cursor == '+'))
+        {
+            negative = (*cursor == '-');
+            cursor++;
+        }
+
+        if(cursor >= end || !isDigit(*cursor))
+            return false;
+
+        //The magnitude of INT_MIN does not fit into an int, it is checked in 64 bit
+        qint64 limit = negative ? -(qint64)INT_MIN : INT_MAX;
+        qint64 result = 0;
+        while(cursor < end && isDigit(*cursor))
+        {
+            result = result * 10 + (*cursor - '0');
+            if(result > limit)
+                return false;
+            cursor++;
+        }
+
+        value = (int)(negative ? -result : result);
+        return true;
+    }
+}
+
+#endif // ASCIIPARSER_H
@@ -0,0 +1,476 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "benchmark.h"
+
+int Benchmark::run(QString fileName)
+{
+    QFile file(fileName);
+    if(!file.exists())
+    {
+        qDebug() << "Benchmark: cannot open file" << fileName;
+        return 1;
+    }
+    qint64 bytes = file.size();
+
+    qDebug() << "Benchmark:" << fileName << "(" << bytes / (1024.0 * 1024.0) << "MB )";
+
+    //Make sure both parsers read from the page cache and not from the disk
+    warmUp(fileName);
+
+    QElapsedTimer timer;
+
+    if(fileName.endsWith(".xyb"))
+    {
+        //Nothing to parse, this only measures how fast the records can be streamed
+        double checksum = 0.0;
+        timer.start();
+        qint64 points = readXyb(fileName, checksum);
+        report("memory mapped .xyb records", bytes, points, timer.nsecsElapsed());
+        qDebug() << "Benchmark: checksum" << checksum;
+        projection();
+        splatting();
+        objWriting();
+        return 0;
+    }
+
+    double checksumLegacy = 0.0;
+    double checksumMapped = 0.0;
+
+    timer.start();
+    qint64 pointsLegacy = parseLegacy(fileName, checksumLegacy);
+    qint64 nsLegacy = timer.nsecsElapsed();
+    report("QTextStream + split (legacy)", bytes, pointsLegacy, nsLegacy);
+
+    timer.restart();
+    qint64 pointsMapped = parseMapped(fileName, checksumMapped);
+    qint64 nsMapped = timer.nsecsElapsed();
+    report("memory mapped parser", bytes, pointsMapped, nsMapped);
+
+    if(pointsLegacy != pointsMapped)
+        qDebug() << "Benchmark: WARNING point count differs:" << pointsLegacy << "!=" << pointsMapped;
+
+    qDebug() << "Benchmark: checksums" << checksumLegacy << checksumMapped;
+    qDebug() << "Benchmark: speedup" << (nsMapped > 0 ? (double)nsLegacy / nsMapped : 0.0) << "x";
+
+    projection();
+    splatting();
+    objWriting();
+
+    return 0;
+}
+
+void Benchmark::warmUp(QString fileName)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly))
+        return;
+
+    while(!file.atEnd())
+        file.read(ImportWorker::ReadBlockSize);
+
+    file.close();
+}
+
+void Benchmark::report(QString name, qint64 bytes, qint64 points, qint64 nanoseconds)
+{
+    double seconds = nanoseconds / 1e9;
+    if(seconds <= 0.0)
+        seconds = 1e-9;
+
+    qDebug().nospace() << "  " << qPrintable(name) << ": "
+                       << seconds << " s, "
+                       << (bytes / (1024.0 * 1024.0)) / seconds << " MB/s, "
+                       << (points / 1e6) / seconds << " Mpoints/s";
+}
+
+qint64 Benchmark::parseLegacy(QString fileName, double &checksum)
+{
+    //The line based parser which was used before the memory mapped import engine
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return 0;
+
+    QTextStream inputStream(&file);
+    QString line = inputStream.readLine();
+    qint64 points = 0;
+
+    while(!line.isNull())
+    {
+        QStringList lineparts = line.split(" ");
+
+        if(lineparts.count() >= 3)
+        {
+            int first = (lineparts.count() == 8 || lineparts.count() == 9) ? 2 : 0;
+            checksum += lineparts[first + 0].toFloat() + lineparts[first + 1].toFloat() + lineparts[first + 2].toFloat();
+            if(lineparts.count() >= 6)
+                checksum += lineparts[first + 3].toInt() + lineparts[first + 4].toInt() + lineparts[first + 5].toInt();
+            points++;
+        }
+
+        line = inputStream.readLine();
+    }
+
+    file.close();
+    return points;
+}
+
+qint64 Benchmark::parseMapped(QString fileName, double &checksum)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly) || file.size() == 0)
+        return 0;
+
+    uchar *mappedFile = file.map(0, file.size());
+    if(mappedFile == NULL)
+        return 0;
+
+    const char *cursor = (const char *)mappedFile;
+    const char *end = cursor + file.size();
+    qint64 points = 0;
+    PointBuffer buffer(PointBuffer::COLOR);
+    buffer.reserve(ImportWorker::BlockSize);
+
+    while(cursor < end)
+    {
+        const char *lineEnd = AsciiParser::findLineEnd(cursor, end);
+        int columns = ImportWorker::parseXYZLine(cursor, lineEnd, buffer);
+
+        if(columns > 0)
+        {
+            int i = buffer.size() - 1;
+            checksum += buffer.x[i] + buffer.y[i] + buffer.z[i];
+            if(columns >= 6)
+                checksum += qRed(buffer.rgba[i]) + qGreen(buffer.rgba[i]) + qBlue(buffer.rgba[i]);
+            points++;
+
+            if(buffer.size() >= ImportWorker::BlockSize)
+                buffer.clear();
+        }
+
+        cursor = (lineEnd < end) ? lineEnd + 1 : end;
+    }
+
+    file.unmap(mappedFile);
+    file.close();
+    return points;
+}
+
+void Benchmark::projection()
+{
+    //Synthetic scan around the origin, the projection does not depend on the file contents
+    const int count = 4 * 1024 * 1024;
+    QVector<float> x(count), y(count), z(count);
+    quint32 seed = 1;
+    for(int i = 0; i < count; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        x[i] = ((seed >> 8) & 0xffff) / 655.36f - 50.0f;
+        y[i] = ((seed >> 16) & 0xffff) / 655.36f - 50.0f;
+        z[i] = (((seed >> 4) ^ (seed >> 20)) & 0xffff) / 655.36f - 50.0f;
+    }
+
+    ProjectionKernel::Parameters parameters;
+    parameters.translation[0] = parameters.translation[1] = parameters.translation[2] = 0.0f;
+    parameters.width = 16384.0f;
+    parameters.height = 8192.0f;
+    parameters.scaleX = parameters.width / (2.0f * M_PI);
+    parameters.scaleY = parameters.height / M_PI;
+
+    QVector<float> referenceX(count), referenceY(count), radius(count), pixelX(count), pixelY(count);
+    QVector<unsigned char> referenceValid(count), valid(count);
+
+    ProjectionKernel::BatchFunction scalar = ProjectionKernel::scalarBatchFunction(ProjectionKernel::UP_Z, ProjectionKernel::EQUIRECTANGULAR);
+    ProjectionKernel::BatchFunction selected = ProjectionKernel::batchFunction(ProjectionKernel::UP_Z, ProjectionKernel::EQUIRECTANGULAR);
+
+    QElapsedTimer timer;
+    timer.start();
+    scalar(parameters, x.constData(), y.constData(), z.constData(), count,
+           referenceX.data(), referenceY.data(), radius.data(), referenceValid.data());
+    report("projection (scalar)", count * 3 * sizeof(float), count, timer.nsecsElapsed());
+
+    timer.restart();
+    selected(parameters, x.constData(), y.constData(), z.constData(), count,
+             pixelX.data(), pixelY.data(), radius.data(), valid.data());
+    report(QString("projection (%1)").arg(ProjectionKernel::kernelName()), count * 3 * sizeof(float), count, timer.nsecsElapsed());
+
+    //Deviation from the scalar reference in pixels of a 16384 x 8192 panorama
+    float maxDeviation = 0.0f;
+    int otherPixel = 0;
+    for(int i = 0; i < count; i++)
+    {
+        if(!valid[i] || !referenceValid[i])
+            continue;
+
+        maxDeviation = qMax(maxDeviation, qMax(qAbs(pixelX[i] - referenceX[i]), qAbs(pixelY[i] - referenceY[i])));
+        if((int)pixelX[i] != (int)referenceX[i] || (int)pixelY[i] != (int)referenceY[i])
+            otherPixel++;
+    }
+
+    qDebug() << "Benchmark: projection max. deviation" << maxDeviation << "pixels," << otherPixel << "of" << count << "points in a neighbouring pixel";
+}
+
+namespace
+{
+    //Splats one slice of the synthetic points, either into the shared store or into private tiles
+    class SplatTask : public QRunnable
+    {
+    public:
+        SplatTask(PanoramaStore *store, PanoramaTiles *tiles, const QVector<int> &column, const QVector<int> &row,
+                  const QVector<float> &depth, int first, int last)
+            : store(store), tiles(tiles), column(column), row(row), depth(depth), first(first), last(last)
+        {
+        }
+
+        void run()
+        {
+            for(int i = this->first; i < this->last; i++)
+            {
+                QRgb color = qRgb(i & 0xff, (i >> 8) & 0xff, (i >> 16) & 0xff);
+                if(this->tiles != NULL)
+                    this->tiles->plot(this->column.at(i), this->row.at(i), this->depth.at(i), color);
+                else
+                    this->store->plot(this->column.at(i), this->row.at(i), this->depth.at(i), color);
+            }
+        }
+
+    private:
+        PanoramaStore *store;
+        PanoramaTiles *tiles;
+        const QVector<int> &column;
+        const QVector<int> &row;
+        const QVector<float> &depth;
+        int first;
+        int last;
+    };
+}
+
+void Benchmark::splatting()
+{
+    //Points spread over the whole panorama, and points concentrated in a small window
+    splatContention("full panorama", 16384, 8192, 0);
+    splatContention("64x64 window", 16384, 8192, 64);
+}
+
+void Benchmark::splatContention(QString name, int width, int height, int window)
+{
+    const int count = 8 * 1024 * 1024;
+
+    QVector<int> column(count), row(count);
+    QVector<float> depth(count);
+    quint32 seed = 7;
+    for(int i = 0; i < count; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        column[i] = (window > 0) ? (seed >> 4) % window : (seed >> 4) % width;
+        seed = seed * 1664525u + 1013904223u;
+        row[i] = (window > 0) ? (seed >> 4) % window : (seed >> 4) % height;
+        depth[i] = ((seed >> 8) & 0xffff) / 655.36f;
+    }
+
+    PanoramaStore reference;
+    reference.resize(width, height);
+
+    QElapsedTimer timer;
+    timer.start();
+    SplatTask(&reference, NULL, column, row, depth, 0, count).run();
+    qint64 nsSerial = timer.nsecsElapsed();
+    report(QString("splatting %1 (serial)").arg(name), count * sizeof(quint64), count, nsSerial);
+
+    //Thread scaling of both concurrent modes: 1, 2, 4, ... threads and all cores
+    QList<int> threadCounts;
+    for(int threads = 1; threads < QThread::idealThreadCount(); threads *= 2)
+        threadCounts.append(threads);
+    threadCounts.append(QThread::idealThreadCount());
+
+    foreach(int threads, threadCounts)
+    {
+        QThreadPool pool;
+        pool.setMaxThreadCount(threads);
+
+        PanoramaStore atomicStore;
+        atomicStore.resize(width, height);
+
+        timer.restart();
+        for(int t = 0; t < threads; t++)
+        {
+            SplatTask *task = new SplatTask(&atomicStore, NULL, column, row, depth, (qint64)count * t / threads, (qint64)count * (t + 1) / threads);
+            pool.start(task);
+        }
+        pool.waitForDone();
+        qint64 nsAtomic = timer.nsecsElapsed();
+        report(QString("splatting %1 (atomic, %2 threads)").arg(name).arg(threads), count * sizeof(quint64), count, nsAtomic);
+
+        PanoramaStore mergedStore;
+        mergedStore.resize(width, height);
+        QList<PanoramaTiles*> privateTiles;
+
+        timer.restart();
+        for(int t = 0; t < threads; t++)
+        {
+            privateTiles.append(new PanoramaTiles(width, height));
+            SplatTask *task = new SplatTask(NULL, privateTiles.last(), column, row, depth, (qint64)count * t / threads, (qint64)count * (t + 1) / threads);
+            pool.start(task);
+        }
+        pool.waitForDone();
+        mergedStore.merge(privateTiles, threads);
+        qint64 nsPrivate = timer.nsecsElapsed();
+        report(QString("splatting %1 (private tiles, %2 threads)").arg(name).arg(threads), count * sizeof(quint64), count, nsPrivate);
+        qDeleteAll(privateTiles);
+
+        qDebug().nospace() << "Benchmark: splatting " << qPrintable(name) << " with " << threads << " threads: atomic "
+                           << (nsAtomic > 0 ? (double)nsSerial / nsAtomic : 0.0) << "x, private tiles "
+                           << (nsPrivate > 0 ? (double)nsSerial / nsPrivate : 0.0) << "x the serial speed, "
+                           << (nsAtomic <= nsPrivate ? "atomic" : "private tiles") << " is faster";
+
+        //The depth test does not depend on the order, all three have to be identical
+        int differences = 0;
+        for(int y = 0; y < height; y++)
+        {
+            for(int x = 0; x < width; x++)
+            {
+                if(atomicStore.wordAt(x, y) != reference.wordAt(x, y) || mergedStore.wordAt(x, y) != reference.wordAt(x, y))
+                    differences++;
+            }
+        }
+
+        if(differences > 0)
+            qDebug() << "Benchmark: WARNING splatting" << name << "with" << threads << "threads differs from the serial result in" << differences << "pixels";
+    }
+}
+
+qint64 Benchmark::readXyb(QString fileName, double &checksum)
+{
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly))
+        return 0;
+
+    XybHeader header;
+    QString errorString;
+    if(!XybFile::readHeader(file, header, errorString))
+    {
+        qDebug() << "Benchmark:" << errorString;
+        return 0;
+    }
+
+    uchar *mappedFile = file.map(0, file.size());
+    if(mappedFile == NULL)
+        return 0;
+
+    const XybRecord *records = (const XybRecord *)(mappedFile + header.headerSize);
+    for(quint64 i = 0; i < header.pointCount; i++)
+    {
+        checksum += records[i].x + records[i].y + records[i].z + records[i].r + records[i].g + records[i].b;
+    }
+
+    file.unmap(mappedFile);
+    file.close();
+    return header.pointCount;
+}
+
+void Benchmark::objWriting()
+{
+    //A synthetic indexed mesh like the one of a panorama tile: a wavy 1024 x 2048 grid of vertices
+    const int columns = 1024;
+    const int rows = 2048;
+    const qint64 quads = (qint64)(columns - 1) * (rows - 1);
+    QString fileName = QDir::tempPath() + "/pointcloud2blender_benchmark.obj";
+    QElapsedTimer timer;
+
+    //Legacy: one QTextStream call per token
+    {
+        timer.start();
+        QFile file(fileName);
+        if(!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        {
+            qDebug() << "Benchmark: cannot write" << fileName;
+            return;
+        }
+
+        QTextStream outputStream(&file);
+        for(int x = 0; x < columns; x++)
+        {
+            for(int y = 0; y < rows; y++)
+            {
+                outputStream << "v " << x * 0.01f << " " << y * 0.01f << " " << qSin(x * 0.05f) * qCos(y * 0.05f) << "\n";
+                outputStream << "vt " << x / (float)columns << " " << y / (float)rows << "\n";
+            }
+        }
+        for(int x = 0; x < columns - 1; x++)
+        {
+            for(int y = 0; y < rows - 1; y++)
+            {
+                int v = x * rows + y + 1;
+                outputStream << "f " << v << "/" << v << " " << v + rows << "/" << v + rows << " "
+                             << v + rows + 1 << "/" << v + rows + 1 << " " << v + 1 << "/" << v + 1 << "\n";
+            }
+        }
+        outputStream.flush();
+        file.close();
+        report("OBJ QTextStream (legacy)", QFileInfo(fileName).size(), quads, timer.nsecsElapsed());
+    }
+
+    //Buffered writer: fixed precision formatting, disk writes on the I/O thread
+    qint64 bytes = 0;
+    {
+        timer.restart();
+        ObjWriter obj;
+        if(!obj.open(fileName))
+        {
+            qDebug() << "Benchmark:" << obj.errorString;
+            return;
+        }
+
+        for(int x = 0; x < columns; x++)
+        {
+            for(int y = 0; y < rows; y++)
+            {
+                obj.vertex(x * 0.01f, y * 0.01f, qSin(x * 0.05f) * qCos(y * 0.05f));
+                obj.textureCoordinate(x / (float)columns, y / (float)rows);
+            }
+        }
+        for(int x = 0; x < columns - 1; x++)
+        {
+            for(int y = 0; y < rows - 1; y++)
+            {
+                int v = x * rows + y + 1;
+                int corners[4] = { v, v + rows, v + rows + 1, v + 1 };
+                obj.face(corners, corners, 4);
+            }
+        }
+        bytes = obj.bytesWritten();
+        obj.close();
+        report("OBJ buffered writer", bytes, quads, timer.nsecsElapsed());
+    }
+
+    //Upper bound: the same amount of bytes written without any formatting
+    {
+        QByteArray block(ObjWriter::BufferSize, ' ');
+        timer.restart();
+        QFile file(fileName);
+        if(file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            for(qint64 written = 0; written < bytes; written += block.size())
+                file.write(block.constData(), qMin((qint64)block.size(), bytes - written));
+            file.close();
+        }
+        report("raw file write (disk bandwidth)", bytes, quads, timer.nsecsElapsed());
+    }
+
+    QFile::remove(fileName);
+}
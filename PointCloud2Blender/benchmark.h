@@ -0,0 +1,60 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <QStringList>
+#include <QDir>
+#include <QFileInfo>
+#include <QtMath>
+
+#include "importworker.h"
+#include "projectionkernel.h"
+#include "panoramastore.h"
+#include "objwriter.h"
+
+#include <QThreadPool>
+
+/*
+ * Measures the throughput of the import stages on a real point cloud file.
+ * Started with --benchmark --input={file}, prints the results and exits.
+ */
+class Benchmark
+{
+public:
+    static int run(QString fileName);
+
+private:
+    static void warmUp(QString fileName);
+    static void report(QString name, qint64 bytes, qint64 points, qint64 nanoseconds);
+
+    static qint64 parseLegacy(QString fileName, double &checksum);
+    static qint64 parseMapped(QString fileName, double &checksum);
+    static qint64 readXyb(QString fileName, double &checksum);
+    static void projection();
+    static void splatting();
+    static void splatContention(QString name, int width, int height, int window);
+    static void objWriting();
+};
+
+#endif // BENCHMARK_H
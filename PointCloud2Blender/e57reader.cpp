@@ -0,0 +1,612 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "e57reader.h"
+
+#include <QtEndian>
+#include <QtMath>
+#include <QVarLengthArray>
+#include <QDebug>
+
+#include <cstring>
+
+const int E57Reader::PageBlock;
+
+const char *E57Reader::roleNames[E57Reader::ROLE_COUNT] =
+{
+    "cartesianX", "cartesianY", "cartesianZ",
+    "sphericalRange", "sphericalAzimuth", "sphericalElevation",
+    "colorRed", "colorGreen", "colorBlue",
+    "intensity", "rowIndex", "columnIndex", "cartesianInvalidState", "sphericalInvalidState"
+};
+
+E57Reader::E57Reader()
+{
+    this->pageSize = 0;
+    this->fileLength = 0;
+    this->firstLoadedPage = -1;
+    this->loadedPages = 0;
+    this->scan = NULL;
+    this->translate = true;
+    this->packetOffset = 0;
+    this->sectionEnd = 0;
+    this->recordsRead = 0;
+
+    for(int i = 0; i < ROLE_COUNT; i++)
+        this->roles[i] = -1;
+}
+
+E57Reader::~E57Reader()
+{
+    close();
+}
+
+bool E57Reader::open(QString fileName)
+{
+    close();
+
+    this->file.setFileName(fileName);
+    if(!this->file.open(QIODevice::ReadOnly))
+    {
+        this->errorString = "Cannot open " + fileName;
+        return false;
+    }
+
+    //File header: signature, version, physical length, XML offset and length, page size
+    QByteArray header = this->file.read(48);
+    const uchar *h = (const uchar *)header.constData();
+    if(header.size() != 48 || memcmp(h, "ASTM-E57", 8) != 0)
+    {
+        this->errorString = fileName + " is not an E57 file";
+        return false;
+    }
+
+    quint32 majorVersion = qFromLittleEndian<quint32>(h + 8);
+    this->fileLength = qFromLittleEndian<quint64>(h + 16);
+    qint64 xmlOffset = qFromLittleEndian<quint64>(h + 24);
+    qint64 xmlLength = qFromLittleEndian<quint64>(h + 32);
+    this->pageSize = qFromLittleEndian<quint64>(h + 40);
+
+    if(majorVersion != 1 || this->pageSize <= 4 || this->pageSize > 1024 * 1024 || xmlLength <= 0 || xmlLength > this->fileLength)
+    {
+        this->errorString = "Unsupported E57 header in " + fileName;
+        return false;
+    }
+
+    QByteArray xmlData(xmlLength, 0);
+    if(!readLogical(logicalOffset(xmlOffset), xmlData.data(), xmlLength))
+        return false;
+
+    QXmlStreamReader xml(xmlData);
+    Node root;
+    while(!xml.atEnd() && !xml.isStartElement())
+        xml.readNext();
+
+    if(!xml.isStartElement() || !readNode(xml, root))
+    {
+        this->errorString = "Invalid E57 XML section: " + xml.errorString();
+        return false;
+    }
+
+    return parseScans(root);
+}
+
+void E57Reader::close()
+{
+    this->file.close();
+    this->scans.clear();
+    this->decoders.clear();
+    this->pages.clear();
+    this->firstLoadedPage = -1;
+    this->loadedPages = 0;
+    this->scan = NULL;
+}
+
+bool E57Reader::readNode(QXmlStreamReader &xml, Node &node)
+{
+    node.name = xml.name().toString();
+    node.attributes = xml.attributes();
+
+    while(!xml.atEnd())
+    {
+        xml.readNext();
+
+        if(xml.isStartElement())
+        {
+            QSharedPointer<Node> child(new Node());
+            node.children.append(child);
+            if(!readNode(xml, *child))
+                return false;
+        }
+        else if(xml.isCharacters())
+        {
+            node.text += xml.text();
+        }
+        else if(xml.isEndElement())
+        {
+            node.text = node.text.trimmed();
+            return true;
+        }
+    }
+
+    return !xml.hasError();
+}
+
+const E57Reader::Node *E57Reader::Node::child(const QString &childName) const
+{
+    for(int i = 0; i < this->children.size(); i++)
+    {
+        if(this->children.at(i)->name == childName)
+            return this->children.at(i).data();
+    }
+    return NULL;
+}
+
+double E57Reader::Node::number(const QString &childName, double fallback) const
+{
+    const Node *node = child(childName);
+    bool ok = false;
+    double value = node ? node->text.toDouble(&ok) : 0.0;
+    return ok ? value : fallback;
+}
+
+bool E57Reader::parseField(const Node &node, Field &field)
+{
+    QString type = node.attributes.value("type").toString();
+    field.name = node.name;
+    field.scale = 1.0;
+    field.offset = 0.0;
+    field.minimum = 0;
+    field.maximum = 0;
+
+    if(type == "Float")
+    {
+        //Limits of floats are only used for colors and intensities
+        field.type = (node.attributes.value("precision") == "single") ? Field::FLOAT : Field::DOUBLE;
+        field.bits = (field.type == Field::FLOAT) ? 32 : 64;
+        field.lower = node.attributes.hasAttribute("minimum") ? node.attributes.value("minimum").toString().toDouble() : 0.0;
+        field.upper = node.attributes.hasAttribute("maximum") ? node.attributes.value("maximum").toString().toDouble() : 1.0;
+        return true;
+    }
+
+    if(type != "Integer" && type != "ScaledInteger")
+        return false;
+
+    field.type = (type == "Integer") ? Field::INTEGER : Field::SCALED_INTEGER;
+    field.minimum = node.attributes.hasAttribute("minimum") ? node.attributes.value("minimum").toString().toLongLong() : Q_INT64_C(-9223372036854775807) - 1;
+    field.maximum = node.attributes.hasAttribute("maximum") ? node.attributes.value("maximum").toString().toLongLong() : Q_INT64_C(9223372036854775807);
+    if(node.attributes.hasAttribute("scale"))
+        field.scale = node.attributes.value("scale").toString().toDouble();
+    if(node.attributes.hasAttribute("offset"))
+        field.offset = node.attributes.value("offset").toString().toDouble();
+
+    //Bits of the range, 0 for a constant
+    quint64 range = (quint64)field.maximum - (quint64)field.minimum;
+    field.bits = 0;
+    while(field.bits < 64 && (range >> field.bits) != 0)
+        field.bits++;
+
+    field.lower = field.minimum * field.scale + field.offset;
+    field.upper = field.maximum * field.scale + field.offset;
+
+    return field.maximum >= field.minimum;
+}
+
+bool E57Reader::parseScans(const Node &root)
+{
+    const Node *data3D = root.child("data3D");
+    if(data3D == NULL || data3D->children.isEmpty())
+    {
+        this->errorString = "The E57 file contains no 3D data";
+        return false;
+    }
+
+    for(int i = 0; i < data3D->children.size(); i++)
+    {
+        const Node &scanNode = *data3D->children.at(i);
+        const Node *points = scanNode.child("points");
+        const Node *prototype = points ? points->child("prototype") : NULL;
+        if(prototype == NULL)
+            continue;
+
+        Scan scan;
+        const Node *name = scanNode.child("name");
+        scan.name = name ? name->text : QString("Scan %1").arg(i);
+        scan.fileOffset = points->attributes.value("fileOffset").toString().toLongLong();
+        scan.recordCount = points->attributes.value("recordCount").toString().toLongLong();
+
+        bool valid = true;
+        for(int j = 0; j < prototype->children.size() && valid; j++)
+        {
+            Field field;
+            valid = parseField(*prototype->children.at(j), field);
+            scan.prototype.append(field);
+        }
+
+        if(!valid)
+        {
+            qDebug() << "E57: skipping" << scan.name << "(unsupported point field)";
+            continue;
+        }
+
+        scan.hasPose = false;
+        const Node *pose = scanNode.child("pose");
+        if(pose != NULL)
+        {
+            const Node *rotation = pose->child("rotation");
+            const Node *translation = pose->child("translation");
+            if(rotation != NULL)
+                scan.rotation = QQuaternion(rotation->number("w", 1.0), rotation->number("x", 0.0), rotation->number("y", 0.0), rotation->number("z", 0.0)).normalized();
+            if(translation != NULL)
+                scan.translation = QVector3D(translation->number("x", 0.0), translation->number("y", 0.0), translation->number("z", 0.0));
+            scan.hasPose = true;
+        }
+
+        scan.hasColor = prototype->child("colorRed") != NULL && prototype->child("colorGreen") != NULL && prototype->child("colorBlue") != NULL;
+        scan.hasGrid = prototype->child("rowIndex") != NULL && prototype->child("columnIndex") != NULL;
+
+        this->scans.append(scan);
+    }
+
+    if(this->scans.isEmpty())
+    {
+        this->errorString = "The E57 file contains no readable scan";
+        return false;
+    }
+
+    return true;
+}
+
+qint64 E57Reader::logicalOffset(qint64 physicalOffset) const
+{
+    return (physicalOffset / this->pageSize) * (this->pageSize - 4) + physicalOffset % this->pageSize;
+}
+
+quint32 E57Reader::crc32c(const uchar *data, int length)
+{
+    static quint32 table[256];
+    static bool initialized = false;
+    if(!initialized)
+    {
+        //Castagnoli polynomial, reflected
+        for(quint32 i = 0; i < 256; i++)
+        {
+            quint32 crc = i;
+            for(int j = 0; j < 8; j++)
+                crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78u : crc >> 1;
+            table[i] = crc;
+        }
+        initialized = true;
+    }
+
+    quint32 crc = 0xFFFFFFFFu;
+    for(int i = 0; i < length; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+bool E57Reader::loadPages(qint64 firstPage)
+{
+    qint64 totalPages = this->fileLength / this->pageSize;
+    qint64 count = qMin((qint64)PageBlock, totalPages - firstPage);
+    if(firstPage < 0 || count <= 0 || !this->file.seek(firstPage * this->pageSize))
+    {
+        this->errorString = "E57: read beyond the end of the file";
+        return false;
+    }
+
+    this->pages = this->file.read(count * this->pageSize);
+    count = this->pages.size() / this->pageSize;
+
+    //Every page ends with the CRC-32C of its logical bytes (writers differ in the byte order)
+    for(qint64 i = 0; i < count; i++)
+    {
+        const uchar *page = (const uchar *)this->pages.constData() + i * this->pageSize;
+        quint32 crc = crc32c(page, this->pageSize - 4);
+        const uchar *stored = page + this->pageSize - 4;
+        if(crc != qFromBigEndian<quint32>(stored) && crc != qFromLittleEndian<quint32>(stored))
+        {
+            this->errorString = "E57: checksum error in page " + QString::number(firstPage + i);
+            this->firstLoadedPage = -1;
+            this->loadedPages = 0;
+            return false;
+        }
+    }
+
+    this->firstLoadedPage = firstPage;
+    this->loadedPages = count;
+    return count > 0;
+}
+
+bool E57Reader::readLogical(qint64 offset, char *data, qint64 length)
+{
+    qint64 logicalPageSize = this->pageSize - 4;
+
+    while(length > 0)
+    {
+        qint64 page = offset / logicalPageSize;
+        qint64 within = offset % logicalPageSize;
+
+        if(page < this->firstLoadedPage || page >= this->firstLoadedPage + this->loadedPages || this->firstLoadedPage < 0)
+        {
+            if(!loadPages(page))
+                return false;
+        }
+
+        qint64 bytes = qMin(length, logicalPageSize - within);
+        memcpy(data, this->pages.constData() + (page - this->firstLoadedPage) * this->pageSize + within, bytes);
+
+        data += bytes;
+        offset += bytes;
+        length -= bytes;
+    }
+
+    return true;
+}
+
+bool E57Reader::beginScan(int index, bool translate)
+{
+    if(index < 0 || index >= this->scans.size())
+        return false;
+
+    this->scan = &this->scans.at(index);
+    this->recordsRead = 0;
+    this->translate = translate;
+    this->decoders.clear();
+
+    for(int i = 0; i < ROLE_COUNT; i++)
+        this->roles[i] = -1;
+
+    for(int i = 0; i < this->scan->prototype.size(); i++)
+    {
+        this->decoders.append(FieldDecoder(this->scan->prototype.at(i)));
+        for(int role = 0; role < ROLE_COUNT; role++)
+        {
+            if(this->scan->prototype.at(i).name == roleNames[role])
+                this->roles[role] = i;
+        }
+    }
+
+    bool cartesian = roles[CARTESIAN_X] >= 0 && roles[CARTESIAN_Y] >= 0 && roles[CARTESIAN_Z] >= 0;
+    bool spherical = roles[SPHERICAL_RANGE] >= 0 && roles[SPHERICAL_AZIMUTH] >= 0 && roles[SPHERICAL_ELEVATION] >= 0;
+    if(!cartesian && !spherical)
+    {
+        this->errorString = "E57: " + this->scan->name + " has no coordinates";
+        return false;
+    }
+
+    //CompressedVector section header: id, reserved, logical length, data offset, index offset
+    uchar section[32];
+    qint64 sectionStart = logicalOffset(this->scan->fileOffset);
+    if(!readLogical(sectionStart, (char *)section, 32))
+        return false;
+
+    if(section[0] != 1)
+    {
+        this->errorString = "E57: " + this->scan->name + " has no compressed vector section";
+        return false;
+    }
+
+    this->sectionEnd = sectionStart + (qint64)qFromLittleEndian<quint64>(section + 8);
+    this->packetOffset = logicalOffset(qFromLittleEndian<quint64>(section + 16));
+    return true;
+}
+
+bool E57Reader::readPacket()
+{
+    if(this->packetOffset >= this->sectionEnd)
+        return false;
+
+    //Packet header: type, flags, logical length - 1
+    uchar header[4];
+    if(!readLogical(this->packetOffset, (char *)header, 4))
+        return false;
+
+    int length = qFromLittleEndian<quint16>(header + 2) + 1;
+    this->packet.resize(length);
+    if(!readLogical(this->packetOffset, this->packet.data(), length))
+        return false;
+    this->packetOffset += length;
+
+    //Index (0) and empty (2) packets carry no points
+    if(header[0] != 1)
+        return header[0] == 0 || header[0] == 2;
+
+    //Data packet: bytestream count, the length of every bytestream, the bytestreams
+    const uchar *data = (const uchar *)this->packet.constData();
+    int streams = (length >= 6) ? qFromLittleEndian<quint16>(data + 4) : 0;
+    int position = 6 + 2 * streams;
+    if(position > length)
+    {
+        this->errorString = "E57: corrupt data packet in " + this->scan->name;
+        return false;
+    }
+
+    for(int i = 0; i < streams && i < this->decoders.size(); i++)
+    {
+        int streamLength = qFromLittleEndian<quint16>(data + 6 + 2 * i);
+        if(position + streamLength > length)
+        {
+            this->errorString = "E57: corrupt data packet in " + this->scan->name;
+            return false;
+        }
+
+        this->decoders[i].append(this->packet.constData() + position, streamLength);
+        position += streamLength;
+    }
+
+    return true;
+}
+
+int E57Reader::readPoints(PointBuffer &points, int maxPoints)
+{
+    if(this->scan == NULL)
+        return 0;
+
+    QVarLengthArray<double, 32> values(this->decoders.size());
+    int count = 0;
+
+    while(count < maxPoints && this->recordsRead < this->scan->recordCount)
+    {
+        //A record needs one value of every field, the bytestreams are filled packet by packet
+        bool complete = true;
+        for(int i = 0; i < this->decoders.size() && complete; i++)
+            complete = this->decoders.at(i).hasValue();
+
+        if(!complete)
+        {
+            if(!readPacket())
+                break;
+            continue;
+        }
+
+        for(int i = 0; i < this->decoders.size(); i++)
+            values[i] = this->decoders[i].next();
+        this->recordsRead++;
+
+        //The invalid state of the coordinates in use, 1: direction only, 2: no measurement
+        bool cartesian = roles[CARTESIAN_X] >= 0 && roles[CARTESIAN_Y] >= 0 && roles[CARTESIAN_Z] >= 0;
+        int invalid = cartesian ? roles[CARTESIAN_INVALID] : roles[SPHERICAL_INVALID];
+        if(invalid >= 0 && values[invalid] != 0.0)
+            continue;
+
+        QVector3D position;
+        if(cartesian)
+        {
+            position = QVector3D(values[roles[CARTESIAN_X]], values[roles[CARTESIAN_Y]], values[roles[CARTESIAN_Z]]);
+        }
+        else
+        {
+            //Azimuth in the x-y plane, elevation above it
+            double range = values[roles[SPHERICAL_RANGE]];
+            double azimuth = values[roles[SPHERICAL_AZIMUTH]];
+            double elevation = values[roles[SPHERICAL_ELEVATION]];
+            position = QVector3D(range * qCos(elevation) * qCos(azimuth), range * qCos(elevation) * qSin(azimuth), range * qSin(elevation));
+        }
+
+        if(this->scan->hasPose)
+        {
+            position = this->scan->rotation.rotatedVector(position);
+            if(this->translate)
+                position += this->scan->translation;
+        }
+
+        QRgb color = PointBuffer::DefaultColor;
+        if(this->scan->hasColor)
+        {
+            int rgb[3];
+            for(int c = 0; c < 3; c++)
+            {
+                const Field &field = this->scan->prototype.at(roles[COLOR_RED + c]);
+                double span = qMax(field.upper - field.lower, 1e-9);
+                rgb[c] = qBound(0, (int)((values[roles[COLOR_RED + c]] - field.lower) * 255.0 / span + 0.5), 255);
+            }
+            color = qRgb(rgb[0], rgb[1], rgb[2]);
+        }
+        else if(roles[INTENSITY] >= 0)
+        {
+            const Field &field = this->scan->prototype.at(roles[INTENSITY]);
+            double span = qMax(field.upper - field.lower, 1e-9);
+            int gray = qBound(0, (int)((values[roles[INTENSITY]] - field.lower) * 255.0 / span + 0.5), 255);
+            color = qRgb(gray, gray, gray);
+        }
+
+        points.append(position.x(), position.y(), position.z(), color);
+        if(points.hasChannel(PointBuffer::GRID))
+        {
+            if(this->scan->hasGrid)
+                points.appendGrid((qint32)values[roles[ROW_INDEX]], (qint32)values[roles[COLUMN_INDEX]]);
+            else
+                points.appendGrid(-1, -1);
+        }
+
+        count++;
+    }
+
+    return count;
+}
+
+E57Reader::FieldDecoder::FieldDecoder(const Field &field)
+{
+    this->field = field;
+    this->bitPosition = 0;
+}
+
+void E57Reader::FieldDecoder::append(const char *data, int length)
+{
+    //Drop the consumed bytes once in a while, the rest of a packet stays
+    qint64 consumed = this->bitPosition >> 3;
+    if(consumed >= 65536 || consumed == this->data.size())
+    {
+        this->data.remove(0, consumed);
+        this->bitPosition -= consumed * 8;
+    }
+
+    this->data.append(data, length);
+}
+
+double E57Reader::FieldDecoder::next()
+{
+    const uchar *bytes = (const uchar *)this->data.constData();
+    qint64 byte = this->bitPosition >> 3;
+
+    if(this->field.type == Field::FLOAT)
+    {
+        float value;
+        quint32 bits = qFromLittleEndian<quint32>(bytes + byte);
+        memcpy(&value, &bits, 4);
+        this->bitPosition += 32;
+        return value;
+    }
+
+    if(this->field.type == Field::DOUBLE)
+    {
+        double value;
+        quint64 bits = qFromLittleEndian<quint64>(bytes + byte);
+        memcpy(&value, &bits, 8);
+        this->bitPosition += 64;
+        return value;
+    }
+
+    //Bit packed, least significant bit first
+    quint64 raw = 0;
+    int bits = this->field.bits;
+    if(bits > 0)
+    {
+        int shift = this->bitPosition & 7;
+        if(bits <= 56 && byte + 8 <= this->data.size())
+        {
+            raw = (qFromLittleEndian<quint64>(bytes + byte) >> shift) & ((Q_UINT64_C(1) << bits) - 1);
+        }
+        else
+        {
+            for(int i = 0; i < bits; i++)
+            {
+                qint64 bit = this->bitPosition + i;
+                raw |= (quint64)((bytes[bit >> 3] >> (bit & 7)) & 1) << i;
+            }
+        }
+        this->bitPosition += bits;
+    }
+
+    double value = (double)(qint64)((quint64)this->field.minimum + raw);
+    if(this->field.type == Field::SCALED_INTEGER)
+        value = value * this->field.scale + this->field.offset;
+
+    return value;
+}
@@ -0,0 +1,179 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef E57READER_H
+#define E57READER_H
+
+#include <QFile>
+#include <QString>
+#include <QList>
+#include <QVector>
+#include <QByteArray>
+#include <QVector3D>
+#include <QQuaternion>
+#include <QXmlStreamReader>
+#include <QSharedPointer>
+
+#include "pointbuffer.h"
+
+/*
+ * Reader for ASTM E57 files (the subset written by scanner software):
+ *
+ * - The file consists of pages (usually 1024 bytes), the last 4 bytes of every page are a CRC-32C
+ *   checksum. Offsets in the file are physical, the sections are contiguous in logical bytes.
+ * - The XML section describes the scans (/data3D): pose, point fields (prototype) and the offset
+ *   of their binary CompressedVector section.
+ * - A CompressedVector section holds data packets, every packet carries a piece of one bytestream
+ *   per field. The values of a field are bit packed (integers, scaled integers) or IEEE floats.
+ *
+ * The points of a scan are streamed: only one block of pages and the undecoded rest of the
+ * current packet per field are held in memory.
+ */
+class E57Reader
+{
+public:
+    struct Field
+    {
+        enum Type
+        {
+            FLOAT,
+            DOUBLE,
+            INTEGER,
+            SCALED_INTEGER
+        };
+
+        QString name;
+        Type type;
+        qint64 minimum;
+        qint64 maximum;
+        double scale;
+        double offset;
+        int bits;
+
+        //Range of the decoded values, colors and intensities are scaled from it
+        double lower;
+        double upper;
+    };
+
+    struct Scan
+    {
+        QString name;
+        qint64 fileOffset;
+        qint64 recordCount;
+        QList<Field> prototype;
+
+        //Scanner pose: p' = rotation * p + translation
+        bool hasPose;
+        QQuaternion rotation;
+        QVector3D translation;
+
+        bool hasColor;
+        bool hasGrid;
+    };
+
+    E57Reader();
+    ~E57Reader();
+
+    bool open(QString fileName);
+    void close();
+
+    //Streams the points of one scan: beginScan(), then readPoints() until it returns 0.
+    //Without the translation of the pose the points stay centered on the scanner, only rotated.
+    bool beginScan(int index, bool translate = true);
+    int readPoints(PointBuffer &points, int maxPoints);
+    qint64 pointsRead() const { return this->recordsRead; }
+
+    QList<Scan> scans;
+    QString errorString;
+
+private:
+    struct Node
+    {
+        QString name;
+        QXmlStreamAttributes attributes;
+        QString text;
+        QList<QSharedPointer<Node> > children;
+
+        const Node *child(const QString &childName) const;
+        double number(const QString &childName, double fallback) const;
+    };
+
+    class FieldDecoder
+    {
+    public:
+        FieldDecoder(const Field &field);
+
+        void append(const char *data, int length);
+        inline bool hasValue() const { return this->field.bits == 0 || this->availableBits() >= this->field.bits; }
+        double next();
+
+        Field field;
+
+    private:
+        inline qint64 availableBits() const { return (qint64)this->data.size() * 8 - this->bitPosition; }
+
+        QByteArray data;
+        qint64 bitPosition;
+    };
+
+    static bool readNode(QXmlStreamReader &xml, Node &node);
+    static bool parseField(const Node &node, Field &field);
+    bool parseScans(const Node &root);
+
+    qint64 logicalOffset(qint64 physicalOffset) const;
+    bool readLogical(qint64 offset, char *data, qint64 length);
+    bool loadPages(qint64 firstPage);
+    bool readPacket();
+
+    static quint32 crc32c(const uchar *data, int length);
+
+    QFile file;
+    qint64 pageSize;
+    qint64 fileLength;
+
+    //Block of checked pages
+    QByteArray pages;
+    qint64 firstLoadedPage;
+    qint64 loadedPages;
+
+    //Fields of the current scan by their meaning, -1 if missing
+    enum Role
+    {
+        CARTESIAN_X, CARTESIAN_Y, CARTESIAN_Z,
+        SPHERICAL_RANGE, SPHERICAL_AZIMUTH, SPHERICAL_ELEVATION,
+        COLOR_RED, COLOR_GREEN, COLOR_BLUE,
+        INTENSITY, ROW_INDEX, COLUMN_INDEX, CARTESIAN_INVALID, SPHERICAL_INVALID,
+        ROLE_COUNT
+    };
+    int roles[ROLE_COUNT];
+    static const char *roleNames[ROLE_COUNT];
+
+    //Current scan
+    const Scan *scan;
+    bool translate;
+    QList<FieldDecoder> decoders;
+    QByteArray packet;
+    qint64 packetOffset;
+    qint64 sectionEnd;
+    qint64 recordsRead;
+
+    //Pages read at once
+    static const int PageBlock = 256;
+};
+
+#endif // E57READER_H
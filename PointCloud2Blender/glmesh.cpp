@@ -17,6 +17,7 @@
 */
 
 #include "glmesh.h"
+#include "xybformat.h"
 
 GLMesh::GLMesh(QOpenGLShaderProgram *shaderProgram, int vertexAttr, int colorAttr) :
     shaderProgram( shaderProgram ),
@@ -90,6 +91,8 @@ void GLMesh::reset(bool meshed)
 
 void GLMesh::addPoint(Point3D &newPoint)
 {
+    QMutexLocker locker(&addMutex);
+
     if(lines)
     {
         lines = false;
@@ -113,6 +116,71 @@ void GLMesh::addPoint(Point3D &newPoint)
     }
 }
 
+void GLMesh::addPoints(const PointBuffer &points, int first, int count, QVector3D translationVector)
+{
+    QMutexLocker locker(&addMutex);
+
+    if(lines)
+    {
+        lines = false;
+    }
+
+    float tx = translationVector.x();
+    float ty = translationVector.y();
+    float tz = translationVector.z();
+
+    for(int i = first; i < first + count; i++)
+    {
+        if(currentVertex >= maxVertices)
+        {
+            reset(meshed);
+        }
+
+        vertices[currentVertex*3 + 0] = points.x[i] + tx;
+        vertices[currentVertex*3 + 1] = points.y[i] + ty;
+        vertices[currentVertex*3 + 2] = points.z[i] + tz;
+
+        QRgb color = points.color(i);
+        colors[currentVertex*3 + 0] = qRed(color) / 255.0f;
+        colors[currentVertex*3 + 1] = qGreen(color) / 255.0f;
+        colors[currentVertex*3 + 2] = qBlue(color) / 255.0f;
+
+        currentVertex++;
+    }
+}
+
+void GLMesh::addPoints(const XybRecord *records, int count, QVector3D translationVector)
+{
+    QMutexLocker locker(&addMutex);
+
+    if(lines)
+    {
+        lines = false;
+    }
+
+    float tx = translationVector.x();
+    float ty = translationVector.y();
+    float tz = translationVector.z();
+
+    for(int i = 0; i < count; i++)
+    {
+        if(currentVertex >= maxVertices)
+        {
+            reset(meshed);
+        }
+
+        vertices[currentVertex*3 + 0] = records[i].x + tx;
+        vertices[currentVertex*3 + 1] = records[i].y + ty;
+        vertices[currentVertex*3 + 2] = records[i].z + tz;
+
+        colors[currentVertex*3 + 0] = records[i].r / 255.0f;
+        colors[currentVertex*3 + 1] = records[i].g / 255.0f;
+        colors[currentVertex*3 + 2] = records[i].b / 255.0f;
+
+        currentVertex++;
+    }
+}
+
 void GLMesh::finished()
 {
     //gets called when a mesh has been filled with vertices
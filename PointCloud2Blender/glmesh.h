@@ -23,6 +23,8 @@
 #include "importworker.h"
 
 class Point3D;
+class PointBuffer;
+struct XybRecord;
 
 class GLMesh
 {
@@ -34,6 +36,8 @@ public:
 
     void reset(bool meshed);
     void addPoint(Point3D &newPoint);
+    void addPoints(const PointBuffer &points, int first, int count, QVector3D translationVector);
+    void addPoints(const XybRecord *records, int count, QVector3D translationVector);
     void finished();
 
 private:
@@ -45,6 +49,9 @@ private:
     bool meshed;
     bool lines;
 
+    //The scans of an E57 file are imported (and meshed) by several threads at once
+    QMutex addMutex;
+
     std::vector<float> vertices;
     std::vector<float> colors;
 
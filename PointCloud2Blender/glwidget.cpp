@@ -49,6 +49,19 @@ void GLWidget::addPoint(Point3D newPoint, QVector3D translationVector)
 }
 
 
+void GLWidget::addPoints(const PointBuffer &points, int first, int count, QVector3D translationVector)
+{
+    this->pointCloudMesh->addPoints(points, first, count, translationVector);
+
+    //One repaint request per block, queued because the importer runs in its own thread
+    QMetaObject::invokeMethod(this, "update", Qt::QueuedConnection);
+}
+
+void GLWidget::addPoints(const XybRecord *records, int count, QVector3D translationVector)
+{
+    this->pointCloudMesh->addPoints(records, count, translationVector);
+    QMetaObject::invokeMethod(this, "update", Qt::QueuedConnection);
+}
 
 void GLWidget::initializeGL()
 {
@@ -34,6 +34,8 @@ public:
 
     GLMesh *pointCloudMesh;
     void addPoint(Point3D newPoint, QVector3D translationVector);
+    void addPoints(const PointBuffer &points, int first, int count, QVector3D translationVector);
+    void addPoints(const XybRecord *records, int count, QVector3D translationVector);
 
 protected:
     void initializeGL();
@@ -17,6 +17,23 @@
 */
 
 #include "importworker.h"
+#include "structuredscan.h"
+#include "e57reader.h"
+
+#include <climits>
+
+const qint64 ImportWorker::ReadBlockSize;
+const qint64 ImportWorker::ChunkSize;
+const int ImportWorker::BlockSize;
+const qint64 ImportWorker::RecordSpanSize;
+const int ImportWorker::SampleStrata;
+const qint64 ImportWorker::SampleWindowSize;
+const int ImportWorker::MinimumSamples;
+const int ImportWorker::GridCalibrationWindows;
+const qint64 ImportWorker::GridCalibrationWindowSize;
+const int ImportWorker::PtxChunkLines;
+const int ImportWorker::E57CalibrationPoints;
+const qint64 ImportWorker::ScanOrderSampleSize;
 
 ImportWorker::ImportWorker(Panorama3D *panorama, GLWidget *glWidget, QString fileName, bool analyze, QObject *parent) :
     QObject(parent)
@@ -38,28 +55,62 @@ ImportWorker::ImportWorker(Panorama3D *panorama, GLWidget *glWidget, QString fil
     {
         this->fileType = PLY;
     }
+    else if(this->fileName.endsWith(".ptx"))
+    {
+        this->fileType = PTX;
+    }
+    else if(this->fileName.endsWith(".e57"))
+    {
+        this->fileType = E57;
+    }
+    else if(this->fileName.endsWith(".las"))
+    {
+        this->fileType = LAS;
+    }
     this->analyze = analyze;
 
     this->updateTimer.setInterval(10000);
 
+    this->analysisMode = SAMPLED_ANALYSIS;
+    this->fusedImport = false;
+    this->estimator = NULL;
+    this->chunkAnalysis = false;
+
     if(analyze)
     {
-        //angle accuracy must be <= than (360/maxHorizontalScannerResolution/4)
-
-        angle_accuracy = 360.0f/30000.0f/4.0f;
-        int n = qCeil(360.0f / angle_accuracy);
-
-        histogram_horizontal_angles.resize(n);
-        histogram_horizontal_angles.fill(0);
-
+        //The estimator bins the angles with 1/4 of the finest scanner step
+        this->estimator = new ResolutionEstimator(panorama);
     }
-    else
+    else if(this->panorama != NULL)
     {
         this->updateTimer.start();
         connect(&this->updateTimer, SIGNAL(timeout()), this->panorama, SLOT(refreshTextureMapsGUI()));
     }
 
     this->cancelThread = false;
+    this->bodySkipped = false;
+    this->scanOrder = false;
+    this->sequenceIndex = 0;
+    this->scanOrderColumnLength = 0;
+    this->scanOrderPhase = 0;
+    this->importerInfo = false;
+    this->commaSeparated = false;
+    this->lineLimit = -1;
+    this->recordStride = 0;
+    this->xybWriter = NULL;
+    this->conversionErrors = 0;
+    this->progressPosition = 0;
+    this->progressTotal = 0;
+    setPointChannels(PointBuffer::COLOR);
+    this->threadCount = QThread::idealThreadCount();
+    this->splattingMode = ATOMIC_SPLATTING;
+    this->chunkSplatting = SERIAL_SPLATTING;
+    this->pointCache = NULL;
+    this->caching = false;
+    this->parseCaching = false;
+    this->cacheWriter = NULL;
+    this->structuredScans = NULL;
+    this->e57Scan = 0;
 
     this->setAutoDelete(false);
 
@@ -68,39 +119,115 @@ ImportWorker::ImportWorker(Panorama3D *panorama, GLWidget *glWidget, QString fil
 ImportWorker::~ImportWorker()
 {
     this->updateTimer.stop();
+    delete this->xybWriter;
+    delete this->cacheWriter;
+    delete this->estimator;
 }
 
 void ImportWorker::run()
 {
     qDebug() << "Thread " << QThread::currentThread() << " is running";
 
-    switch(this->fileType)
+    //Only a projection is replayed from memory, the analysis and the conversion read the file
+    bool projecting = (this->panorama != NULL && !analyze && this->xybWriter == NULL);
+
+    if(projecting && this->pointCache != NULL && this->pointCache->isValidFor(this->fileName))
     {
-    default:
-    case XYZ_ASCII:
-        import_XYZ_Ascii_File();
-    break;
-    case XYZ_BINARY:
-        import_XYZ_Binary_File();
-    break;
-    case PLY:
-        import_PLY_File();
-    break;
+        import_Cache();
     }
-
-    if(analyze && !this->cancelThread)
+    else
     {
-        //Count histogram values
-        int resolution = 0;
-        for(int i = 0; i < histogram_horizontal_angles.size(); i++)
+        //The analysis reads the same points as the projection: it fills the caches as well, so the
+        //import with the detected resolution replays the buffered points instead of parsing again.
+        //.xyb and .las files are mapped without parsing already, a copy would not be faster.
+        //A sampled analysis only reads parts of the file, nothing can be cached then.
+        //PTX scans are range images already, they are not projected at all.
+        //The scans of an E57 file share the file, the caches only know one point set per file.
+        bool parsing = this->panorama != NULL && this->xybWriter == NULL && this->fileType != XYZ_BINARY && this->fileType != LAS && this->fileType != PTX && this->fileType != E57;
+
+        //Followed by the import, the file is read completely anyway: the full histogram reads it once
+        //and buffers the points for the import, sampling first would add a second complete pass
+        bool buffering = (this->pointCache != NULL && this->pointCache->isEnabled()) || this->parseCaching;
+        if(analyze && this->analysisMode == SAMPLED_ANALYSIS && this->fusedImport && parsing && buffering)
+        {
+            qDebug() << "Analysis followed by the import: full analysis, the points are buffered for the import";
+            this->analysisMode = FULL_ANALYSIS;
+        }
+
+        if(analyze && this->analysisMode == SAMPLED_ANALYSIS)
+            parsing = false;
+
+        this->caching = parsing && this->pointCache != NULL;
+        if(this->caching)
+            this->pointCache->begin(this->fileName);
+
+        ParseCache parseCache(this->fileName, this->parseCacheDirectory);
+
+        if(parsing && this->parseCaching && parseCache.hasPoints())
+        {
+            if(this->caching)
+                this->pointCache->shareFile(parseCache.dataFileName());
+            this->scanOrderColumnLength = parseCache.scanOrder(this->scanOrderPhase);
+            import_Parse_Cache(parseCache.dataFileName());
+        }
+        else
         {
-            if(histogram_horizontal_angles.at(i) != 0)
+            bool writeParseCache = parsing && this->parseCaching && openParseCache(parseCache);
+            if(writeParseCache && this->caching)
+                this->pointCache->shareFile(parseCache.dataFileName());
+
+            switch(this->fileType)
             {
-                resolution++;
+            default:
+            case XYZ_ASCII:
+                import_XYZ_Ascii_File();
+            break;
+            case XYZ_BINARY:
+                import_XYZ_Binary_File();
+            break;
+            case PLY:
+                import_PLY_File();
+            break;
+            case PTX:
+                import_PTX_File();
+            break;
+            case E57:
+                import_E57_File();
+            break;
+            case LAS:
+                import_LAS_File();
+            break;
             }
+
+            if(writeParseCache)
+                closeParseCache(parseCache);
         }
 
-        emit originalResolution(resolution);
+        if(this->caching)
+            this->pointCache->finish(!this->cancelThread && !this->bodySkipped);
+        this->caching = false;
+    }
+
+    if(this->xybWriter != NULL && !this->xybWriter->close())
+    {
+        emit showErrorMessage(this->xybWriter->errorString);
+    }
+
+    //Sent exactly once, after the last block was splatted and the private tiles were merged:
+    //the main window starts meshing or finishes the analysis on it
+    emit importStatus(100.0f);
+
+    if(analyze && !this->cancelThread)
+    {
+        //Files which could not be sampled (not mapped, .xyb) were analyzed completely
+        ResolutionEstimator::Result resolution = this->sampledResolution;
+        if(!resolution.isValid())
+            resolution = this->estimator->estimate();
+
+        qDebug() << "Original resolution" << resolution.horizontal << "x" << resolution.vertical
+                 << "confidence" << resolution.confidence << "from" << resolution.points << "points";
+
+        emit originalResolution(resolution.horizontal, resolution.vertical, resolution.confidence);
     }
     else
     {
@@ -117,354 +244,1784 @@ void ImportWorker::import_XYZ_Ascii_File()
     qDebug() << "opening file: " << this->fileName;
 
     QFile file(this->fileName);
-    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        emit showErrorMessage("Cannot open " + this->fileName);
         return;
+    }
 
-    qint64 totalSize = file.size();
-    qint64 currentSize = 0;
-    float percent = 0.0f;
-
-    QTextStream inputStream(&file);
-    QString line = inputStream.readLine();
-
-    bool importerInfo = false;
+    //The first line decides which channels the points need
+    const char *tokens[AsciiParser::MaxTokens];
+    QByteArray firstLine = file.readLine();
+    const char *lineEnd = AsciiParser::findLineEnd(firstLine.constData(), firstLine.constData() + firstLine.size());
+    this->commaSeparated = AsciiParser::hasCommas(firstLine.constData(), lineEnd);
+    if(this->commaSeparated)
+        qDebug() << "XYZ: the columns are separated by commas";
+
+    int columns = AsciiParser::tokenize(firstLine.constData(), lineEnd, tokens, AsciiParser::MaxTokens, this->commaSeparated);
+    if(columns >= 3 && columns < 6)
+        setPointChannels(PointBuffer::POSITION);
+    else if(columns == 8)
+        setPointChannels(PointBuffer::COLOR | PointBuffer::GRID);
+    else
+        setPointChannels(PointBuffer::COLOR);
 
-    while(!line.isNull() && !this->cancelThread)
+    //Scene LT export (grid columns) or scan line ordered export: the grid itself is the original resolution,
+    //the points are placed by their cell
+    bool gridPlacement = false;
+    if(this->panorama != NULL && this->xybWriter == NULL)
     {
-        currentSize += line.size();
+        if(columns == 8)
+            gridPlacement = calibrateScanGrid(file);
+        else if(columns == 6)
+            gridPlacement = inferScanOrder(file);
+    }
 
-        percent = (currentSize*100.0f)/totalSize;
+    if(gridPlacement && analyze)
+    {
+        this->bodySkipped = true;
+    }
+    else
+    {
+        import_Ascii_Body(file, 0, 0, -1);
+        flushBlock();
+    }
 
-        Point3D _newPoint;
+    file.close();
+}
 
-        //Process the line
-        QStringList lineparts = line.split(" ");
+bool ImportWorker::calibrateScanGrid(QFile &file)
+{
+    //Whole lines of windows spread over the file, the head alone may cover only a few columns
+    PointBuffer points(PointBuffer::COLOR | PointBuffer::GRID);
+    qint64 size = file.size();
+    qint64 stride = qMax(size / GridCalibrationWindows, GridCalibrationWindowSize);
 
-        if(lineparts.count() >= 3 && lineparts.count() < 6)
-        {
-            //Read only XYZ-Parts
-            _newPoint.x = lineparts[0].toFloat();
-            _newPoint.y = lineparts[1].toFloat();
-            _newPoint.z = lineparts[2].toFloat();
-            _newPoint.r = 128;
-            _newPoint.g = 128;
-            _newPoint.b = 128;
-        }
-        else if(lineparts.count() == 6)
-        {
-            //Probably Normal Faro Scene Export
-            _newPoint.x = lineparts[0].toFloat();
-            _newPoint.y = lineparts[1].toFloat();
-            _newPoint.z = lineparts[2].toFloat();
-            _newPoint.r = lineparts[3].toInt();
-            _newPoint.g = lineparts[4].toInt();
-            _newPoint.b = lineparts[5].toInt();
-        }
-        else if(lineparts.count() == 8 )
-        {
-            //Probably Faro Scene LT Export
-            if(!importerInfo)
-            {
-                importerInfo = true;
-                emit showInfoMessage("The imported file was probably generated by Faro Scene LT!");
-            }
-            _newPoint.x = lineparts[2].toFloat();
-            _newPoint.y = lineparts[3].toFloat();
-            _newPoint.z = lineparts[4].toFloat();
-            _newPoint.r = lineparts[5].toInt();
-            _newPoint.g = lineparts[6].toInt();
-            _newPoint.b = lineparts[7].toInt();
-        }
-        else if(lineparts.count() == 9 )
-        {
-            //Probably Agisoft Photoscan
-            _newPoint.x = lineparts[2].toFloat();
-            _newPoint.y = lineparts[3].toFloat();
-            _newPoint.z = lineparts[4].toFloat();
-            _newPoint.r = lineparts[5].toInt();
-            _newPoint.g = lineparts[6].toInt();
-            _newPoint.b = lineparts[7].toInt();
-        }
+    for(qint64 offset = 0; offset < size && !this->cancelThread; offset += stride)
+        readSampleLines(file, offset, GridCalibrationWindowSize, points);
 
+    file.seek(0);
 
-        if(analyze)
-        {
-            if(determineOriginalResolution( _newPoint )) break;
-        }
-        else
-        {
-            //send the current point over to the panorama data container
-            panorama->addPoint( _newPoint );
-            glWidget->addPoint( _newPoint, panorama->getTranslationVector() );
-        }
+    ScanGrid grid;
+    if(!grid.calibrate(this->panorama, points))
+    {
+        qDebug() << "Scan grid: no consistent grid in" << points.size() << "points, projecting instead";
+        return false;
+    }
 
-        emit importStatus(percent);
+    if(analyze)
+    {
+        this->sampledResolution.horizontal = grid.horizontalResolution();
+        this->sampledResolution.vertical = grid.verticalResolution();
+        this->sampledResolution.confidence = grid.confidence();
+        this->sampledResolution.points = points.size();
+    }
+    else
+    {
+        this->panorama->setScanGrid(grid);
+    }
 
+    return true;
+}
 
-        //read the next line
-        line = inputStream.readLine();
+bool ImportWorker::calibrateCachedGrid(const PointBuffer &sample)
+{
+    //The cells are kept with the cached points, the angles depend on the current panorama origin
+    ScanGrid grid;
+    if(!grid.calibrate(this->panorama, sample))
+    {
+        qDebug() << "Scan grid: no consistent grid in" << sample.size() << "cached points, projecting instead";
+        return false;
     }
 
-    file.close();
-
-    //after importing send a finished signal
-    emit importStatus(100.0f);
+    this->panorama->setScanGrid(grid);
+    return true;
 }
 
-void ImportWorker::import_XYZ_Binary_File()
+bool ImportWorker::inferScanOrder(QFile &file)
 {
-    //TODO
-    bool importerInfo = false;
+    PointBuffer points(PointBuffer::COLOR | PointBuffer::GRID);
+    readSampleLines(file, 0, ScanOrderSampleSize, points);
+    file.seek(0);
 
-    if(!importerInfo)
+    int phase;
+    int columnLength = ScanGrid::inferColumnLength(points, this->panorama->getTranslationVector(), phase);
+    if(columnLength == 0)
     {
-        importerInfo = true;
-        emit showErrorMessage("The imported .xyz file has binary format. This is not supported, yet!");
+        qDebug() << "Scan order: the points are not in scan line order, projecting instead";
+        return false;
     }
+
+    return applyScanOrder(points, columnLength, phase);
 }
 
-void ImportWorker::import_PLY_File()
+bool ImportWorker::applyScanOrder(PointBuffer &head, int columnLength, int phase)
 {
-    //import the filename
-    qDebug() << "opening file: " << this->fileName;
+    //The order has to describe a consistent grid as well
+    ScanGrid::assignSequence(head, 0, columnLength, phase);
+    ScanGrid grid;
+    if(!grid.calibrate(this->panorama, head))
+    {
+        qDebug() << "Scan order:" << columnLength << "points per column, but no consistent grid, projecting instead";
+        return false;
+    }
 
-    QFile file(this->fileName);
-    if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    qDebug() << "Scan order:" << columnLength << "points per column, first point in row" << phase;
+
+    //The caches keep the points in file order, the cells follow from the same index when they are replayed
+    this->scanOrderColumnLength = columnLength;
+    this->scanOrderPhase = phase;
+    if(this->caching)
+        this->pointCache->setScanOrder(columnLength, phase);
+
+    if(analyze)
+    {
+        this->sampledResolution.horizontal = grid.horizontalResolution();
+        this->sampledResolution.vertical = grid.verticalResolution();
+        this->sampledResolution.confidence = grid.confidence();
+        this->sampledResolution.points = head.size();
+    }
+    else
+    {
+        this->panorama->setScanGrid(grid);
+        this->panorama->setScanOrder(columnLength, phase);
+        this->scanOrder = true;
+        this->sequenceIndex = 0;
+    }
+
+    return true;
+}
+
+void ImportWorker::readSampleLines(QFile &file, qint64 offset, qint64 size, PointBuffer &points)
+{
+    if(!file.seek(offset))
         return;
 
+    QByteArray window = file.read(size);
+    const char *cursor = window.constData();
+    const char *end = cursor + window.size();
+
+    //The first line of a window is cut, the last one may be
+    if(offset > 0)
+        cursor = qMin(AsciiParser::findLineEnd(cursor, end) + 1, end);
+
+    while(cursor < end)
+    {
+        const char *lineEnd = AsciiParser::findLineEnd(cursor, end);
+        if(lineEnd == end)
+            break;
+
+        parseXYZLine(cursor, lineEnd, points, this->commaSeparated);
+        cursor = lineEnd + 1;
+    }
+}
+
+void ImportWorker::import_Ascii_Body(QFile &file, qint64 bodyOffset, qint64 skipLines, qint64 maxLines)
+{
     qint64 totalSize = file.size();
-    qint64 currentSize = 0;
-    float percent = 0.0f;
 
-    QTextStream inputStream(&file);
-    QString line = inputStream.readLine();
+    //Map the whole file into memory and tokenize the raw bytes in place
+    uchar *mappedFile = totalSize > 0 ? file.map(0, totalSize) : NULL;
+
+    if(mappedFile != NULL)
+    {
+        const char *data = (const char *)mappedFile;
+        const char *begin = AsciiParser::skipLines(data + bodyOffset, data + totalSize, skipLines);
+        const char *end = data + totalSize;
+
+        if(maxLines >= 0)
+            end = AsciiParser::skipLines(begin, end, maxLines);
+
+        if(isSampledAnalysis(end - begin))
+            analyze_Sampled(begin, end);
+        else if(this->threadCount > 1)
+            import_Parallel(begin, end, begin - data, totalSize);
+        else
+            parse_Ascii_Range(begin, end, begin - data, totalSize);
+
+        file.unmap(mappedFile);
+    }
+    else
+    {
+        //Mapping failed (e.g. 32 bit address space): read big blocks which end at a line break
+        file.seek(bodyOffset);
+        for(qint64 i = 0; i < skipLines && !file.atEnd(); i++)
+            file.readLine();
+
+        this->lineLimit = maxLines;
+
+        QByteArray block;
+        qint64 offset = file.pos();
+
+        while(!file.atEnd() && !this->cancelThread)
+        {
+            block += file.read(ReadBlockSize);
+
+            int usable = block.lastIndexOf('\n') + 1;
+            if(file.atEnd())
+                usable = block.size();
+            if(usable <= 0)
+                continue;
+
+            if(!parse_Ascii_Range(block.constData(), block.constData() + usable, offset, totalSize))
+                break;
 
-    bool importerInfo = false;
+            offset += usable;
+            block.remove(0, usable);
+        }
 
-    int maxVertices = 0;
-    int currentVertex = 0;
+        this->lineLimit = -1;
+    }
+}
 
-    bool header = true;
-    bool binary = false;
+void ImportWorker::import_Binary_Body(QFile &file, qint64 bodyOffset, qint64 recordCount, int stride)
+{
+    qint64 totalSize = file.size();
 
-    bool property_x = false;
-    bool property_y = false;
-    bool property_z = false;
-    bool property_red = false;
-    bool property_green = false;
-    bool property_blue = false;
-    bool property_alpha = false;
+    //Never read more records than the file contains
+    if(bodyOffset + recordCount * stride > totalSize)
+    {
+        qDebug() << "Binary body is truncated, expected" << recordCount << "records";
+        recordCount = (totalSize - bodyOffset) / stride;
+    }
 
-    /*
-    PLY Header definitions:
+    this->recordStride = stride;
 
-    ply
-    format ascii 1.0
-    format binary_little_endian 1.0
-    format binary_big_endian 1.0
-    element vertex 12
-    property float x
-    property float y
-    property float z
-    property uchar red
-    property uchar green
-    property uchar blue
-    property uchar alpha
-    end_header
+    uchar *mappedFile = totalSize > 0 ? file.map(0, totalSize) : NULL;
 
-    */
-    while(!line.isNull() && !this->cancelThread)
+    if(mappedFile != NULL)
     {
-        currentSize += line.size();
+        const char *data = (const char *)mappedFile;
+        const char *begin = data + bodyOffset;
+        const char *end = begin + recordCount * stride;
+
+        if(isSampledAnalysis(end - begin))
+            analyze_Sampled(begin, end);
+        else if(this->threadCount > 1)
+            import_Parallel(begin, end, bodyOffset, totalSize);
+        else
+            parse_Binary_Range(begin, end, bodyOffset, totalSize);
 
-        Point3D _newPoint;
+        file.unmap(mappedFile);
+    }
+    else
+    {
+        //Mapping failed: read big blocks of whole records
+        file.seek(bodyOffset);
 
-        //Process the line
-        QStringList lineparts = line.split(" ");
+        qint64 blockSize = (ReadBlockSize / stride) * stride;
+        qint64 remaining = recordCount * stride;
+        qint64 offset = bodyOffset;
 
-        if(header)
+        while(remaining > 0 && !this->cancelThread)
         {
-            percent = (currentSize*100.0f)/totalSize;
+            QByteArray block = file.read(qMin(blockSize, remaining));
+            int usable = (block.size() / stride) * stride;
+            if(usable <= 0)
+                break;
 
-            //Parse the header information
-            if(line.startsWith("format binary"))
-            {
-                binary = true;
-                qDebug() << "PLY: HEADER binary";
-            }
-            if(line.startsWith("element vertex"))
-            {
-                maxVertices = lineparts.at(2).toInt();
-                qDebug() << "PLY: HEADER maxVertices = " << maxVertices;
-            }
-            if(line.startsWith("property"))
+            if(!parse_Binary_Range(block.constData(), block.constData() + usable, offset, totalSize))
+                break;
+
+            offset += usable;
+            remaining -= usable;
+        }
+    }
+
+    this->recordStride = 0;
+}
+
+bool ImportWorker::import_Parallel(const char *begin, const char *end, qint64 offset, qint64 totalSize)
+{
+    //The chunks get parsed on all cores, but are handed over to the panorama in file order.
+    //This way the result is identical to a serial import.
+    QThreadPool chunkPool;
+    chunkPool.setMaxThreadCount(this->threadCount);
+
+    int maxChunksInFlight = this->threadCount * 2;
+    QQueue<ImportChunk*> chunks;
+    const char *cursor = begin;
+    bool continueImport = true;
+
+    //Binary chunks consist of whole records, ascii chunks end at a line break
+    qint64 chunkSize = ChunkSize;
+    if(this->recordStride > 0)
+        chunkSize = qMax(ChunkSize / this->recordStride, (qint64)1) * this->recordStride;
+
+    //Chunks may splat into the panorama themselves: the packed depth test does not depend on the order of the points
+    //Scan line ordered files are placed by the index of the point, known only on the import thread.
+    this->chunkSplatting = SERIAL_SPLATTING;
+    if(this->panorama != NULL && !analyze && this->xybWriter == NULL && !this->scanOrder)
+        this->chunkSplatting = this->splattingMode;
+
+    //The analysis counts the angles on the chunk threads as well, into one histogram per thread
+    this->chunkAnalysis = analyze && this->estimator != NULL && this->xybWriter == NULL;
+    bool handledByChunks = (this->chunkSplatting != SERIAL_SPLATTING || this->chunkAnalysis);
+
+    qDebug() << "Parallel import with" << this->threadCount << "threads, splatting mode" << this->chunkSplatting;
+
+    while(cursor < end || !chunks.isEmpty())
+    {
+        //Fill the pipeline with new byte ranges
+        while(cursor < end && chunks.size() < maxChunksInFlight && continueImport && !this->cancelThread)
+        {
+            const char *chunkEnd = end;
+            if(end - cursor > chunkSize)
             {
-                if(lineparts.at(2) == "x")
-                {
-                    property_x = true;
-                    qDebug() << "PLY: HEADER property = x";
-                }
-                if(lineparts.at(2) == "y")
-                {
-                    property_y = true;
-                    qDebug() << "PLY: HEADER property = y";
-                }
-                if(lineparts.at(2) == "z")
-                {
-                    property_z = true;
-                    qDebug() << "PLY: HEADER property = z";
-                }
-                if(lineparts.at(2).contains("red"))
-                {
-                    property_red = true;
-                    qDebug() << "PLY: HEADER property = red";
-                }
-                if(lineparts.at(2).contains("green"))
-                {
-                    property_green = true;
-                    qDebug() << "PLY: HEADER property = green";
-                }
-                if(lineparts.at(2).contains("blue"))
+                if(this->recordStride > 0)
                 {
-                    property_blue = true;
-                    qDebug() << "PLY: HEADER property = blue";
+                    chunkEnd = cursor + chunkSize;
                 }
-                if(lineparts.at(2).contains("alpha"))
+                else
                 {
-                    property_alpha = true;
-                    qDebug() << "PLY: HEADER property = alpha";
+                    chunkEnd = AsciiParser::findLineEnd(cursor + chunkSize, end);
+                    if(chunkEnd < end) chunkEnd++;
                 }
             }
 
+            ImportChunk *chunk = new ImportChunk(this, cursor, chunkEnd);
+            chunks.enqueue(chunk);
+            chunkPool.start(chunk);
+
+            cursor = chunkEnd;
+        }
+
+        if(chunks.isEmpty())
+            break;
+
+        ImportChunk *chunk = chunks.dequeue();
+        chunk->finished.acquire();
+
+        if(continueImport && !this->cancelThread)
+        {
+            if(chunk->sceneLT && !importerInfo)
+            {
+                importerInfo = true;
+                emit showInfoMessage("The imported file was probably generated by Faro Scene LT!");
+            }
+
+            //The chunk is handed over in blocks, without copying the points again.
+            //The last chunk stays below 100%, the private tiles are merged after it.
+            this->progressPosition = qMin(offset + (chunk->end - begin), (qint64)(totalSize * 0.99f));
+            continueImport = flushBlock();
 
-            if(line.startsWith("end_header"))
+            for(int i = 0; i < chunk->points.size() && continueImport; i += BlockSize)
             {
-                header = false;
+                continueImport = processBlock(chunk->points, i, qMin(BlockSize, chunk->points.size() - i), handledByChunks);
             }
         }
-        else
+
+        delete chunk;
+    }
+
+    chunkPool.waitForDone();
+    finishSplatting();
+    this->chunkAnalysis = false;
+
+    return continueImport && !this->cancelThread;
+}
+
+bool ImportWorker::isSampledAnalysis(qint64 size)
+{
+    //Small files are analyzed completely, the windows would cover most of them anyway
+    return analyze && this->analysisMode == SAMPLED_ANALYSIS && size > SampleWindowSize * MinimumSamples * 2;
+}
+
+void ImportWorker::analyze_Sampled(const char *begin, const char *end)
+{
+    //Estimate within the 95% confidence interval +-0.5%
+    const float stableConfidence = 0.995f;
+
+    QThreadPool samplePool;
+    samplePool.setMaxThreadCount(this->threadCount);
+
+    QList<ResolutionEstimator::Result> samples;
+    ResolutionEstimator::Result estimate;
+    qint64 size = end - begin;
+    int parsed = 0;
+
+    //Bit reversed order of the strata: every round spreads over the whole file
+    for(int round = 0; round < SampleStrata && !this->cancelThread; round += this->threadCount)
+    {
+        QList<ImportChunk*> chunks;
+
+        for(int i = round; i < qMin(round + this->threadCount, SampleStrata); i++)
         {
-            //Parse the mesh data
-            if(binary)
+            int stratum = 0;
+            for(int bit = 1, reversed = SampleStrata / 2; bit < SampleStrata; bit <<= 1, reversed >>= 1)
             {
-                //Binary
-                if(!importerInfo)
-                {
-                    importerInfo = true;
-                    emit showErrorMessage("The imported .ply file has binary format. This is not supported, yet!");
-                }
-                break;
+                if(i & bit)
+                    stratum |= reversed;
+            }
+
+            const char *windowBegin = begin + size * stratum / SampleStrata;
+            const char *windowEnd;
+
+            if(this->recordStride > 0)
+            {
+                windowBegin = begin + ((windowBegin - begin) / this->recordStride) * this->recordStride;
+                windowEnd = windowBegin + qMin((SampleWindowSize / this->recordStride) * this->recordStride, (qint64)((end - windowBegin) / this->recordStride) * this->recordStride);
             }
             else
             {
-                //Ascii
-                if(currentVertex < maxVertices)
-                {
-                    percent = (currentVertex*100.0f)/maxVertices;
-
-                    if(lineparts.size() >= 3)
-                    {
-                        if(property_x)
-                            _newPoint.x = lineparts.at(0).toFloat();
-                        else
-                            _newPoint.x = 0;
-                        if(property_y)
-                            _newPoint.y = lineparts.at(1).toFloat();
-                        else
-                            _newPoint.y = 0;
-                        if(property_z)
-                            _newPoint.z = lineparts.at(2).toFloat();
-                        else
-                            _newPoint.z = 0;
-                        if(property_red)
-                            _newPoint.r = lineparts.at(3).toFloat();
-                        else
-                            _newPoint.r = 0;
-                        if(property_green)
-                            _newPoint.g = lineparts.at(4).toFloat();
-                        else
-                            _newPoint.g = 0;
-                        if(property_blue)
-                            _newPoint.b = lineparts.at(5).toFloat();
-                        else
-                            _newPoint.b = 0;
-                        if(property_alpha)
-                        {
-                            //TODO: implement alpha value?
-                        }
-
-                        currentVertex++;
-
-                        if(analyze)
-                        {
-                            if(determineOriginalResolution( _newPoint )) break;
-                        }
-                        else
-                        {
-                            //send the current point over to the panorama data container and 3D viewer:
-                            panorama->addPoint( _newPoint );
-                            glWidget->addPoint( _newPoint, panorama->getTranslationVector() );
-
-                        }
-
-                    }
-
-                }
-                else
-                {
-                    break;
-                }
+                //Whole lines only
+                if(windowBegin > begin)
+                    windowBegin = AsciiParser::findLineEnd(windowBegin, end) + 1;
+                if(windowBegin >= end)
+                    continue;
+
+                windowEnd = AsciiParser::findLineEnd(windowBegin + qMin(SampleWindowSize, (qint64)(end - windowBegin)) - 1, end);
+                if(windowEnd < end) windowEnd++;
             }
+
+            if(windowBegin >= windowEnd)
+                continue;
+
+            ImportChunk *chunk = new ImportChunk(this, windowBegin, windowEnd);
+            chunk->sampled = true;
+            chunks.append(chunk);
+            samplePool.start(chunk);
         }
 
-        emit importStatus(percent);
+        samplePool.waitForDone();
 
+        foreach(ImportChunk *chunk, chunks)
+        {
+            samples.append(chunk->sample);
+            parsed++;
+        }
+        qDeleteAll(chunks);
 
-        //read the next line
-        line = inputStream.readLine();
+        estimate = ResolutionEstimator::combineSamples(samples);
+        emit importStatus(qMin(99.0f, 100.0f * parsed / SampleStrata));
+
+        if(samples.size() >= MinimumSamples && estimate.confidence >= stableConfidence)
+            break;
     }
 
-    file.close();
+    qDebug() << "Sampled analysis:" << samples.size() << "of" << SampleStrata << "windows, confidence" << estimate.confidence;
 
-    //after importing send a finished signal
-    emit importStatus(100.0f);
+    this->sampledResolution = estimate;
+}
+
+void ImportWorker::finishSplatting()
+{
+    if(!this->privateTiles.isEmpty())
+    {
+        this->panorama->mergePrivateTiles(this->privateTiles.values(), this->threadCount);
+        qDeleteAll(this->privateTiles);
+        this->privateTiles.clear();
+    }
+    this->chunkSplatting = SERIAL_SPLATTING;
 }
 
-bool ImportWorker::determineOriginalResolution(Point3D newPoint)
+void ImportWorker::import_Cache()
 {
-    float theta, phi, radius;
+    qDebug() << "Re-projecting" << this->pointCache->size() << "cached points of" << this->fileName;
+
+    setPointChannels(PointBuffer::COLOR);
+    this->progressTotal = this->pointCache->size();
+    this->progressPosition = 0;
+
+    if(this->pointCache->isSpilled())
+    {
+        import_Cache_Records();
+        return;
+    }
+
+    //The segments are splatted on all cores, the viewer gets them on this thread
+    const QList<PointBuffer> &segments = this->pointCache->segments();
 
-    this->panorama->convertToSpherical(newPoint, theta, phi, radius);
+    if(!segments.isEmpty() && segments.first().hasChannel(PointBuffer::GRID))
+    {
+        //Windows spread over the segments, like the calibration windows of the file
+        PointBuffer sample(PointBuffer::COLOR | PointBuffer::GRID);
+        int stride = qMax(1, segments.size() / GridCalibrationWindows);
+        for(int i = 0; i < segments.size(); i += stride)
+        {
+            const PointBuffer &segment = segments.at(i);
+            for(int j = 0; j < qMin(segment.size(), GridCalibrationWindowPoints); j++)
+            {
+                sample.append(segment.x.at(j), segment.y.at(j), segment.z.at(j), segment.color(j));
+                sample.appendGrid(segment.row.at(j), segment.column.at(j));
+            }
+        }
+
+        calibrateCachedGrid(sample);
+    }
 
-    /*
-     * BUGFIX: floating-point imprecision leading to negative index
-     */
-    if(theta < angle_accuracy)
+    if(this->pointCache->scanOrderColumnLength() > 0 && !segments.isEmpty())
     {
-        //theta = 0.0f;
+        //The head of the cloud calibrates the grid again, like the sample of the file
+        const PointBuffer &segment = segments.first();
+        PointBuffer head(PointBuffer::COLOR | PointBuffer::GRID);
+        for(int j = 0; j < qMin(segment.size(), ScanOrderSamplePoints); j++)
+            head.append(segment.x.at(j), segment.y.at(j), segment.z.at(j), segment.color(j));
+
+        applyScanOrder(head, this->pointCache->scanOrderColumnLength(), this->pointCache->scanOrderPhase());
     }
 
-    float alpha = qRadiansToDegrees(theta);
+    QThreadPool replayPool;
+    replayPool.setMaxThreadCount(this->threadCount);
 
-    int index = 0;
+    //Scan line ordered points are placed by their index, in file order on this thread
+    this->chunkSplatting = (this->threadCount > 1 && !this->scanOrder) ? this->splattingMode : SERIAL_SPLATTING;
+    bool projected = (this->chunkSplatting != SERIAL_SPLATTING);
 
-    if(alpha >= angle_accuracy)
+    if(projected)
     {
-        index = qFloor(alpha / angle_accuracy);
+        for(int i = 0; i < segments.size(); i++)
+            replayPool.start(new CacheReplayTask(this, &segments.at(i)));
     }
 
-    //Sanity check:
-    if(index >= 0 && index < histogram_horizontal_angles.size() )
+    bool continueImport = true;
+    for(int i = 0; i < segments.size() && continueImport; i++)
     {
-        //increment histogram value depending on horizontal angle
-        histogram_horizontal_angles[ index ]++;
+        const PointBuffer &segment = segments.at(i);
+        this->progressPosition += segment.size();
+
+        for(int j = 0; j < segment.size() && continueImport; j += BlockSize)
+        {
+            continueImport = processBlock(segment, j, qMin(BlockSize, segment.size() - j), projected);
+        }
     }
 
-    //continue analyzing
-    return false;
+    replayPool.waitForDone();
+    finishSplatting();
 }
 
-void ImportWorker::stopThread()
+void ImportWorker::import_Parse_Cache(QString dataFileName)
 {
-    this->cancelThread = true;
+    qDebug() << "Parse cache: importing" << dataFileName << "instead of parsing" << this->fileName;
+
+    //The cache is a regular .xyb file
+    QString sourceFileName = this->fileName;
+    FileType sourceFileType = this->fileType;
+
+    this->fileName = dataFileName;
+    this->fileType = XYZ_BINARY;
+    import_XYZ_Binary_File();
+
+    this->fileName = sourceFileName;
+    this->fileType = sourceFileType;
+}
+
+bool ImportWorker::openParseCache(ParseCache &parseCache)
+{
+    //Written under another name, an interrupted import must not leave a valid looking cache
+    this->cacheWriter = new XybWriter();
+    this->cacheWriter->keepGrid();
+    if(!this->cacheWriter->open(parseCache.dataFileName() + ".part", QVector3D()))
+    {
+        qDebug() << "Parse cache:" << this->cacheWriter->errorString;
+        delete this->cacheWriter;
+        this->cacheWriter = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+void ImportWorker::closeParseCache(ParseCache &parseCache)
+{
+    QString partFileName = parseCache.dataFileName() + ".part";
+    qint64 pointCount = this->cacheWriter->count();
+    bool grid = this->cacheWriter->hasGrid();
+    bool written = this->cacheWriter->close();
+
+    delete this->cacheWriter;
+    this->cacheWriter = NULL;
+
+    if(!written || this->cancelThread || this->bodySkipped)
+    {
+        QFile::remove(partFileName);
+        QFile::remove(XybFile::gridFileName(partFileName));
+        return;
+    }
+
+    //The cells of a previous version must not be taken for the new points
+    QFile::remove(parseCache.dataFileName());
+    QFile::remove(XybFile::gridFileName(parseCache.dataFileName()));
+    if(!QFile::rename(partFileName, parseCache.dataFileName())
+            || (grid && !QFile::rename(XybFile::gridFileName(partFileName), XybFile::gridFileName(parseCache.dataFileName()))))
+    {
+        qDebug() << "Parse cache: cannot rename" << partFileName;
+        QFile::remove(partFileName);
+        QFile::remove(XybFile::gridFileName(partFileName));
+        QFile::remove(parseCache.dataFileName());
+        return;
+    }
+
+    parseCache.storePoints(pointCount, this->scanOrderColumnLength, this->scanOrderPhase);
+}
+
+void ImportWorker::import_Cache_Records()
+{
+    QFile file(this->pointCache->spillFileName());
+    XybHeader header;
+    QString errorString;
+
+    if(!file.open(QIODevice::ReadOnly) || !XybFile::readHeader(file, header, errorString))
+    {
+        emit showErrorMessage("Cannot read the cached points: " + this->pointCache->spillFileName());
+        this->pointCache->clear();
+        return;
+    }
+
+    uchar *mappedFile = file.map(0, file.size());
+    if(mappedFile == NULL)
+    {
+        emit showErrorMessage("Cannot map the cached points: " + this->pointCache->spillFileName());
+        this->pointCache->clear();
+        return;
+    }
+
+    const XybRecord *records = (const XybRecord *)(mappedFile + header.headerSize);
+    qint64 pointCount = header.pointCount;
+
+    QFile gridFile(XybFile::gridFileName(this->pointCache->spillFileName()));
+    const qint32 *grid = XybFile::mapGrid(gridFile, pointCount);
+    if(grid != NULL)
+    {
+        PointBuffer sample(PointBuffer::COLOR | PointBuffer::GRID);
+        qint64 stride = qMax(pointCount / GridCalibrationWindows, (qint64)GridCalibrationWindowPoints);
+        for(qint64 i = 0; i < pointCount; i += stride)
+            appendRecords(sample, records, grid, i, qMin((qint64)GridCalibrationWindowPoints, pointCount - i));
+
+        calibrateCachedGrid(sample);
+        setPointChannels(PointBuffer::COLOR | PointBuffer::GRID);
+    }
+
+    if(this->pointCache->scanOrderColumnLength() > 0)
+    {
+        PointBuffer head(PointBuffer::COLOR | PointBuffer::GRID);
+        appendRecords(head, records, NULL, 0, qMin((qint64)ScanOrderSamplePoints, pointCount));
+        applyScanOrder(head, this->pointCache->scanOrderColumnLength(), this->pointCache->scanOrderPhase());
+    }
+
+    QThreadPool replayPool;
+    replayPool.setMaxThreadCount(this->threadCount);
+
+    //Scan line ordered points are placed by their index, in file order on this thread
+    this->chunkSplatting = (this->threadCount > 1 && !this->scanOrder) ? this->splattingMode : SERIAL_SPLATTING;
+
+    if(this->chunkSplatting == SERIAL_SPLATTING)
+    {
+        for(qint64 i = 0; i < pointCount && !this->cancelThread; i += RecordSpanSize)
+        {
+            qint64 count = qMin(RecordSpanSize, pointCount - i);
+            this->progressPosition = i + count;
+            if(!processRecords(records + i, grid != NULL ? grid + 2 * i : NULL, count))
+                break;
+        }
+    }
+    else
+    {
+        //Same spans as the in-memory segments
+        for(qint64 i = 0; i < pointCount; i += PointCache::SegmentSize)
+            replayPool.start(new CacheReplayTask(this, records + i, grid != NULL ? grid + 2 * i : NULL, qMin((qint64)PointCache::SegmentSize, pointCount - i)));
+
+        bool continueImport = true;
+        for(qint64 i = 0; i < pointCount && continueImport; i += RecordSpanSize)
+        {
+            qint64 count = qMin(RecordSpanSize, pointCount - i);
+            this->progressPosition = i + count;
+
+            this->pointBlock.clear();
+            appendRecords(this->pointBlock, records, grid, i, count);
+
+            continueImport = processBlock(this->pointBlock, 0, this->pointBlock.size(), true);
+        }
+        this->pointBlock.clear();
+    }
+
+    replayPool.waitForDone();
+    finishSplatting();
+
+    if(grid != NULL)
+        gridFile.unmap((uchar *)grid);
+    file.unmap(mappedFile);
+    file.close();
+}
+
+bool ImportWorker::parse_Binary_Range(const char *begin, const char *end, qint64 offset, qint64 totalSize)
+{
+    const int stride = this->recordStride;
+    const char *cursor = begin;
+
+    this->progressTotal = totalSize;
+
+    while(end - cursor >= stride && !this->cancelThread)
+    {
+        //Whole runs of records up to the next flush
+        int count = (int)qMin((qint64)((end - cursor) / stride), (qint64)(BlockSize - this->pointBlock.size()));
+        decodeRecords((const uchar *)cursor, count, this->pointBlock);
+        cursor += (qint64)count * stride;
+
+        if(this->pointBlock.size() >= BlockSize)
+        {
+            this->progressPosition = offset + (cursor - begin);
+            if(!flushBlock())
+                return false;
+        }
+    }
+
+    this->progressPosition = offset + (cursor - begin);
+
+    return !this->cancelThread;
+}
+
+bool ImportWorker::parse_Ascii_Range(const char *begin, const char *end, qint64 offset, qint64 totalSize)
+{
+    const char *cursor = begin;
+
+    //The progress is reported once per block of points
+    this->progressTotal = totalSize;
+
+    while(cursor < end && this->lineLimit != 0 && !this->cancelThread)
+    {
+        const char *lineEnd = AsciiParser::findLineEnd(cursor, end);
+
+        //Parse straight into the current block
+        int columns = parseLine(cursor, lineEnd, this->pointBlock);
+
+        if(columns == 8 && this->fileType == XYZ_ASCII && !importerInfo)
+        {
+            //Probably Faro Scene LT Export
+            importerInfo = true;
+            emit showInfoMessage("The imported file was probably generated by Faro Scene LT!");
+        }
+
+        //continue with the next line
+        cursor = (lineEnd < end) ? lineEnd + 1 : end;
+
+        if(this->lineLimit > 0)
+            this->lineLimit--;
+
+        if(columns > 0 && this->pointBlock.size() >= BlockSize)
+        {
+            this->progressPosition = offset + (cursor - begin);
+            if(!flushBlock())
+                return false;
+        }
+    }
+
+    this->progressPosition = offset + (cursor - begin);
+
+    return !this->cancelThread;
+}
+
+int ImportWorker::parseLine(const char *begin, const char *end, PointBuffer &points)
+{
+    if(this->fileType == PLY)
+        return parsePLYLine(begin, end, points);
+    else
+        return parseXYZLine(begin, end, points, this->commaSeparated);
+}
+
+int ImportWorker::parseXYZLine(const char *begin, const char *end, PointBuffer &points, bool commas)
+{
+    const char *tokens[AsciiParser::MaxTokens];
+    int count = AsciiParser::tokenize(begin, end, tokens, AsciiParser::MaxTokens, commas);
+
+    int first = 0;
+    bool color = true;
+
+    if(count >= 3 && count < 6)
+    {
+        //Read only XYZ-Parts
+        color = false;
+    }
+    else if(count == 6)
+    {
+        //Probably Normal Faro Scene Export
+    }
+    else if(count == 8 || count == 9)
+    {
+        //Probably Faro Scene LT Export (8) or Agisoft Photoscan (9): two leading columns
+        first = 2;
+    }
+    else
+    {
+        return 0;
+    }
+
+    float x, y, z;
+    if(!AsciiParser::parseFloat(tokens[first + 0], end, x) ||
+       !AsciiParser::parseFloat(tokens[first + 1], end, y) ||
+       !AsciiParser::parseFloat(tokens[first + 2], end, z))
+    {
+        return 0;
+    }
+
+    QRgb rgb = PointBuffer::DefaultColor;
+    if(color)
+    {
+        int r = 0, g = 0, b = 0;
+        AsciiParser::parseInt(tokens[first + 3], end, r);
+        AsciiParser::parseInt(tokens[first + 4], end, g);
+        AsciiParser::parseInt(tokens[first + 5], end, b);
+        rgb = qRgb(r, g, b);
+    }
+
+    points.append(x, y, z, rgb);
+
+    if(points.hasChannel(PointBuffer::GRID))
+    {
+        //Faro Scene LT: scan grid row and column (-1 keeps the channels aligned for other lines)
+        int row = -1, column = -1;
+        if(count == 8)
+        {
+            AsciiParser::parseInt(tokens[0], end, row);
+            AsciiParser::parseInt(tokens[1], end, column);
+        }
+        points.appendGrid(row, column);
+    }
+
+    return count;
+}
+
+int ImportWorker::parsePLYLine(const char *begin, const char *end, PointBuffer &points)
+{
+    const char *tokens[AsciiParser::MaxTokens];
+    int count = AsciiParser::tokenize(begin, end, tokens, AsciiParser::MaxTokens);
+
+    //Columns of the properties are taken from the compiled header schema
+    float xyz[3];
+    quint16 rgb[3];
+    if(!this->plySchema.decodeAscii(tokens, qMin(count, AsciiParser::MaxTokens), end, xyz, rgb))
+        return 0;
+
+    points.append(xyz[0], xyz[1], xyz[2], qRgb(rgb[0], rgb[1], rgb[2]));
+
+    return count;
+}
+
+void ImportWorker::decodeRecord(const uchar *record, PointBuffer &points)
+{
+    float xyz[3];
+    quint16 rgb[3];
+    this->plySchema.decodeBinary(record, xyz, rgb);
+
+    points.append(xyz[0], xyz[1], xyz[2], qRgb(rgb[0], rgb[1], rgb[2]));
+}
+
+void ImportWorker::decodeRecords(const uchar *records, int count, PointBuffer &points)
+{
+    //LAS records are dequantized batch wise
+    if(this->fileType == LAS)
+    {
+        this->lasSchema.decode(records, count, points);
+        return;
+    }
+
+    const int stride = this->recordStride;
+    for(int i = 0; i < count; i++)
+    {
+        decodeRecord(records + (qint64)i * stride, points);
+    }
+}
+
+bool ImportWorker::flushBlock()
+{
+    bool continueImport = processBlock(this->pointBlock, 0, this->pointBlock.size());
+    this->pointBlock.clear();
+    return continueImport;
+}
+
+bool ImportWorker::processBlock(const PointBuffer &points, int first, int count, bool projected)
+{
+    if(count == 0)
+        return !this->cancelThread;
+
+    if(this->xybWriter != NULL)
+    {
+        //Conversion into the .xyb format
+        this->xybWriter->addPoints(points, first, count);
+    }
+    else
+    {
+        //Buffered for the next import of the file
+        if(this->caching)
+            this->pointCache->addPoints( points, first, count );
+        if(this->cacheWriter != NULL)
+            this->cacheWriter->addPoints( points, first, count );
+
+        if(analyze)
+        {
+            //The chunk threads counted their points already
+            if(!projected)
+                this->estimator->addPoints(points, first, count);
+        }
+        else
+        {
+            //send the current points over to the panorama data container and 3D viewer:
+            if(!projected && this->scanOrder)
+                panorama->addOrderedPoints( points, first, count, this->sequenceIndex );
+            else if(!projected)
+                panorama->addPoints( points, first, count );
+            glWidget->addPoints( points, first, count, panorama->getTranslationVector() );
+        }
+    }
+
+    this->sequenceIndex += count;
+
+    //One progress update per block instead of one per point, 100% is only sent by run() when the panorama is complete
+    if(this->progressTotal > 0)
+        emit importStatus(qMin(99.0f, (this->progressPosition * 100.0f) / this->progressTotal));
+
+    return !this->cancelThread;
+}
+
+void ImportWorker::import_XYZ_Binary_File()
+{
+    //import the filename
+    qDebug() << "opening file: " << this->fileName;
+
+    QFile file(this->fileName);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        emit showErrorMessage("Cannot open " + this->fileName);
+        return;
+    }
+
+    XybHeader header;
+    QString errorString;
+    if(!XybFile::readHeader(file, header, errorString))
+    {
+        emit showErrorMessage(errorString);
+        file.close();
+        return;
+    }
+
+    qDebug() << "XYB: points" << header.pointCount
+             << "bounds (" << header.boundsMin[0] << header.boundsMin[1] << header.boundsMin[2] << ") - ("
+             << header.boundsMax[0] << header.boundsMax[1] << header.boundsMax[2] << ")";
+
+    //Without a user defined translation the scanner origin of the file is used
+    QVector3D origin(header.origin[0], header.origin[1], header.origin[2]);
+    if(this->panorama != NULL && this->panorama->getTranslationVector().isNull() && !origin.isNull())
+    {
+        qDebug() << "XYB: using the scanner origin" << origin;
+        this->panorama->setTranslationVector(-origin);
+    }
+
+    qint64 totalSize = file.size();
+    qint64 pointCount = header.pointCount;
+    uchar *mappedFile = file.map(0, totalSize);
+
+    setPointChannels(PointBuffer::COLOR);
+
+    this->progressTotal = pointCount;
+
+    if(mappedFile != NULL)
+    {
+        //Zero-copy: the records of the mapped file go straight into the projection
+        const XybRecord *records = (const XybRecord *)(mappedFile + header.headerSize);
+
+        //Parse cache of a scan grid import: the points are placed by their cells again
+        QFile gridFile(XybFile::gridFileName(this->fileName));
+        const qint32 *grid = (this->panorama != NULL && this->xybWriter == NULL) ? XybFile::mapGrid(gridFile, pointCount) : NULL;
+        if(grid != NULL)
+        {
+            PointBuffer sample(PointBuffer::COLOR | PointBuffer::GRID);
+            qint64 stride = qMax(pointCount / GridCalibrationWindows, (qint64)GridCalibrationWindowPoints);
+            for(qint64 i = 0; i < pointCount; i += stride)
+                appendRecords(sample, records, grid, i, qMin((qint64)GridCalibrationWindowPoints, pointCount - i));
+
+            ScanGrid scanGrid;
+            if(analyze && scanGrid.calibrate(this->panorama, sample))
+            {
+                //As for the file: the grid itself is the original resolution
+                this->sampledResolution.horizontal = scanGrid.horizontalResolution();
+                this->sampledResolution.vertical = scanGrid.verticalResolution();
+                this->sampledResolution.confidence = scanGrid.confidence();
+                this->sampledResolution.points = sample.size();
+                this->bodySkipped = true;
+                pointCount = 0;
+            }
+            else if(!analyze && calibrateCachedGrid(sample))
+            {
+                setPointChannels(PointBuffer::COLOR | PointBuffer::GRID);
+            }
+
+            //Without a grid the records are projected zero-copy as usual
+            if(!this->pointBlock.hasChannel(PointBuffer::GRID))
+            {
+                gridFile.unmap((uchar *)grid);
+                grid = NULL;
+            }
+        }
+
+        //Parse cache of a scan line ordered import: the cells follow from the index of the records
+        if(this->scanOrderColumnLength > 0 && this->panorama != NULL && this->xybWriter == NULL)
+        {
+            PointBuffer head(PointBuffer::COLOR | PointBuffer::GRID);
+            appendRecords(head, records, NULL, 0, qMin((qint64)ScanOrderSamplePoints, pointCount));
+            if(applyScanOrder(head, this->scanOrderColumnLength, this->scanOrderPhase) && analyze)
+            {
+                this->bodySkipped = true;
+                pointCount = 0;
+            }
+        }
+
+        for(qint64 i = 0; i < pointCount && !this->cancelThread; i += RecordSpanSize)
+        {
+            qint64 count = qMin(RecordSpanSize, pointCount - i);
+            this->progressPosition = i + count;
+            if(!processRecords(records + i, grid != NULL ? grid + 2 * i : NULL, count))
+                break;
+        }
+
+        if(grid != NULL)
+            gridFile.unmap((uchar *)grid);
+        file.unmap(mappedFile);
+    }
+    else
+    {
+        //Mapping failed: read spans of records into a buffer
+        QVector<XybRecord> records(RecordSpanSize);
+        file.seek(header.headerSize);
+
+        for(qint64 i = 0; i < pointCount && !this->cancelThread; i += RecordSpanSize)
+        {
+            qint64 count = qMin(RecordSpanSize, pointCount - i);
+            if(file.read((char *)records.data(), count * sizeof(XybRecord)) != count * (qint64)sizeof(XybRecord))
+                break;
+            this->progressPosition = i + count;
+            if(!processRecords(records.constData(), NULL, count))
+                break;
+        }
+    }
+
+    flushBlock();
+    file.close();
+}
+
+void ImportWorker::import_PTX_File()
+{
+    qDebug() << "opening file: " << this->fileName;
+
+    QFile file(this->fileName);
+    uchar *mappedFile = NULL;
+    if(file.open(QIODevice::ReadOnly) && file.size() > 0)
+        mappedFile = file.map(0, file.size());
+
+    if(mappedFile == NULL)
+    {
+        emit showErrorMessage("Cannot read the PTX file " + this->fileName);
+        return;
+    }
+
+    const char *cursor = (const char *)mappedFile;
+    const char *end = cursor + file.size();
+
+    //Headers first (sequential, only the line ends are searched), then every scan is split into chunks of lines
+    QList<StructuredScan*> scans;
+    QList<PtxChunk*> chunks;
+
+    while(cursor < end && !this->cancelThread)
+    {
+        //Blank lines after the last scan
+        while(cursor < end && (AsciiParser::isBlank(*cursor) || *cursor == '\n' || *cursor == '\r'))
+            cursor++;
+        if(cursor >= end)
+            break;
+
+        StructuredScan *scan = new StructuredScan();
+        cursor = parsePTXHeader(cursor, end, *scan);
+        if(cursor == NULL)
+        {
+            delete scan;
+            emit showErrorMessage("Invalid PTX header in scan " + QString::number(scans.size() + 1) + " of " + this->fileName);
+            break;
+        }
+        scans.append(scan);
+
+        qDebug() << "PTX: scan" << scans.size() << scan->columns << "x" << scan->rows << "scanner at" << scan->scannerPosition;
+
+        if(analyze)
+        {
+            //The range image is the original resolution, no points need to be read
+            cursor = AsciiParser::skipLines(cursor, end, (qint64)scan->columns * scan->rows);
+            continue;
+        }
+
+        scan->resize(scan->columns, scan->rows);
+        int cells = scan->columns * scan->rows;
+        for(int cell = 0; cell < cells && cursor < end; cell += PtxChunkLines)
+        {
+            const char *chunkEnd = AsciiParser::skipLines(cursor, end, qMin(PtxChunkLines, cells - cell));
+            chunks.append(new PtxChunk(this, scan, cell, cursor, chunkEnd));
+            cursor = chunkEnd;
+        }
+    }
+
+    if(analyze)
+    {
+        if(!scans.isEmpty())
+        {
+            this->sampledResolution.horizontal = scans.first()->columns;
+            this->sampledResolution.vertical = scans.first()->rows;
+            this->sampledResolution.confidence = 1.0f;
+        }
+        qDeleteAll(scans);
+        scans.clear();
+    }
+    else
+    {
+        //Scans and chunks are independent, all of them run at once
+        QThreadPool pool;
+        pool.setMaxThreadCount(this->threadCount);
+        this->ptxChunksDone.store(0);
+
+        for(int i = 0; i < chunks.size(); i++)
+            pool.start(chunks.at(i));
+
+        while(!pool.waitForDone(200))
+        {
+            emit importStatus(qMin(99.0f, 100.0f * this->ptxChunksDone.load() / chunks.size()));
+        }
+    }
+
+    qDeleteAll(chunks);
+    file.unmap(mappedFile);
+    file.close();
+
+    //Conversion into the .xyb format: the registered cells with a measurement, scan by scan
+    if(this->xybWriter != NULL && !analyze)
+    {
+        setPointChannels(PointBuffer::COLOR);
+        this->progressTotal = 0;
+        for(int i = 0; i < scans.size(); i++)
+            this->progressTotal += scans.at(i)->valid.size();
+
+        qint64 cellsBefore = 0;
+        for(int i = 0; i < scans.size() && !this->cancelThread; i++)
+        {
+            const StructuredScan *scan = scans.at(i);
+            for(int cell = 0; cell < scan->valid.size() && !this->cancelThread; cell++)
+            {
+                if(scan->valid.at(cell))
+                    this->pointBlock.append(scan->x.at(cell), scan->y.at(cell), scan->z.at(cell), scan->rgba.at(cell));
+
+                if(this->pointBlock.size() >= BlockSize)
+                {
+                    this->progressPosition = cellsBefore + cell + 1;
+                    flushBlock();
+                }
+            }
+            cellsBefore += scan->valid.size();
+        }
+        flushBlock();
+    }
+
+    if(this->cancelThread || this->structuredScans == NULL)
+        qDeleteAll(scans);
+    else
+        this->structuredScans->append(scans);
+}
+
+void ImportWorker::import_E57_File()
+{
+    qDebug() << "opening file: " << this->fileName;
+
+    E57Reader reader;
+    if(!reader.open(this->fileName) || this->e57Scan < 0 || this->e57Scan >= reader.scans.size())
+    {
+        emit showErrorMessage(reader.errorString);
+        return;
+    }
+
+    //A conversion keeps the whole registered file, the panorama is projected from one scan position
+    if(this->xybWriter != NULL && !analyze)
+    {
+        import_E57_Scans(reader);
+        return;
+    }
+
+    const E57Reader::Scan &scan = reader.scans.at(this->e57Scan);
+    qDebug() << "E57:" << scan.name << "(scan" << this->e57Scan + 1 << "of" << reader.scans.size() << ")" << scan.recordCount << "points"
+             << (scan.hasGrid ? "with grid indices" : "");
+
+    //The points are registered by the pose. Without a user defined translation the panorama is centered on the scanner:
+    //only the rotation is applied then, a translation added in float and subtracted again would cost precision.
+    bool scannerCentered = this->panorama != NULL && scan.hasPose && this->panorama->getTranslationVector().isNull() && !scan.translation.isNull();
+    if(scannerCentered)
+        qDebug() << "E57: centered on the scanner position" << scan.translation;
+
+    if(!reader.beginScan(this->e57Scan, !scannerCentered))
+    {
+        emit showErrorMessage(reader.errorString);
+        return;
+    }
+
+    setPointChannels(scan.hasGrid ? (PointBuffer::COLOR | PointBuffer::GRID) : PointBuffer::COLOR);
+    this->progressTotal = scan.recordCount;
+
+    PointBuffer points(this->pointChannels);
+    int count = reader.readPoints(points, scan.hasGrid ? E57CalibrationPoints : BlockSize);
+
+    //Row and column indices: placed by the grid like Scene LT exports
+    if(scan.hasGrid && this->panorama != NULL && this->xybWriter == NULL)
+    {
+        ScanGrid grid;
+        if(grid.calibrate(this->panorama, points))
+        {
+            if(analyze)
+            {
+                this->sampledResolution.horizontal = grid.horizontalResolution();
+                this->sampledResolution.vertical = grid.verticalResolution();
+                this->sampledResolution.confidence = grid.confidence();
+                this->sampledResolution.points = points.size();
+                this->bodySkipped = true;
+                return;
+            }
+
+            this->panorama->setScanGrid(grid);
+        }
+    }
+
+    //Streamed block by block, only the current pages and packet are held
+    while(count > 0 && !this->cancelThread)
+    {
+        this->progressPosition = reader.pointsRead();
+        if(!processBlock(points, 0, points.size()))
+            break;
+
+        points.clear();
+        count = reader.readPoints(points, BlockSize);
+    }
+
+    if(!this->cancelThread && reader.pointsRead() < scan.recordCount)
+    {
+        emit showErrorMessage("E57: only " + QString::number(reader.pointsRead()) + " of " + QString::number(scan.recordCount) + " points could be read. " + reader.errorString);
+    }
+}
+
+void ImportWorker::import_E57_Scans(E57Reader &reader)
+{
+    //Every scan registered by its pose, the grid indices only belong to a single scan
+    setPointChannels(PointBuffer::COLOR);
+    this->progressTotal = 0;
+    for(int i = 0; i < reader.scans.size(); i++)
+        this->progressTotal += reader.scans.at(i).recordCount;
+
+    qint64 pointsBefore = 0;
+    PointBuffer points(this->pointChannels);
+
+    for(int i = 0; i < reader.scans.size() && !this->cancelThread; i++)
+    {
+        const E57Reader::Scan &scan = reader.scans.at(i);
+        qDebug() << "E57: converting" << scan.name << "(scan" << i + 1 << "of" << reader.scans.size() << ")" << scan.recordCount << "points";
+
+        if(!reader.beginScan(i, true))
+        {
+            emit showErrorMessage(reader.errorString);
+            return;
+        }
+
+        points.clear();
+        int count = reader.readPoints(points, BlockSize);
+        while(count > 0 && !this->cancelThread)
+        {
+            this->progressPosition = pointsBefore + reader.pointsRead();
+            if(!processBlock(points, 0, points.size()))
+                return;
+
+            points.clear();
+            count = reader.readPoints(points, BlockSize);
+        }
+
+        if(!this->cancelThread && reader.pointsRead() < scan.recordCount)
+        {
+            emit showErrorMessage("E57: only " + QString::number(reader.pointsRead()) + " of " + QString::number(scan.recordCount) + " points of " + scan.name + " could be read. " + reader.errorString);
+            return;
+        }
+
+        pointsBefore += scan.recordCount;
+    }
+}
+
+const char *ImportWorker::parsePTXHeader(const char *cursor, const char *end, StructuredScan &scan)
+{
+    //columns, rows, scanner position, 3 scanner axes, 4x4 registration (row vectors)
+    float values[4];
+    const char *tokens[AsciiParser::MaxTokens];
+    int expected[10] = { 1, 1, 3, 3, 3, 3, 4, 4, 4, 4 };
+    int columns = 0, rows = 0;
+
+    for(int line = 0; line < 10; line++)
+    {
+        if(cursor >= end)
+            return NULL;
+
+        const char *lineEnd = AsciiParser::findLineEnd(cursor, end);
+        int count = AsciiParser::tokenize(cursor, lineEnd, tokens, AsciiParser::MaxTokens);
+        if(count < expected[line])
+            return NULL;
+
+        if(line < 2)
+        {
+            //The grid size is a whole number: "59.5" or "5e3" is no PTX header
+            const char *tokenEnd = tokens[0];
+            while(tokenEnd < lineEnd && !AsciiParser::isSeparator(*tokenEnd, false))
+                tokenEnd++;
+
+            const char *digit = tokens[0];
+            if(digit < tokenEnd && (*digit == '-' || *digit == '+'))
+                digit++;
+            while(digit < tokenEnd && AsciiParser::isDigit(*digit))
+                digit++;
+
+            if(digit != tokenEnd || !AsciiParser::parseInt(tokens[0], tokenEnd, (line == 0) ? columns : rows))
+                return NULL;
+        }
+        else
+        {
+            for(int i = 0; i < expected[line]; i++)
+            {
+                if(!AsciiParser::parseFloat(tokens[i], lineEnd, values[i]))
+                    return NULL;
+            }
+        }
+
+        if(line == 2)
+            scan.scannerPosition = QVector3D(values[0], values[1], values[2]);
+        else if(line >= 6)
+        {
+            for(int i = 0; i < 4; i++)
+                scan.transform[(line - 6) * 4 + i] = values[i];
+        }
+
+        cursor = (lineEnd < end) ? lineEnd + 1 : end;
+    }
+
+    //A range image has to fit into one vector
+    if(columns <= 0 || rows <= 0 || (qint64)columns * rows > INT_MAX)
+        return NULL;
+
+    scan.columns = columns;
+    scan.rows = rows;
+    return cursor;
+}
+
+void ImportWorker::copyRecords(const XybRecord *records, const qint32 *grid, qint64 count)
+{
+    this->pointBlock.clear();
+    appendRecords(this->pointBlock, records, grid, 0, count);
+}
+
+void ImportWorker::appendRecords(PointBuffer &points, const XybRecord *records, const qint32 *grid, qint64 first, qint64 count)
+{
+    for(qint64 i = first; i < first + count; i++)
+    {
+        points.append(records[i].x, records[i].y, records[i].z, qRgb(records[i].r, records[i].g, records[i].b));
+        if(grid != NULL)
+            points.appendGrid(grid[2 * i], grid[2 * i + 1]);
+    }
+}
+
+bool ImportWorker::processRecords(const XybRecord *records, const qint32 *grid, qint64 count)
+{
+    //Analysis and conversion work on a block of points, cached scan grid points are placed by their cells
+    //and scan line ordered points by their index
+    if(analyze || this->xybWriter != NULL || grid != NULL || this->scanOrder)
+    {
+        copyRecords(records, grid, count);
+        return flushBlock();
+    }
+
+    //The projection and the 3D viewer read the records directly, only the point cache needs a copy
+    this->panorama->addPoints(records, count);
+    glWidget->addPoints( records, (int)count, panorama->getTranslationVector() );
+    if(this->caching)
+    {
+        copyRecords(records, NULL, count);
+        this->pointCache->addPoints( this->pointBlock, 0, this->pointBlock.size() );
+        this->pointBlock.clear();
+    }
+
+    if(this->progressTotal > 0)
+        emit importStatus(qMin(99.0f, (this->progressPosition * 100.0f) / this->progressTotal));
+
+    return !this->cancelThread;
+}
+
+void ImportWorker::import_PLY_File()
+{
+    //import the filename
+    qDebug() << "opening file: " << this->fileName;
+
+    QFile file(this->fileName);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        emit showErrorMessage("Cannot open " + this->fileName);
+        return;
+    }
+
+    bool validHeader = this->plySchema.parseHeader(file);
+    setPointChannels(this->plySchema.hasColor() ? PointBuffer::COLOR : PointBuffer::POSITION);
+
+    if(!validHeader)
+    {
+        emit showErrorMessage(this->plySchema.errorString);
+    }
+    else if(this->plySchema.format == PlySchema::ASCII)
+    {
+        //Ascii: one line per vertex, stop at the end of the vertex element
+        import_Ascii_Body(file, this->plySchema.dataOffset, this->plySchema.linesBeforeVertices(),
+                          this->plySchema.vertexElementIsLast() ? -1 : this->plySchema.vertexCount());
+    }
+    else
+    {
+        //Binary: fixed size vertex records
+        qint64 vertexOffset;
+        int stride = this->plySchema.vertexStride();
+
+        if(stride <= 0 || !this->plySchema.binaryVertexOffset(vertexOffset))
+        {
+            emit showErrorMessage("The vertices of the imported .ply file have no fixed size. This is not supported, yet!");
+        }
+        else
+        {
+            import_Binary_Body(file, vertexOffset, this->plySchema.vertexCount(), stride);
+        }
+    }
+
+    flushBlock();
+    file.close();
+}
+
+void ImportWorker::import_LAS_File()
+{
+    //import the filename
+    qDebug() << "opening file: " << this->fileName;
+
+    QFile file(this->fileName);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        emit showErrorMessage("Cannot open " + this->fileName);
+        return;
+    }
+
+    //Points without RGB carry their intensity as grey value
+    bool validHeader = this->lasSchema.parseHeader(file);
+    setPointChannels(PointBuffer::COLOR);
+
+    if(!validHeader)
+    {
+        emit showErrorMessage(this->lasSchema.errorString);
+    }
+    else
+    {
+        setLasOrigin();
+
+        //Fixed size point records, decoded in parallel chunks of whole records
+        import_Binary_Body(file, this->lasSchema.dataOffset, this->lasSchema.pointCount, this->lasSchema.recordLength);
+    }
+
+    flushBlock();
+    file.close();
+}
+
+void ImportWorker::setLasOrigin()
+{
+    //Georeferenced coordinates (UTM: millions of meters) only have half meter steps as float.
+    //The records are moved to a local origin in double precision, which becomes the origin of the panorama.
+    //A conversion writes the same local coordinates, the user defined origin is the one of the .xyb header.
+    QVector3D userOrigin;
+    if(this->panorama != NULL)
+        userOrigin = -this->panorama->getTranslationVector();
+    else if(this->xybWriter != NULL)
+        userOrigin = this->xybWriter->origin();
+    double origin[3];
+
+    if(!userOrigin.isNull())
+    {
+        //The user defined origin: nothing is left to translate in float
+        origin[0] = (double)userOrigin.x();
+        origin[1] = (double)userOrigin.y();
+        origin[2] = (double)userOrigin.z();
+        if(this->panorama != NULL)
+            this->panorama->setTranslationVector(QVector3D(0, 0, 0));
+    }
+    else
+    {
+        //Without a user defined translation the panorama is centered on the local origin of the file
+        this->lasSchema.defaultOrigin(origin);
+    }
+
+    this->lasSchema.setOrigin(origin[0], origin[1], origin[2]);
+
+    //The scanner position of the .xyb header moves into the local coordinates of the records
+    if(this->xybWriter != NULL)
+        this->xybWriter->setOrigin(QVector3D((float)(userOrigin.x() - origin[0]), (float)(userOrigin.y() - origin[1]), (float)(userOrigin.z() - origin[2])));
+
+    qDebug() << "LAS: local origin" << QString::number(origin[0], 'f', 3) << QString::number(origin[1], 'f', 3) << QString::number(origin[2], 'f', 3);
+}
+
+bool ImportWorker::setConversionTarget(QString xybFileName, QVector3D origin)
+{
+    //Instead of filling a panorama all points get written into a .xyb file
+    delete this->xybWriter;
+    this->xybWriter = new XybWriter();
+
+    if(!this->xybWriter->open(xybFileName, origin))
+    {
+        qDebug() << this->xybWriter->errorString;
+        delete this->xybWriter;
+        this->xybWriter = NULL;
+        return false;
+    }
+
+    //Without a user interface the errors are printed, the caller asks conversionFailed() afterwards
+    this->conversionErrors = 0;
+    connect(this, SIGNAL(showErrorMessage(QString)), this, SLOT(recordConversionError(QString)), Qt::DirectConnection);
+
+    return true;
+}
+
+void ImportWorker::recordConversionError(QString message)
+{
+    qDebug() << "Conversion error:" << qPrintable(message);
+    this->conversionErrors++;
+}
+
+void ImportWorker::setPointChannels(int channels)
+{
+    this->pointChannels = channels;
+    this->pointBlock.setChannels(channels);
+    this->pointBlock.reserve(BlockSize);
+}
+
+void ImportWorker::splatChunk(const PointBuffer &points)
+{
+    PanoramaTiles *tiles = NULL;
+
+    if(this->chunkSplatting == PRIVATE_TILE_SPLATTING)
+    {
+        //One set of tiles per pool thread, reused by all chunks of that thread
+        QMutexLocker locker(&this->privateTilesMutex);
+        tiles = this->privateTiles.value(QThread::currentThread(), NULL);
+        if(tiles == NULL)
+        {
+            tiles = this->panorama->createPrivateTiles();
+            this->privateTiles.insert(QThread::currentThread(), tiles);
+        }
+    }
+
+    this->panorama->addPoints(points, 0, points.size(), tiles);
+}
+
+void ImportWorker::setSplattingMode(SplattingMode mode)
+{
+    this->splattingMode = mode;
+}
+
+void ImportWorker::setE57Scan(int scan)
+{
+    this->e57Scan = scan;
+}
+
+void ImportWorker::setStructuredScans(QList<StructuredScan*> *scans)
+{
+    this->structuredScans = scans;
+}
+
+void ImportWorker::setAnalysisMode(AnalysisMode mode)
+{
+    this->analysisMode = mode;
+}
+
+void ImportWorker::setFusedImport(bool fused)
+{
+    this->fusedImport = fused;
+}
+
+void ImportWorker::setPointCache(PointCache *cache)
+{
+    this->pointCache = cache;
+}
+
+void ImportWorker::setParseCache(bool enabled, QString directory)
+{
+    this->parseCaching = enabled;
+    this->parseCacheDirectory = directory;
+}
+
+void ImportWorker::setThreadCount(int threads)
+{
+    this->threadCount = qMax(threads, 1);
+}
+
+void ImportWorker::stopThread()
+{
+    this->cancelThread = true;
+}
+
+ImportChunk::ImportChunk(ImportWorker *importer, const char *begin, const char *end) :
+    points(importer->pointChannels)
+{
+    this->importer = importer;
+    this->begin = begin;
+    this->end = end;
+    this->sceneLT = false;
+    this->sampled = false;
+
+    //The import worker waits for the chunk and deletes it afterwards
+    this->setAutoDelete(false);
+}
+
+void ImportChunk::run()
+{
+    const char *cursor = this->begin;
+
+    if(this->importer->recordStride > 0)
+    {
+        //Binary: fixed size records
+        const int stride = this->importer->recordStride;
+        this->points.reserve((this->end - this->begin) / stride);
+
+        while(this->end - cursor >= stride && !this->importer->cancelThread)
+        {
+            int count = (int)qMin((qint64)((this->end - cursor) / stride), (qint64)ImportWorker::BlockSize);
+            this->importer->decodeRecords((const uchar *)cursor, count, this->points);
+            cursor += (qint64)count * stride;
+        }
+    }
+    else
+    {
+        //Roughly 30 bytes per line in typical exports
+        this->points.reserve((this->end - this->begin) / 30);
+
+        while(cursor < this->end && !this->importer->cancelThread)
+        {
+            const char *lineEnd = AsciiParser::findLineEnd(cursor, this->end);
+
+            int columns = this->importer->parseLine(cursor, lineEnd, this->points);
+            if(columns == 8 && this->importer->fileType == ImportWorker::XYZ_ASCII)
+                this->sceneLT = true;
+
+            cursor = (lineEnd < this->end) ? lineEnd + 1 : this->end;
+        }
+    }
+
+    //Concurrent splatting: the projection runs on this thread as well
+    if(this->importer->chunkSplatting != ImportWorker::SERIAL_SPLATTING && !this->importer->cancelThread)
+        this->importer->splatChunk(this->points);
+
+    if(this->sampled)
+    {
+        //A window of the sampled analysis is estimated on its own
+        ResolutionEstimator::Histogram histogram;
+        this->importer->estimator->addPoints(histogram, this->points, 0, this->points.size());
+        this->sample = ResolutionEstimator::estimate(histogram);
+    }
+    else if(this->importer->chunkAnalysis && !this->importer->cancelThread)
+    {
+        this->importer->estimator->addPoints(this->points, 0, this->points.size());
+    }
+
+    this->finished.release();
+}
+
+PtxChunk::PtxChunk(ImportWorker *importer, StructuredScan *scan, int firstCell, const char *begin, const char *end)
+{
+    this->importer = importer;
+    this->scan = scan;
+    this->firstCell = firstCell;
+    this->begin = begin;
+    this->end = end;
+
+    //Deleted by the import worker once all chunks are done
+    this->setAutoDelete(false);
+}
+
+void PtxChunk::run()
+{
+    const char *tokens[AsciiParser::MaxTokens];
+    const float *m = this->scan->transform;
+    const char *cursor = this->begin;
+
+    //One line per cell: x y z intensity [r g b], 0 0 0 marks a missing measurement
+    for(int cell = this->firstCell; cursor < this->end && !this->importer->cancelThread; cell++)
+    {
+        const char *lineEnd = AsciiParser::findLineEnd(cursor, this->end);
+        int count = AsciiParser::tokenize(cursor, lineEnd, tokens, AsciiParser::MaxTokens);
+
+        float x, y, z;
+        if(count >= 3 &&
+           AsciiParser::parseFloat(tokens[0], lineEnd, x) &&
+           AsciiParser::parseFloat(tokens[1], lineEnd, y) &&
+           AsciiParser::parseFloat(tokens[2], lineEnd, z) &&
+           (x != 0.0f || y != 0.0f || z != 0.0f))
+        {
+            QRgb color = PointBuffer::DefaultColor;
+            if(count >= 7)
+            {
+                int r = 0, g = 0, b = 0;
+                AsciiParser::parseInt(tokens[4], lineEnd, r);
+                AsciiParser::parseInt(tokens[5], lineEnd, g);
+                AsciiParser::parseInt(tokens[6], lineEnd, b);
+                color = qRgb(r, g, b);
+            }
+            else if(count >= 4)
+            {
+                //Intensity only, 0..1
+                float intensity = 0.0f;
+                AsciiParser::parseFloat(tokens[3], lineEnd, intensity);
+                int gray = qBound(0, (int)(intensity * 255.0f), 255);
+                color = qRgb(gray, gray, gray);
+            }
+
+            //Registered position
+            this->scan->set(cell,
+                            x * m[0] + y * m[4] + z * m[8] + m[12],
+                            x * m[1] + y * m[5] + z * m[9] + m[13],
+                            x * m[2] + y * m[6] + z * m[10] + m[14],
+                            color);
+        }
+
+        cursor = (lineEnd < this->end) ? lineEnd + 1 : this->end;
+    }
+
+    this->importer->ptxChunksDone.ref();
+}
+
+CacheReplayTask::CacheReplayTask(ImportWorker *importer, const PointBuffer *segment)
+{
+    this->importer = importer;
+    this->segment = segment;
+    this->records = NULL;
+    this->grid = NULL;
+    this->count = 0;
+}
+
+CacheReplayTask::CacheReplayTask(ImportWorker *importer, const XybRecord *records, const qint32 *grid, qint64 count)
+{
+    this->importer = importer;
+    this->segment = NULL;
+    this->records = records;
+    this->grid = grid;
+    this->count = count;
+}
+
+void CacheReplayTask::run()
+{
+    if(this->importer->cancelThread)
+        return;
+
+    if(this->segment != NULL)
+    {
+        this->importer->splatChunk(*this->segment);
+        return;
+    }
+
+    //Spilled records are converted into a buffer of their own thread
+    PointBuffer points(this->grid != NULL ? PointBuffer::COLOR | PointBuffer::GRID : PointBuffer::COLOR);
+    points.reserve(this->count);
+    ImportWorker::appendRecords(points, this->records, this->grid, 0, this->count);
+
+    this->importer->splatChunk(points);
 }
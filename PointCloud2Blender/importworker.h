@@ -25,14 +25,30 @@
 #include <QDebug>
 
 #include <QFile>
+#include <QQueue>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QMutex>
+#include <QHash>
+
+#include "asciiparser.h"
 
 #include "panorama3d.h"
 #include "glmesh.h"
 #include "glwidget.h"
+#include "plyschema.h"
+#include "lasschema.h"
+#include "xybformat.h"
+#include "pointbuffer.h"
+#include "pointcache.h"
+#include "parsecache.h"
+#include "resolutionestimator.h"
 
 class Point3D;
 class Panorama3D;
 class GLWidget;
+class StructuredScan;
+class E57Reader;
 
 class ImportWorker : public QObject, public QRunnable
 {
@@ -42,18 +58,69 @@ public:
     {
         XYZ_ASCII,
         XYZ_BINARY,
-        PLY
+        PLY,
+        PTX,
+        E57,
+        LAS
+    };
+
+    //How the parallel import hands the points over to the panorama. Atomic is the default: it needs no memory
+    //per thread and no merge pass, private tiles pay for both and only win when many threads hit the same pixels.
+    //--benchmark prints both for 1, 2, 4, ... threads.
+    enum SplattingMode
+    {
+        SERIAL_SPLATTING,       //import thread, in file order
+        ATOMIC_SPLATTING,       //every chunk thread writes into the shared panorama
+        PRIVATE_TILE_SPLATTING  //every chunk thread writes into its own tiles, merged at the end
     };
 
+    enum AnalysisMode
+    {
+        FULL_ANALYSIS,      //every point, fills the caches for the following import
+        SAMPLED_ANALYSIS    //windows spread over the file until the estimate is stable
+    };
 
     explicit ImportWorker(Panorama3D *panorama, GLWidget *glWidget, QString fileName, bool analyze, QObject *parent = 0);
     ~ImportWorker();
 
     void run();
     void import_XYZ_Ascii_File();
+    void import_Ascii_Body(QFile &file, qint64 bodyOffset, qint64 skipLines, qint64 maxLines);
+    bool calibrateScanGrid(QFile &file);
+    bool inferScanOrder(QFile &file);
+    void readSampleLines(QFile &file, qint64 offset, qint64 size, PointBuffer &points);
+    void import_Binary_Body(QFile &file, qint64 bodyOffset, qint64 recordCount, int stride);
+    void import_Cache();
+    void import_Cache_Records();
+    void import_Parse_Cache(QString dataFileName);
+    bool openParseCache(ParseCache &parseCache);
+    void closeParseCache(ParseCache &parseCache);
+    bool isSampledAnalysis(qint64 size);
+    void analyze_Sampled(const char *begin, const char *end);
+    bool import_Parallel(const char *begin, const char *end, qint64 offset, qint64 totalSize);
+    bool parse_Ascii_Range(const char *begin, const char *end, qint64 offset, qint64 totalSize);
+    bool parse_Binary_Range(const char *begin, const char *end, qint64 offset, qint64 totalSize);
+    int parseLine(const char *begin, const char *end, PointBuffer &points);
+    static int parseXYZLine(const char *begin, const char *end, PointBuffer &points, bool commas = false);
+    int parsePLYLine(const char *begin, const char *end, PointBuffer &points);
+    void decodeRecord(const uchar *record, PointBuffer &points);
+    void decodeRecords(const uchar *records, int count, PointBuffer &points);
+    bool processBlock(const PointBuffer &points, int first, int count, bool projected = false);
+    void splatChunk(const PointBuffer &points);
+    void finishSplatting();
+    bool flushBlock();
+    bool processRecords(const XybRecord *records, const qint32 *grid, qint64 count);
+    void copyRecords(const XybRecord *records, const qint32 *grid, qint64 count);
+    static void appendRecords(PointBuffer &points, const XybRecord *records, const qint32 *grid, qint64 first, qint64 count);
+    bool calibrateCachedGrid(const PointBuffer &sample);
     void import_XYZ_Binary_File();
     void import_PLY_File();
-    bool determineOriginalResolution(Point3D newPoint);
+    void import_PTX_File();
+    void import_E57_File();
+    void import_E57_Scans(E57Reader &reader);
+    void import_LAS_File();
+    void setLasOrigin();
+    static const char *parsePTXHeader(const char *cursor, const char *end, StructuredScan &scan);
 
     Panorama3D *panorama;
     GLWidget *glWidget;
@@ -61,23 +128,169 @@ public:
     FileType fileType;
     QString fileName;
     bool analyze;
-    QVector<int> histogram_horizontal_angles;
-    float angle_accuracy;
+    AnalysisMode analysisMode;
+    //The analysis is followed by the import of the same file
+    bool fusedImport;
+    ResolutionEstimator *estimator;
+    bool chunkAnalysis;
+    ResolutionEstimator::Result sampledResolution;
 
     bool cancelThread;
+    bool bodySkipped;
+    bool scanOrder;
+    qint64 sequenceIndex;
+    bool importerInfo;
+    //.xyz: the first line has commas, they separate the columns like blanks
+    bool commaSeparated;
+    PlySchema plySchema;
+    LasSchema lasSchema;
+    qint64 lineLimit;
+    int recordStride;
+    int threadCount;
+    XybWriter *xybWriter;
+    int conversionErrors;
+
+    int pointChannels;
+    PointBuffer pointBlock;
+    qint64 progressPosition;
+    qint64 progressTotal;
+
+    SplattingMode splattingMode;
+    SplattingMode chunkSplatting;
+    QMutex privateTilesMutex;
+    QHash<QThread*, PanoramaTiles*> privateTiles;
+
+    PointCache *pointCache;
+    bool caching;
+
+    bool parseCaching;
+    QString parseCacheDirectory;
+    XybWriter *cacheWriter;
+
+    //Scan line order of the imported points, stored with the caches
+    int scanOrderColumnLength;
+    int scanOrderPhase;
+    bool applyScanOrder(PointBuffer &head, int columnLength, int phase);
+
+    QList<StructuredScan*> *structuredScans;
+
+    //Scan of an E57 file imported by this worker
+    int e57Scan;
+    QAtomicInt ptxChunksDone;
+
+    //Block size when a file cannot be memory mapped
+    static const qint64 ReadBlockSize = 64 * 1024 * 1024;
+    //Byte range decoded by one thread in the parallel import
+    static const qint64 ChunkSize = 16 * 1024 * 1024;
+    //Number of points handed downstream at once
+    static const int BlockSize = 65536;
+    //Number of .xyb records handed to the projection at once
+    static const qint64 RecordSpanSize = 65536;
+    //Sampled analysis: the file is divided into strata, one window of each is parsed
+    static const int SampleStrata = 256;
+    static const qint64 SampleWindowSize = 2 * 1024 * 1024;
+    static const int MinimumSamples = 16;
+    //Scene LT scan grid: windows spread over the file calibrate the grid angles
+    static const int GridCalibrationWindows = 16;
+    static const qint64 GridCalibrationWindowSize = 256 * 1024;
+    //Cached scan grid points: the same number of windows, of this many points
+    static const int GridCalibrationWindowPoints = 4096;
+    //Scan order inference: a contiguous sample from the start of the file
+    static const qint64 ScanOrderSampleSize = 32 * 1024 * 1024;
+    //Cached scan line ordered points: the first points calibrate the grid again
+    static const int ScanOrderSamplePoints = 524288;
+    //Lines of a PTX scan parsed by one thread
+    static const int PtxChunkLines = 262144;
+    //E57 with grid indices: points of the first block calibrate the grid
+    static const int E57CalibrationPoints = 262144;
+
+    void setThreadCount(int threads);
+    void setSplattingMode(SplattingMode mode);
+    void setPointCache(PointCache *cache);
+    void setParseCache(bool enabled, QString directory);
+    void setAnalysisMode(AnalysisMode mode);
+    void setFusedImport(bool fused);
+    void setStructuredScans(QList<StructuredScan*> *scans);
+    void setE57Scan(int scan);
+    void setPointChannels(int channels);
+    bool setConversionTarget(QString xybFileName, QVector3D origin);
+    bool conversionFailed() const { return this->conversionErrors > 0; }
 
     void stopThread();
 
 signals:
-    void newPoint(Point3D point);
     void importStatus(float percent);
-    void originalResolution(int horizontal);
+    void originalResolution(int horizontal, int vertical, float confidence);
 
     void showInfoMessage(QString message);
     void showErrorMessage(QString message);
 
 public slots:
 
+private slots:
+    void recordConversionError(QString message);
+};
+
+/*
+ * A byte range of a memory mapped file (whole lines or whole binary records),
+ * decoded on its own thread during the parallel import.
+ */
+class ImportChunk : public QRunnable
+{
+public:
+    ImportChunk(ImportWorker *importer, const char *begin, const char *end);
+
+    void run();
+
+    ImportWorker *importer;
+    const char *begin;
+    const char *end;
+
+    PointBuffer points;
+    bool sceneLT;
+
+    //Sampled analysis: the estimate of this window alone
+    bool sampled;
+    ResolutionEstimator::Result sample;
+
+    //Released as soon as all points of the range are parsed
+    QSemaphore finished;
+};
+
+/*
+ * A range of lines of one PTX scan, parsed straight into the cells of its range image.
+ */
+class PtxChunk : public QRunnable
+{
+public:
+    PtxChunk(ImportWorker *importer, StructuredScan *scan, int firstCell, const char *begin, const char *end);
+
+    void run();
+
+    ImportWorker *importer;
+    StructuredScan *scan;
+    int firstCell;
+    const char *begin;
+    const char *end;
+};
+
+/*
+ * Splats a segment of cached points (or a span of spilled .xyb records)
+ * during the re-projection of a cached import.
+ */
+class CacheReplayTask : public QRunnable
+{
+public:
+    CacheReplayTask(ImportWorker *importer, const PointBuffer *segment);
+    CacheReplayTask(ImportWorker *importer, const XybRecord *records, const qint32 *grid, qint64 count);
+
+    void run();
+
+    ImportWorker *importer;
+    const PointBuffer *segment;
+    const XybRecord *records;
+    const qint32 *grid;
+    qint64 count;
 };
 
 #endif // IMPORTWORKER_H
@@ -0,0 +1,269 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "lasschema.h"
+
+const int LasSchema::DecodeBatch;
+
+LasSchema::LasSchema()
+{
+    versionMajor = 0;
+    versionMinor = 0;
+    pointFormat = -1;
+    recordLength = 0;
+    pointCount = 0;
+    dataOffset = 0;
+    colorOffset = -1;
+    colorShift = 0;
+    intensityShift = 0;
+
+    for(int c = 0; c < 3; c++)
+    {
+        scale[c] = 1.0;
+        offset[c] = 0.0;
+        boundsMin[c] = 0.0;
+        boundsMax[c] = 0.0;
+        origin[c] = 0.0;
+    }
+}
+
+bool LasSchema::parseHeader(QFile &file)
+{
+    /*
+    LAS public header block (little endian), the fields used here:
+
+    0    char[4]   "LASF"
+    24   uchar     version major
+    25   uchar     version minor
+    94   ushort    header size
+    96   ulong     offset to point data
+    104  uchar     point data record format (bit 7: compressed, LAZ)
+    105  ushort    point data record length
+    107  ulong     legacy number of point records
+    131  double[3] x, y, z scale factor
+    155  double[3] x, y, z offset
+    179  double[6] max x, min x, max y, min y, max z, min z
+    247  uint64    number of point records (1.4, header size 375)
+    */
+    file.seek(0);
+    QByteArray header = file.read(375);
+    const uchar *h = (const uchar *)header.constData();
+
+    if(header.size() < 227 || header.left(4) != "LASF")
+    {
+        errorString = "The imported file is no LAS file.";
+        return false;
+    }
+
+    versionMajor = h[24];
+    versionMinor = h[25];
+    int headerSize = qFromLittleEndian<quint16>(h + 94);
+    dataOffset = qFromLittleEndian<quint32>(h + 96);
+    int formatId = h[104];
+    recordLength = qFromLittleEndian<quint16>(h + 105);
+    pointCount = qFromLittleEndian<quint32>(h + 107);
+
+    for(int c = 0; c < 3; c++)
+    {
+        scale[c] = readDouble(h + 131 + 8 * c);
+        offset[c] = readDouble(h + 155 + 8 * c);
+        boundsMax[c] = readDouble(h + 179 + 16 * c);
+        boundsMin[c] = readDouble(h + 187 + 16 * c);
+    }
+
+    //LAS 1.4 keeps the number of points in a 64 bit field, the legacy field is 0 for formats 6+
+    if((versionMajor > 1 || versionMinor >= 4) && headerSize >= 255 && header.size() >= 255)
+    {
+        qint64 count = qFromLittleEndian<quint64>(h + 247);
+        if(count > 0)
+            pointCount = count;
+    }
+
+    qDebug() << "LAS" << versionMajor << "." << versionMinor << "point format" << (formatId & 0x3F)
+             << "record length" << recordLength << "points" << pointCount;
+
+    if(formatId & 0x80)
+    {
+        errorString = "The imported LAS file is compressed (LAZ). This is not supported, yet!";
+        return false;
+    }
+
+    pointFormat = formatId & 0x3F;
+
+    //Minimum record length and byte offset of red, green, blue
+    int minimumLength;
+    switch(pointFormat)
+    {
+    case 0: minimumLength = 20; colorOffset = -1; break;
+    case 1: minimumLength = 28; colorOffset = -1; break;
+    case 2: minimumLength = 26; colorOffset = 20; break;
+    case 3: minimumLength = 34; colorOffset = 28; break;
+    case 6: minimumLength = 30; colorOffset = -1; break;
+    case 7: minimumLength = 36; colorOffset = 30; break;
+    case 8: minimumLength = 38; colorOffset = 30; break;
+    default:
+        errorString = "The point format " + QString::number(pointFormat) + " of the imported LAS file is not supported, yet!";
+        return false;
+    }
+
+    if(recordLength < minimumLength || dataOffset < headerSize)
+    {
+        errorString = "The header of the imported LAS file is corrupt.";
+        return false;
+    }
+
+    detectValueRanges(file);
+
+    return true;
+}
+
+void LasSchema::detectValueRanges(QFile &file)
+{
+    //The specification asks for 16 bit colors and intensities, many writers store 8 bit values
+    //(or 12 bit intensities) anyway. The first records decide how far the values get shifted.
+    const qint64 sampleRecords = qMin(pointCount, (qint64)65536);
+
+    file.seek(dataOffset);
+    QByteArray sample = file.read(sampleRecords * recordLength);
+    const uchar *record = (const uchar *)sample.constData();
+    int records = sample.size() / recordLength;
+
+    quint16 maximumColor = 0;
+    quint16 maximumIntensity = 0;
+
+    for(int i = 0; i < records; i++, record += recordLength)
+    {
+        maximumIntensity = qMax(maximumIntensity, qFromLittleEndian<quint16>(record + 12));
+
+        if(colorOffset >= 0)
+        {
+            for(int c = 0; c < 3; c++)
+                maximumColor = qMax(maximumColor, qFromLittleEndian<quint16>(record + colorOffset + 2 * c));
+        }
+    }
+
+    colorShift = shiftTo8Bit(maximumColor);
+    intensityShift = shiftTo8Bit(maximumIntensity);
+}
+
+void LasSchema::setOrigin(double x, double y, double z)
+{
+    origin[0] = x;
+    origin[1] = y;
+    origin[2] = z;
+}
+
+void LasSchema::defaultOrigin(double origin[3]) const
+{
+    bool hasOffset = offset[0] != 0.0 || offset[1] != 0.0 || offset[2] != 0.0;
+
+    //A scan in scanner coordinates contains (0, 0, 0), it is kept as origin
+    bool containsZero = true;
+    for(int c = 0; c < 3; c++)
+        containsZero = containsZero && boundsMin[c] <= 0.0 && boundsMax[c] >= 0.0;
+
+    for(int c = 0; c < 3; c++)
+    {
+        if(hasOffset)
+            origin[c] = offset[c];
+        else if(!containsZero)
+            origin[c] = boundsMin[c];
+        else
+            origin[c] = 0.0;
+    }
+}
+
+double LasSchema::readDouble(const uchar *data)
+{
+    quint64 bits = qFromLittleEndian<quint64>(data);
+    double value;
+    memcpy(&value, &bits, sizeof(double));
+    return value;
+}
+
+int LasSchema::shiftTo8Bit(quint16 maximum)
+{
+    int shift = 0;
+    while((maximum >> shift) > 255)
+        shift++;
+    return shift;
+}
+
+void LasSchema::dequantize(const qint32 *quantized, int count, double scale, double shift, float *coordinates)
+{
+    //No branches and no aliasing between input and output: vectorized by the compiler.
+    //The local origin is already part of shift, only the small local value is rounded to float.
+    for(int i = 0; i < count; i++)
+        coordinates[i] = (float)(quantized[i] * scale + shift);
+}
+
+void LasSchema::decode(const uchar *records, int count, PointBuffer &points) const
+{
+    int first = points.size();
+    points.resize(first + count);
+
+    float *x = points.x.data() + first;
+    float *y = points.y.data() + first;
+    float *z = points.z.data() + first;
+    QRgb *rgba = points.hasChannel(PointBuffer::COLOR) ? points.rgba.data() + first : NULL;
+
+    qint32 quantized[3][DecodeBatch];
+
+    for(int done = 0; done < count; done += DecodeBatch)
+    {
+        int batch = qMin(count - done, DecodeBatch);
+        const uchar *record = records + (qint64)done * recordLength;
+
+        //Gather: X, Y, Z are the first three fields of every point format
+        for(int i = 0; i < batch; i++, record += recordLength)
+        {
+            quantized[0][i] = qFromLittleEndian<qint32>(record);
+            quantized[1][i] = qFromLittleEndian<qint32>(record + 4);
+            quantized[2][i] = qFromLittleEndian<qint32>(record + 8);
+        }
+
+        dequantize(quantized[0], batch, scale[0], offset[0] - origin[0], x + done);
+        dequantize(quantized[1], batch, scale[1], offset[1] - origin[1], y + done);
+        dequantize(quantized[2], batch, scale[2], offset[2] - origin[2], z + done);
+
+        if(rgba == NULL)
+            continue;
+
+        record = records + (qint64)done * recordLength;
+
+        if(colorOffset >= 0)
+        {
+            for(int i = 0; i < batch; i++, record += recordLength)
+            {
+                const uchar *color = record + colorOffset;
+                rgba[done + i] = qRgb(qMin(qFromLittleEndian<quint16>(color) >> colorShift, 255),
+                                      qMin(qFromLittleEndian<quint16>(color + 2) >> colorShift, 255),
+                                      qMin(qFromLittleEndian<quint16>(color + 4) >> colorShift, 255));
+            }
+        }
+        else
+        {
+            for(int i = 0; i < batch; i++, record += recordLength)
+            {
+                int grey = qMin(qFromLittleEndian<quint16>(record + 12) >> intensityShift, 255);
+                rgba[done + i] = qRgb(grey, grey, grey);
+            }
+        }
+    }
+}
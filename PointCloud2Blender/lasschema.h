@@ -0,0 +1,92 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef LASSCHEMA_H
+#define LASSCHEMA_H
+
+#include <QDebug>
+#include <QFile>
+#include <QString>
+#include <QtEndian>
+#include <QColor>
+
+#include <cstring>
+
+#include "pointbuffer.h"
+
+/*
+ * The point record layout of a LAS 1.2 - 1.4 file, compiled from its public header block.
+ *
+ * Point formats 0 - 3 and 6 - 8 are supported. The records have a fixed size (including
+ * optional extra bytes), so they are decoded straight from the mapped file: the quantized
+ * coordinates of a batch are gathered first, then scale and offset get applied in one
+ * branch free loop over the whole batch, which the compiler vectorizes.
+ * Georeferenced coordinates are far too large for float: they are moved to a local origin
+ * in double precision before they get stored.
+ * Formats without RGB get their intensity as a grey value.
+ */
+class LasSchema
+{
+public:
+    LasSchema();
+
+    bool parseHeader(QFile &file);
+
+    int versionMajor;
+    int versionMinor;
+    int pointFormat;
+    int recordLength;
+    qint64 pointCount;
+    qint64 dataOffset;
+    QString errorString;
+
+    //Coordinate = quantized value * scale + offset
+    double scale[3];
+    double offset[3];
+    double boundsMin[3];
+    double boundsMax[3];
+
+    //Subtracted from every decoded coordinate, (0, 0, 0) keeps the file coordinates
+    double origin[3];
+    void setOrigin(double x, double y, double z);
+
+    //Header offset, or the bounds minimum if the file has no offset but lies far from (0, 0, 0)
+    void defaultOrigin(double origin[3]) const;
+
+    bool hasColor() const { return colorOffset >= 0; }
+
+    //Decode count consecutive records, appended to points
+    void decode(const uchar *records, int count, PointBuffer &points) const;
+
+    //Records dequantized at once
+    static const int DecodeBatch = 1024;
+
+private:
+    int colorOffset;
+    int colorShift;
+    int intensityShift;
+
+    void detectValueRanges(QFile &file);
+
+    static double readDouble(const uchar *data);
+    static int shiftTo8Bit(quint16 maximum);
+    static void dequantize(const qint32 *quantized, int count, double scale, double shift, float *coordinates);
+};
+
+#endif // LASSCHEMA_H
@@ -17,6 +17,7 @@
 */
 
 #include "mainwindow.h"
+#include "benchmark.h"
 #include <QApplication>
 
 QString get_string(QString option)
@@ -47,10 +48,19 @@ void usage(QString name)
     qDebug() << " --input={file}: your point cloud file";
     qDebug() << " --translation=x,y,z: initial translation of point cloud";
     qDebug() << " --up={left/right}{x/y/z}: coordinate system handedness and up direction";
-    qDebug() << " --resolution={1/2/4/8/16}: the resolution of the panorama images";
+    qDebug() << " --resolution={original/1/2/4/8/16}: the resolution of the panorama images (original: analyze the file first)";
     qDebug() << " --distance=maxDistance: the maximum distance of a point from the origin in meters";
     qDebug() << " --projection={equirectangular/cylindrical/mercator}: the type of projection you want to use for the panoramas";
+    qDebug() << " --threads=n: number of threads used for parsing and meshing (1 = serial import)";
+    qDebug() << " --splatting={atomic/private/serial}: how the parsing threads write into the panorama";
+    qDebug() << " --analysis={sampled/full}: sampled analysis of the original resolution, or all points (full: parsed once for analysis and import)";
+    qDebug() << " --tiles={CxR/auto}: split the mesh into C x R tiles, one .obj each (default 1x1, auto: about 1024x1024 pixels per tile)";
+    qDebug() << " --decimals=v[,t]: decimals of the vertex positions (default 4) and texture coordinates (default 6) in the .obj files";
+    qDebug() << " --cachedir={dir}: directory of the parse cache (default: next to the input file)";
+    qDebug() << " --nocache: neither read nor write the parse cache";
+    qDebug() << " --convert={file.xyb}: convert the input file into the binary .xyb format and exit";
     qDebug() << " --nogui: don't show a user interface";
+    qDebug() << " --benchmark: measure the import throughput on the input file and the .obj writing throughput, then exit";
     qDebug() << " --help: this help text";
     qDebug() << "example: .xyz 2 Blender usage";
     qDebug() << " ./" + app + " --input=file.xyz --translation=(20,10,50) --up=leftx --resolution=16 --distance=60 --projection=equirectangular --nogui";
@@ -86,7 +96,17 @@ int main(int argc, char *argv[])
     int resolution=1;
     float distance=60.0f;
     QString projection="equirectangular";
+    int threads=QThread::idealThreadCount();
+    QString splatting="atomic";
     bool gui=true;
+    bool benchmark=false;
+    QString convertFile;
+    QString cacheDir;
+    bool parseCache=true;
+    bool cacheOptions=false;
+    QString analysis;
+    QString tiles;
+    QString decimals;
 
     //Initialize Variables
     for(int i=0; i<opt.size(); i++)
@@ -94,21 +114,66 @@ int main(int argc, char *argv[])
         if(opt[i].startsWith("input=")) inputFile=get_string(opt[i]);
         else if(opt[i].startsWith("translation=")) translation=get_string(opt[i]);
         else if(opt[i].startsWith("up=")) up=get_string(opt[i]);
+        else if(opt[i] == "resolution=original") resolution=0;
         else if(opt[i].startsWith("resolution=")) resolution=get_int(opt[i]);
         else if(opt[i].startsWith("distance=")) distance=get_float(opt[i]);
         else if(opt[i].startsWith("projection=")) projection=get_string(opt[i]);
+        else if(opt[i].startsWith("threads=")) threads=get_int(opt[i]);
+        else if(opt[i].startsWith("splatting=")) splatting=get_string(opt[i]);
         else if(opt[i] == "nogui") gui=false;
+        else if(opt[i] == "benchmark") benchmark=true;
+        else if(opt[i].startsWith("convert=")) convertFile=get_string(opt[i]);
+        else if(opt[i].startsWith("cachedir=")) { cacheDir=get_string(opt[i]); cacheOptions=true; }
+        else if(opt[i].startsWith("analysis=")) analysis=get_string(opt[i]);
+        else if(opt[i].startsWith("tiles=")) tiles=get_string(opt[i]);
+        else if(opt[i].startsWith("decimals=")) decimals=get_string(opt[i]);
+        else if(opt[i] == "nocache") { parseCache=false; cacheOptions=true; }
         else if(opt[i] == "help") usage( appname );
         else usage( appname );
     }
 
+    if(benchmark)
+    {
+        return Benchmark::run(inputFile);
+    }
+
+    if(!convertFile.isEmpty())
+    {
+        //Parse once, afterwards the .xyb file can be imported without parsing
+        ImportWorker *converter = new ImportWorker(NULL, NULL, inputFile, false);
+        converter->setThreadCount(threads);
+
+        //The scanner sits at -translation in file coordinates
+        translation.replace("(", "").replace(")", "");
+        QStringList translationComponents = translation.split(",");
+        QVector3D origin;
+        if(translationComponents.size() == 3)
+            origin = -QVector3D(translationComponents.at(0).toFloat(), translationComponents.at(1).toFloat(), translationComponents.at(2).toFloat());
+
+        if(!converter->setConversionTarget(convertFile, origin))
+            return 1;
+
+        //Scripts rely on the exit code, every reported error fails the conversion
+        converter->run();
+        return converter->conversionFailed() ? 1 : 0;
+    }
 
     MainWindow w;
 
+    //Otherwise the settings of the user interface apply
+    if(cacheOptions)
+        w.setParseCache(parseCache, cacheDir);
+    if(!analysis.isEmpty())
+        w.setAnalysisMode(analysis);
+    if(!tiles.isEmpty())
+        w.setMeshTiles(tiles);
+    if(!decimals.isEmpty())
+        w.setMeshPrecision(decimals);
+
     if(!gui)
     {
         //GUI will not start
-        w.processCommandLine(inputFile, translation, up, resolution, distance, projection);
+        w.processCommandLine(inputFile, translation, up, resolution, distance, projection, threads, splatting);
 
     }
     else
@@ -23,8 +23,6 @@ MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow)
 {
-    qRegisterMetaType<Point3D>("Point3D");
-
     ui->setupUi(this);
 
     threadPool.setMaxThreadCount(20);
@@ -37,6 +35,28 @@ MainWindow::MainWindow(QWidget *parent) :
     translation = QVector3D(0,0,0);
     maxDistance = 60.0f;
     projectionType = Panorama3D::EQUIRECTANGULAR;
+    importThreads = QThread::idealThreadCount();
+    pendingScanMeshes = 0;
+    panoramaMeshed = false;
+    meshedNormalAngle = 0.0;
+    splattingMode = ImportWorker::ATOMIC_SPLATTING;
+
+    //0 disables the cache, every import parses the file again
+    pointCache.setMemoryLimit(settings.value("cache/memoryLimitMB", 2048).toLongLong() * 1024 * 1024);
+
+    //Empty directory: the cache is written next to the point cloud file
+    parseCaching = settings.value("cache/parseCache", true).toBool();
+    parseCacheDirectory = settings.value("cache/directory", "").toString();
+    importAfterAnalysis = false;
+
+    //Sampled: seconds instead of a full read, full: one parse for analysis and import
+    setAnalysisMode(settings.value("analysis/mode", "sampled").toString());
+
+    //Columns x rows, e.g. "8x4", or "auto". One .obj file unless asked otherwise
+    setMeshTiles(settings.value("mesh/tiles", "1x1").toString());
+
+    //"vertex,texture" decimals, e.g. "4,6"
+    setMeshPrecision(settings.value("mesh/decimals", "").toString());
 
     originalHorizontalResolution = 0;
     originalVerticalResolution = 0;
@@ -66,6 +86,7 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->sbTranslateY, SIGNAL(valueChanged(double)), this, SLOT(onChangeTranslationVectorY(double)));
     connect(ui->sbTranslateZ, SIGNAL(valueChanged(double)), this, SLOT(onChangeTranslationVectorZ(double)));
     connect(ui->sbMaxDistance, SIGNAL(valueChanged(double)), this, SLOT(onChangeMaxDistance(double)));
+    connect(ui->sbNormalAngle, SIGNAL(editingFinished()), this, SLOT(onChangeNormalAngle()));
     connect(ui->btnProjectionTypeEquirectangular, SIGNAL(clicked()), this, SLOT(onClickProjectionTypeEquirectangular()));
     connect(ui->btnProjectionTypeCylindrical, SIGNAL(clicked()), this, SLOT(onClickProjectionTypeCylindrical()));
     connect(ui->btnProjectionTypeMercator, SIGNAL(clicked()), this, SLOT(onClickProjectionTypeMercator()));
@@ -94,12 +115,19 @@ MainWindow::~MainWindow()
     if(panorama != NULL)
         delete panorama;
 
+    QList<ImportWorker*> runningScans = scanImporters.keys();
+    for(int i = 0; i < runningScans.size(); i++)
+        runningScans.at(i)->stopThread();
+
     threadPool.waitForDone(30000);
+
+    qDeleteAll(structuredScans);
+    qDeleteAll(scanPanoramas);
 }
 
-void MainWindow::processCommandLine(QString inputFile, QString translation, QString up, int resolution, float distance, QString projection)
+void MainWindow::processCommandLine(QString inputFile, QString translation, QString up, int resolution, float distance, QString projection, int threads, QString splatting)
 {
-    qDebug() << "called MainWindow::processCommandLine("<< inputFile <<","<<translation<< ","<<up<<","<<resolution<<","<<distance<<","<<projection<<")";
+    qDebug() << "called MainWindow::processCommandLine("<< inputFile <<","<<translation<< ","<<up<<","<<resolution<<","<<distance<<","<<projection<<","<<threads<<","<<splatting<<")";
 
     setFilePath(inputFile);
 
@@ -144,6 +172,8 @@ void MainWindow::processCommandLine(QString inputFile, QString translation, QStr
     }
 
     this->resolution = resolution;
+    if(resolution > 0)
+        calculateCustomResolution(360*resolution, 180*resolution, 1);
     this->maxDistance = distance;
     if(projection == "equirectangular")
     {
@@ -162,11 +192,83 @@ void MainWindow::processCommandLine(QString inputFile, QString translation, QStr
         this->projectionType = Panorama3D::EQUIRECTANGULAR;
     }
 
+    this->importThreads = threads;
+
+    if(splatting == "private")
+    {
+        this->splattingMode = ImportWorker::PRIVATE_TILE_SPLATTING;
+    }
+    else if(splatting == "serial")
+    {
+        this->splattingMode = ImportWorker::SERIAL_SPLATTING;
+    }
+    else
+    {
+        this->splattingMode = ImportWorker::ATOMIC_SPLATTING;
+    }
+
+    //PTX scans are range images, there is no panorama resolution to determine
+    if(resolution <= 0 && !inputFile.endsWith(".ptx"))
+    {
+        //Original resolution: analyzed first (or taken from the parse cache), then imported
+        importAfterAnalysis = true;
+        onClickDeterminePanoramaResolution();
+        return;
+    }
+
     startFileImport();
 
 
 }
 
+void MainWindow::setParseCache(bool enabled, QString directory)
+{
+    this->parseCaching = enabled;
+    this->parseCacheDirectory = directory;
+}
+
+void MainWindow::setAnalysisMode(QString mode)
+{
+    if(mode == "full")
+        this->analysisMode = ImportWorker::FULL_ANALYSIS;
+    else
+        this->analysisMode = ImportWorker::SAMPLED_ANALYSIS;
+}
+
+void MainWindow::setMeshTiles(QString tiles)
+{
+    QStringList components = tiles.split("x");
+    if(components.size() == 2)
+    {
+        this->meshTileColumns = components.at(0).toInt();
+        this->meshTileRows = components.at(1).toInt();
+    }
+    else if(tiles == "auto")
+    {
+        this->meshTileColumns = 0;
+        this->meshTileRows = 0;
+    }
+    else
+    {
+        this->meshTileColumns = 1;
+        this->meshTileRows = 1;
+    }
+}
+
+void MainWindow::setMeshPrecision(QString decimals)
+{
+    QStringList components = decimals.split(",");
+    bool valid = false;
+
+    this->meshVertexDecimals = components.at(0).toInt(&valid);
+    if(!valid)
+        this->meshVertexDecimals = ObjWriter::DefaultVertexDecimals;
+
+    this->meshTextureDecimals = (components.size() > 1) ? components.at(1).toInt(&valid) : 0;
+    if(components.size() < 2 || !valid)
+        this->meshTextureDecimals = ObjWriter::DefaultTextureDecimals;
+}
+
 void MainWindow::generateMenus()
 {
     //Load application settings
@@ -210,7 +312,7 @@ void MainWindow::calculateCustomResolution(int horizontal, int vertical, int div
 void MainWindow::showFileOpenDialog()
 {
     //The following filetypes are selectable
-    QString fileFormat = "All Files (*.*);;XYZ Ascii Files (*xyz);;XYZ Binary Files (*xyb);;PLY Ascii Files (*ply)";
+    QString fileFormat = "All Files (*.*);;XYZ Ascii Files (*xyz);;XYZ Binary Files (*xyb);;PLY Files (*ply);;PTX Files (*ptx);;E57 Files (*e57);;LAS Files (*las)";
     QString fileName = "";
 
     fileName = QFileDialog::getOpenFileName(this, "Please specify your point cloud file", QDir::currentPath() + "/../TestData", fileFormat);
@@ -241,12 +343,27 @@ void MainWindow::startFileImport()
     qDebug() << "MainWindow::startFileImport()";
 
     ui->canvasGL->pointCloudMesh->reset(false);
+    panoramaMeshed = false;
 
     ui->btnDeterminePanoramaResolution->setEnabled(false);
     ui->btnImport->setEnabled(false);
 
     setStatusTip("Importing...");
 
+    qDeleteAll(scanPanoramas);
+    scanPanoramas.clear();
+
+    //E57 files with several scans get one panorama per scan
+    if(ui->txtFilePathImport->text().endsWith(".e57"))
+    {
+        E57Reader reader;
+        if(reader.open(ui->txtFilePathImport->text()) && reader.scans.size() > 1)
+        {
+            startScanImports(reader.scans.size());
+            return;
+        }
+    }
+
     //delete panorama
     if(panorama != NULL)
     {
@@ -256,8 +373,16 @@ void MainWindow::startFileImport()
     connect(panorama, SIGNAL(updateDepthMap(QImage*)), this, SLOT(updateDepthMap(QImage*)), Qt::QueuedConnection);
     connect(panorama, SIGNAL(updateColorMap(QImage*)), this, SLOT(updateColorMap(QImage*)), Qt::QueuedConnection);
 
+    qDeleteAll(structuredScans);
+    structuredScans.clear();
+
     //delete importer
     importer = new ImportWorker(panorama, ui->canvasGL, ui->txtFilePathImport->text(), false);
+    importer->setThreadCount(importThreads);
+    importer->setSplattingMode(splattingMode);
+    importer->setPointCache(&pointCache);
+    importer->setParseCache(parseCaching, parseCacheDirectory);
+    importer->setStructuredScans(&structuredScans);
     connect(importer, SIGNAL(importStatus(float)), this, SLOT(updateImportStatus(float)));
     connect(importer, SIGNAL(showInfoMessage(QString)), this, SLOT(showInfoMessage(QString)));
     connect(importer, SIGNAL(showErrorMessage(QString)), this, SLOT(showErrorMessage(QString)));
@@ -265,6 +390,73 @@ void MainWindow::startFileImport()
     threadPool.start(importer);
 }
 
+void MainWindow::startScanImports(int scans)
+{
+    qDebug() << "MainWindow::startScanImports(" << scans << ")";
+
+    //The threads are shared by the scans
+    int threadsPerScan = qMax(1, (importThreads > 0 ? importThreads : QThread::idealThreadCount()) / scans);
+    pendingScanMeshes = scans;
+
+    for(int i = 0; i < scans; i++)
+    {
+        Panorama3D *scanPanorama = new Panorama3D(translation, orientation, customPanoramaWidth, customPanoramaHeight, maxDistance, projectionType, this);
+        scanPanorama->mapFilename += "_scan_" + QString::number(i);
+        connect(scanPanorama, SIGNAL(updateDepthMap(QImage*)), this, SLOT(updateDepthMap(QImage*)), Qt::QueuedConnection);
+        connect(scanPanorama, SIGNAL(updateColorMap(QImage*)), this, SLOT(updateColorMap(QImage*)), Qt::QueuedConnection);
+        scanPanoramas.append(scanPanorama);
+
+        ImportWorker *scanImporter = new ImportWorker(scanPanorama, ui->canvasGL, ui->txtFilePathImport->text(), false);
+        scanImporter->setThreadCount(threadsPerScan);
+        scanImporter->setSplattingMode(splattingMode);
+        scanImporter->setE57Scan(i);
+        connect(scanImporter, SIGNAL(importStatus(float)), this, SLOT(updateScanImportStatus(float)));
+        connect(scanImporter, SIGNAL(showInfoMessage(QString)), this, SLOT(showInfoMessage(QString)));
+        connect(scanImporter, SIGNAL(showErrorMessage(QString)), this, SLOT(showErrorMessage(QString)));
+        scanImporters.insert(scanImporter, scanPanorama);
+    }
+
+    QList<ImportWorker*> scanWorkers = scanImporters.keys();
+    for(int i = 0; i < scanWorkers.size(); i++)
+        threadPool.start(scanWorkers.at(i));
+}
+
+void MainWindow::updateScanImportStatus(float percent)
+{
+    ImportWorker *scanImporter = qobject_cast<ImportWorker*>(sender());
+    if(scanImporter == NULL || !scanImporters.contains(scanImporter))
+        return;
+
+    if(percent < 100.0f)
+    {
+        ui->prbImportStatus->setValue(percent);
+        return;
+    }
+
+    //Every scan is saved and meshed as soon as it is imported
+    Panorama3D *scanPanorama = scanImporters.take(scanImporter);
+    scanPanorama->finished();
+    if(scanImporters.isEmpty())
+        ui->canvasGL->pointCloudMesh->finished();
+
+    setStatusTip("Meshing...");
+    MeshWorker *scanMesher = new MeshWorker(scanPanorama, ui->canvasGL, ui->sbNormalAngle->value(), this);
+    scanMesher->setTiles(meshTileColumns, meshTileRows);
+    scanMesher->setPrecision(meshVertexDecimals, meshTextureDecimals);
+    scanMesher->setThreadCount(qMax(1, importThreads / qMax(1, pendingScanMeshes)));
+    connect(scanMesher, SIGNAL(meshingStatus(float)), this, SLOT(updateScanMeshingStatus(float)));
+    threadPool.start(scanMesher);
+}
+
+void MainWindow::updateScanMeshingStatus(float percent)
+{
+    if(percent < 100.0f)
+        return;
+
+    if(--pendingScanMeshes == 0)
+        updateMeshingStatus(100.0f);
+}
+
 void MainWindow::openRecentFile()
 {
     //Get the text from the menu item and use it as the filepath
@@ -291,19 +483,51 @@ void MainWindow::updateImportStatus(float percent)
         else
         {
             ui->prbImportStatus->setValue(0);
-            setStatusTip("Saving panoramas...");
-            panorama->finished();
+            if(structuredScans.isEmpty())
+            {
+                setStatusTip("Saving panoramas...");
+                panorama->finished();
+            }
             ui->canvasGL->pointCloudMesh->finished();
 
-            setStatusTip("Meshing...");
-            mesher = new MeshWorker(panorama, ui->canvasGL, ui->sbNormalAngle->value(), this);
-            connect(mesher, SIGNAL(meshingStatus(float)), this, SLOT(updateMeshingStatus(float)));
-            threadPool.start(mesher);
+            startMeshing();
         }
 
     }
 }
 
+void MainWindow::startMeshing()
+{
+    setStatusTip("Meshing...");
+    meshedNormalAngle = ui->sbNormalAngle->value();
+    mesher = new MeshWorker(panorama, ui->canvasGL, meshedNormalAngle, this);
+    mesher->setStructuredScans(structuredScans);
+    mesher->setTiles(meshTileColumns, meshTileRows);
+    mesher->setPrecision(meshVertexDecimals, meshTextureDecimals);
+    mesher->setThreadCount(importThreads);
+    connect(mesher, SIGNAL(meshingStatus(float)), this, SLOT(updateMeshingStatus(float)));
+    threadPool.start(mesher);
+}
+
+void MainWindow::onChangeNormalAngle()
+{
+    //Only the filter of the mesh changed: the panorama of the last import gets meshed again, the quads
+    //are not measured again (cached in the panorama), they only get filtered and written
+    if(!panoramaMeshed || panorama == NULL || !structuredScans.isEmpty() || !scanPanoramas.isEmpty() || !ui->btnImport->isEnabled())
+        return;
+    if(ui->sbNormalAngle->value() == meshedNormalAngle)
+        return;
+
+    qDebug() << "Meshing again with normal angle threshold" << ui->sbNormalAngle->value();
+
+    startTime = QDateTime::currentMSecsSinceEpoch();
+    panoramaMeshed = false;
+    ui->btnImport->setEnabled(false);
+    ui->canvasGL->pointCloudMesh->reset(false);
+
+    startMeshing();
+}
+
 void MainWindow::updateMeshingStatus(float percent)
 {
     ui->prbImportStatus->setValue(percent);
@@ -314,15 +538,17 @@ void MainWindow::updateMeshingStatus(float percent)
 
     if(percent >= 100.0f)
     {
+        panoramaMeshed = true;
         QMessageBox::information(this, "Meshing complete!", "The meshing process has finished. This took " + QString::number(minutes, 'f', 2) + " minutes.\n\nYou can see the result in the 3D viewer and you can use the generated .obj file in Blender. Have fun!", QMessageBox::Ok);
         ui->btnImport->setEnabled(true);
     }
 }
 
-void MainWindow::setOriginalResolution(int horizontalResolution)
+void MainWindow::setOriginalResolution(int horizontalResolution, int verticalResolution, float confidence)
 {
+    //Both axes are measured
     originalHorizontalResolution = horizontalResolution;
-    originalVerticalResolution = horizontalResolution / 2;
+    originalVerticalResolution = verticalResolution;
 
     ui->lblOriginalHorizontalResolution->setText( QString::number(originalHorizontalResolution) );
     ui->lblOriginalVerticalResolution->setText( QString::number(originalVerticalResolution) );
@@ -330,8 +556,11 @@ void MainWindow::setOriginalResolution(int horizontalResolution)
     ui->sbResolutionHorizontal->setValue(originalHorizontalResolution);
     ui->sbResolutionVertical->setValue(originalVerticalResolution);
 
-    //Save as App-setting
+    //Save as App-setting and with the file
     settings.setValue("import/originalHorizontalResolution", originalHorizontalResolution);
+    if(parseCaching)
+        ParseCache(ui->txtFilePathImport->text(), parseCacheDirectory).storeOriginalResolution(translation, orientation, analysisMode == ImportWorker::SAMPLED_ANALYSIS,
+                                                                                               originalHorizontalResolution, originalVerticalResolution, confidence);
 
     //Recalculate resolution
     this->calculateCustomResolution(originalHorizontalResolution, originalVerticalResolution, 1);
@@ -339,10 +568,17 @@ void MainWindow::setOriginalResolution(int horizontalResolution)
     ui->btnPanoramaResolutionCustom->setChecked(true);
     //ui->btnImport->setEnabled(true);
 
+    if(importAfterAnalysis)
+    {
+        importAfterAnalysis = false;
+        startFileImport();
+        return;
+    }
+
     float duration = (QDateTime::currentMSecsSinceEpoch() - startTime) / 1000.0f;
     float minutes = duration / 60.0f;
 
-    QMessageBox::information(this, "File analyzed!", "Analyzing the file took " + QString::number(minutes, 'f', 2) + " minutes.\nThe original resolution of the point cloud probably was:\n" + QString::number(originalHorizontalResolution) + " by " + QString::number(originalVerticalResolution) +" Points.", QMessageBox::Ok);
+    QMessageBox::information(this, "File analyzed!", "Analyzing the file took " + QString::number(minutes, 'f', 2) + " minutes.\nThe original resolution of the point cloud probably was:\n" + QString::number(originalHorizontalResolution) + " by " + QString::number(originalVerticalResolution) +" Points (confidence " + QString::number(confidence * 100.0f, 'f', 1) + "%).", QMessageBox::Ok);
 
 }
 
@@ -477,6 +713,17 @@ void MainWindow::onClickDeterminePanoramaResolution()
 {
     startTime = QDateTime::currentMSecsSinceEpoch();
 
+    //An unchanged file does not need to be analyzed again with the same settings
+    int cachedHorizontal, cachedVertical;
+    float cachedConfidence;
+    if(parseCaching && ParseCache(ui->txtFilePathImport->text(), parseCacheDirectory).originalResolution(translation, orientation, analysisMode == ImportWorker::SAMPLED_ANALYSIS,
+                                                                                                        cachedHorizontal, cachedVertical, cachedConfidence))
+    {
+        qDebug() << "Parse cache: original resolution" << cachedHorizontal << "x" << cachedVertical;
+        setOriginalResolution(cachedHorizontal, cachedVertical, cachedConfidence);
+        return;
+    }
+
     analyzingOriginalResolution = true;
     ui->btnDeterminePanoramaResolution->setEnabled(false);
     ui->btnImport->setEnabled(false);
@@ -487,7 +734,15 @@ void MainWindow::onClickDeterminePanoramaResolution()
     }
     this->panorama = new Panorama3D(translation, orientation, customPanoramaWidth, customPanoramaHeight, maxDistance, projectionType, this);
     this->importer = new ImportWorker(this->panorama, ui->canvasGL, ui->txtFilePathImport->text(), true, this);
-    connect(this->importer, SIGNAL(originalResolution(int)), this, SLOT(setOriginalResolution(int)));
+    this->importer->setThreadCount(importThreads);
+    this->importer->setAnalysisMode(analysisMode);
+
+    //Fused analysis and import (full analysis, chosen automatically if the import follows directly):
+    //the points get buffered while they are analyzed, the import with the detected resolution only projects them
+    this->importer->setFusedImport(importAfterAnalysis);
+    this->importer->setPointCache(&pointCache);
+    this->importer->setParseCache(parseCaching, parseCacheDirectory);
+    connect(this->importer, SIGNAL(originalResolution(int,int,float)), this, SLOT(setOriginalResolution(int,int,float)));
     connect(this->importer, SIGNAL(importStatus(float)), this, SLOT(updateImportStatus(float)));
 
     ui->lblOriginalHorizontalResolution->setText("analyzing...");
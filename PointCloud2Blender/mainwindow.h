@@ -34,6 +34,7 @@
 #include "importworker.h"
 #include "panorama3d.h"
 #include "meshworker.h"
+#include "e57reader.h"
 
 namespace Ui {
 class MainWindow;
@@ -58,6 +59,37 @@ class MainWindow : public QMainWindow
     QVector3D translation;
     Panorama3D::ProjectionType projectionType;
     float maxDistance;
+    int importThreads;
+    ImportWorker::SplattingMode splattingMode;
+
+    //Parsed points of the last import, for re-projection with new settings
+    PointCache pointCache;
+
+    //Scans of a .ptx import, meshed directly
+    QList<StructuredScan*> structuredScans;
+
+    //E57 files with several scans: one panorama and importer per scan, all at once
+    QHash<ImportWorker*, Panorama3D*> scanImporters;
+    QList<Panorama3D*> scanPanoramas;
+    int pendingScanMeshes;
+
+    //The panorama of the last import is meshed, a new normal angle only needs a filter and emit pass
+    bool panoramaMeshed;
+    double meshedNormalAngle;
+
+    //Decoded points and analysis results stored on disk, across runs
+    bool parseCaching;
+    QString parseCacheDirectory;
+    bool importAfterAnalysis;
+    ImportWorker::AnalysisMode analysisMode;
+
+    //Tiles of the panorama mesh, 0 x 0: automatic
+    int meshTileColumns;
+    int meshTileRows;
+
+    //Decimals of vertex positions and texture coordinates in the .obj files
+    int meshVertexDecimals;
+    int meshTextureDecimals;
 
     QSettings settings;
     qint64 startTime;
@@ -71,13 +103,19 @@ class MainWindow : public QMainWindow
 public:
     explicit MainWindow(QWidget *parent = 0);
     ~MainWindow();
-    void processCommandLine(QString inputFile, QString translation, QString up, int resolution, float distance, QString projection);
+    void setParseCache(bool enabled, QString directory);
+    void setAnalysisMode(QString mode);
+    void setMeshTiles(QString tiles);
+    void setMeshPrecision(QString decimals);
+    void processCommandLine(QString inputFile, QString translation, QString up, int resolution, float distance, QString projection, int threads, QString splatting);
 
 private:
     Ui::MainWindow *ui;
 
     void generateMenus();
     void calculateCustomResolution(int horizontal, int vertical, int divisor);
+    void startScanImports(int scans);
+    void startMeshing();
 
 public slots:
     void showFileOpenDialog();
@@ -86,7 +124,9 @@ public slots:
     void openRecentFile();
     void updateImportStatus(float percent);
     void updateMeshingStatus(float percent);
-    void setOriginalResolution(int horizontalResolution);
+    void updateScanImportStatus(float percent);
+    void updateScanMeshingStatus(float percent);
+    void setOriginalResolution(int horizontalResolution, int verticalResolution, float confidence);
 
     void updateDepthMap(QImage *depthMap);
     void updateColorMap(QImage *colorMap);
@@ -107,6 +147,7 @@ public slots:
     void onChangeTranslationVectorY(double y);
     void onChangeTranslationVectorZ(double z);
     void onChangeMaxDistance(double distance);
+    void onChangeNormalAngle();
     void onClickProjectionTypeEquirectangular();
     void onClickProjectionTypeCylindrical();
     void onClickProjectionTypeMercator();
@@ -18,6 +18,8 @@
 
 #include "meshworker.h"
 
+const int MeshWorker::TileSize;
+
 MeshWorker::MeshWorker(Panorama3D *panorama, GLWidget *glWidget, float normalAngleThreshold, QObject *parent) : QObject(parent)
 {
     this->panorama = panorama;
@@ -26,8 +28,16 @@ MeshWorker::MeshWorker(Panorama3D *panorama, GLWidget *glWidget, float normalAng
     this->meshing = false;
     this->maxTiles = 1;
     this->currentTile = 0;
+    this->tileColumns = 1;
+    this->tileRows = 1;
+    this->scanColumns = 0;
+    this->vertexDecimals = ObjWriter::DefaultVertexDecimals;
+    this->textureDecimals = ObjWriter::DefaultTextureDecimals;
+    this->threadCount = QThread::idealThreadCount();
 
     this->normalAngleThreshold = normalAngleThreshold;
+    this->minimumArea = 0.0f;
+    this->minimumCosine = qAbs( qCos(normalAngleThreshold) );
 
     this->cancelThread = false;
 
@@ -49,235 +59,559 @@ void MeshWorker::run()
     this->meshing = true;
     qDebug() << "MeshWorker::run()";
 
-    int width = this->panorama->panoramaDepth.width();
-    int height = this->panorama->panoramaDepth.height();
+    int width = this->panorama->store.width();
+    int height = this->panorama->store.height();
+
+    //The vertices are in meters now, the threshold was tuned on 255 depth steps up to maxDistance
+    float depthStep = this->panorama->getMaxDistance() / 255.0f;
+    this->minimumArea = 0.005f * depthStep * depthStep;
+    this->minimumCosine = qAbs( qCos(normalAngleThreshold) );
 
-    while(this->meshing && !this->cancelThread)
+    if(!this->structuredScans.isEmpty())
     {
-        for(; this->currentTile < this->maxTiles; this->currentTile++)
+        //Every scan is a range image of its own, no panorama is involved: one .obj per scan, meshed concurrently
+        this->maxTiles = this->structuredScans.size();
+        this->scanColumns = 0;
+        for(int i = 0; i < this->maxTiles; i++)
+            this->scanColumns += qMax(this->structuredScans.at(i)->columns - 1, 0);
+        this->cellsDone.store(0);
+
+        qDebug() << "Meshing" << this->maxTiles << "scans with" << this->threadCount << "threads";
+
+        QThreadPool scanPool;
+        scanPool.setMaxThreadCount(this->threadCount);
+        for(int i = 0; i < this->maxTiles; i++)
+            scanPool.start(new MeshScan(this, this->structuredScans.at(i), i));
+        scanPool.waitForDone();
+
+        this->currentTile = this->maxTiles;
+        this->meshing = false;
+    }
+
+    if(this->meshing && !this->cancelThread)
+    {
+        //Automatic: tiles of about TileSize x TileSize pixels
+        if(this->tileColumns <= 0 || this->tileRows <= 0)
         {
-            //qDebug() << "this->currentTile" << this->currentTile << "this->maxTiles" << this->maxTiles;
+            this->tileColumns = (width + TileSize - 1) / TileSize;
+            this->tileRows = (height + TileSize - 1) / TileSize;
+        }
+        this->tileColumns = qBound(1, this->tileColumns, width);
+        this->tileRows = qBound(1, this->tileRows, height);
+        this->maxTiles = this->tileColumns * this->tileRows;
+        this->cellsDone.store(0);
 
-            QString filename_mtl, filename_obj;
-            filename_mtl = filename_obj = this->panorama->mapFilename + "_tile_" + QString::number(this->currentTile) + ".obj";
-            filename_mtl.replace("obj", "mtl");
+        qDebug() << "Meshing" << this->tileColumns << "x" << this->tileRows << "tiles with" << this->threadCount << "threads";
 
-            QFile file( QDir::currentPath() + "/" + filename_obj);
+        //Unprojected once, meshing again with other thresholds reuses it
+        this->panorama->prepareVertexGrid(this->threadCount);
 
-            if(!file.open(QIODevice::WriteOnly | QIODevice::Text))
-            {
-                qDebug() << "Cannot open file for writing: " << filename_obj;
-                return;
-            }
+        //Measured quads are kept in the panorama, every tile fills its own pixels
+        this->panorama->prepareQuadMetrics();
 
-            /*
-             OBJ-FIle Format:
+        //The tiles only read the panorama, every one writes its own .obj/.mtl
+        QThreadPool tilePool;
+        tilePool.setMaxThreadCount(this->threadCount);
+        for(int tile = 0; tile < this->maxTiles; tile++)
+            tilePool.start(new MeshTile(this, tile));
+        tilePool.waitForDone();
 
-            o panorama_mesh
-            mtllib filename_mtl.mtl
-            usemtl panorama
+        if(!this->cancelThread)
+            this->panorama->quadMetricsValid = true;
 
-            v 0.000000 0.000000 2.000000
-            v 0.000000 0.000000 0.000000
-            v 2.000000 0.000000 0.000000
-            v 2.000000 0.000000 2.000000
-            vt 1.0  0.5
-            vt 0.0  1.0
-            vt 0.5  1.0
-            vt 1.0  1.0
-            f -4 -3 -2 -1
+        this->currentTile = this->maxTiles;
+        this->meshing = false;
+    }
+
+    emit meshingStatus( 100.0f );
+    qDebug() << "Mesher just finished!";
+
+    this->deleteLater();
+
+}
 
-              */
+void MeshWorker::meshTile(int tile)
+{
+    int width = this->panorama->store.width();
+    int height = this->panorama->store.height();
+
+    //Quads of the pixels inside the tile, the neighbours of the right and bottom border belong to the next tiles.
+    //Both tiles unproject the shared border pixels the same way, so the seams match exactly.
+    int tileX = tile % this->tileColumns;
+    int tileY = tile / this->tileColumns;
+    int left = (qint64)tileX * width / this->tileColumns;
+    int right = (qint64)(tileX + 1) * width / this->tileColumns;
+    int top = (qint64)tileY * height / this->tileRows;
+    int bottom = (qint64)(tileY + 1) * height / this->tileRows;
+
+    QString filename_mtl, filename_obj;
+    filename_mtl = filename_obj = this->panorama->mapFilename + "_tile_" + QString::number(tile) + ".obj";
+    filename_mtl.replace("obj", "mtl");
+
+    ObjWriter obj;
+    obj.setPrecision(this->vertexDecimals, this->textureDecimals);
+
+    if(!obj.open(QDir::currentPath() + "/" + filename_obj))
+    {
+        qDebug() << obj.errorString;
+        return;
+    }
 
+    /*
+     OBJ-FIle Format (indexed, neighbouring quads share their vertices):
+
+    o panorama_mesh
+    mtllib filename_mtl.mtl
+    usemtl panorama
+
+    v 0.000000 0.000000 2.000000
+    v 0.000000 0.000000 0.000000
+    v 2.000000 0.000000 0.000000
+    v 2.000000 0.000000 2.000000
+    vt 1.0  0.5
+    vt 0.0  1.0
+    vt 0.5  1.0
+    vt 1.0  1.0
+    f 1/1 2/2 3/3 4/4
+    v 4.000000 0.000000 0.000000
+    v 4.000000 0.000000 2.000000
+    vt 1.0  0.0
+    vt 0.0  0.0
+    f 2/2 5/5 6/6 3/3
+
+      */
+
+
+    obj.writeText("# " + QApplication::applicationName() + " v" + QApplication::applicationVersion() + " OBJ File\n");
+    obj.writeText("# http://bachelor.kalisz.co\n");
+    obj.writeText(QString("# tile %1 of %2x%3: pixels x %4-%5, y %6-%7\n").arg(tile).arg(this->tileColumns).arg(this->tileRows)
+                  .arg(left).arg(right - 1).arg(top).arg(bottom - 1));
+    obj.writeText("mtllib " + filename_mtl + "\n");
+    obj.writeText("o " + filename_obj + "\n");
+    obj.writeText("usemtl panorama\n\n");
+
+    //Grid point (gx, gy) is the top left corner of pixel (gx, gy). Every grid point gets one vertex and one
+    //texture coordinate, written on first use, the faces reference them by index. The right column and the
+    //bottom row of the panorama wrap around: same position as column/row 0, but their own texture coordinate.
+    //Only the two grid columns of the current quads are unprojected and kept.
+    bool cachedMetrics = this->panorama->quadMetricsValid;
+    bool wrapsX = (left == 0 && right == width);
+    bool wrapsY = (top == 0 && bottom == height);
+    int rows = bottom - top;
+    int vertexCount = 0;
+    int uvCount = 0;
+
+    MeshColumn current, next, first;
+    loadColumn(left, top, rows, current);
+
+    //The written vertices go to the 3D viewer once per column, not one locked call per vertex
+    PointBuffer viewerPoints(PointBuffer::COLOR);
+    QVector3D translation = this->panorama->getTranslationVector();
+
+    for(int x = left; x < right; x++)
+    {
+        if(this->cancelThread) break;
 
-            QTextStream outputStream(&file);
-            outputStream << "# " << QApplication::applicationName() << " v" << QApplication::applicationVersion() << " OBJ File\n";
-            outputStream << "# http://bachelor.kalisz.co\n";
-            outputStream << "mtllib " << filename_mtl << "\n";
-            outputStream << "o " << filename_obj << "\n";
-            outputStream << "usemtl panorama\n\n";
+        if(wrapsX && x == width - 1)
+        {
+            next = first;
+            next.uv.fill(0);
+        }
+        else
+        {
+            loadColumn(x + 1, top, rows, next);
+        }
 
-            for(int x = 0; x < width; x++)
+        for(int y = top; y < bottom; y++)
+        {
+            if(!this->panorama->store.isEmpty(x, y))
             {
-                if(this->cancelThread) break;
+                //Meshing again: the quad is only filtered with the cached metrics
+                Panorama3D::QuadMetricsTile *metrics = this->panorama->quadMetricsTile(x, y);
+                int pixel = Panorama3D::quadMetricsOffset(x, y);
+                if(cachedMetrics && !acceptQuad(Panorama3D::dequantizeCosine(metrics->cosine[pixel]), metrics->area[pixel]))
+                    continue;
+
+                //create quad clockwise: top left, top right, bottom right, bottom left
+                int slot = y - top;
+                int slotBelow = (wrapsY && y == height - 1) ? 0 : slot + 1;
+                MeshColumn *columns[4] = { &current, &next, &next, &current };
+                int slots[4] = { slot, slot, slotBelow, slotBelow };
+                int uvSlots[4] = { slot, slot, slot + 1, slot + 1 };
+                int gridX[4] = { x, x + 1, x + 1, x };
+                int gridY[4] = { y, y, y + 1, y + 1 };
+
+                Point3D v1 = current.position.at(slot);
+                Point3D v2 = next.position.at(slot);
+                Point3D v3 = next.position.at(slotBelow);
+                Point3D v4 = current.position.at(slotBelow);
+                bool filled[4] = { false, v2.isNull(), v3.isNull(), v4.isNull() };
+
+                //Avoid deformed faces due to one black pixel (v1 cannot be null):
+                if( v2.isNull() )
+                {
+                    v2.x = (v1.x + v3.x + v4.x) / 3.0f;
+                    v2.y = (v1.y + v3.y + v4.y) / 3.0f;
+                    v2.z = (v1.z + v3.z + v4.z) / 3.0f;
+                }
+                if( v3.isNull() )
+                {
+                    v3.x = (v1.x + v2.x + v4.x) / 3.0f;
+                    v3.y = (v1.y + v2.y + v4.y) / 3.0f;
+                    v3.z = (v1.z + v2.z + v4.z) / 3.0f;
+                }
+                if( v4.isNull() )
+                {
+                    v4.x = (v1.x + v2.x + v3.x) / 3.0f;
+                    v4.y = (v1.y + v2.y + v3.y) / 3.0f;
+                    v4.z = (v1.z + v2.z + v3.z) / 3.0f;
+                }
+
+                if(!cachedMetrics)
+                {
+                    //The view ray of the panorama center
+                    QVector3D myV1(-v1.x, -v1.y, -v1.z);
+
+                    float cosine, area;
+                    measureQuad(v1, v2, v3, v4, myV1, cosine, area);
+                    metrics->cosine[pixel] = Panorama3D::quantizeCosine(cosine);
+                    metrics->area[pixel] = area;
 
-                for(int y = 0; y < height; y++)
+                    //Decided on the stored value, meshing again with the same threshold gives the same mesh
+                    if(!acceptQuad(Panorama3D::dequantizeCosine(metrics->cosine[pixel]), area))
+                        continue;
+                }
+
+                const Point3D *corners[4] = { &v1, &v2, &v3, &v4 };
+                int vertices[4];
+                int uvs[4];
+
+                for(int i = 0; i < 4; i++)
                 {
-                    if(this->cancelThread) break;
+                    MeshColumn *column = columns[i];
 
-                    if(! QColor(this->panorama->panoramaDepth.pixel(x,y)).value() == 0)
+                    //A filled in corner belongs to this quad only
+                    if(filled[i] || column->vertex.at(slots[i]) == 0)
                     {
-                        //create quad clockwise:
-                        int x1, x2, x3, x4;
-                        int y1, y2, y3, y4;
-
-                        //Top left:
-                        x1 = x;
-                        y1 = y;
-                        //Top right:
-                        x2 = x+1;
-                        y2 = y;
-                        //Bottom right:
-                        x3 = x+1;
-                        y3 = y+1;
-                        //Bottom left:
-                        x4 = x;
-                        y4 = y+1;
-
-                        //Check for bounds, if reached border, wrap around back (prevents polystrip gap):
-                        if(x == width - 1)
-                        {
-                            x2 = 0;
-                            x3 = 0;
-                        }
-                        if(y == height - 1)
-                        {
-                            x2 = 0;
-                            x3 = 0;
-                            y3 = 0;
-                            y4 = 0;
-                        }
-
-                        Point3D v1, v2, v3, v4;
-                        panorama->unprojectPanorama3D(x1, y1, v1);
-                        panorama->unprojectPanorama3D(x2, y2, v2);
-                        panorama->unprojectPanorama3D(x3, y3, v3);
-                        panorama->unprojectPanorama3D(x4, y4, v4);
-
-                        //Avoid deformed faces due to one black pixel (v1 cannot be null):
-                        if( v2.isNull() )
-                        {
-                            v2.x = (v1.x + v3.x + v4.x) / 3.0f;
-                            v2.y = (v1.y + v3.y + v4.y) / 3.0f;
-                            v2.z = (v1.z + v3.z + v4.z) / 3.0f;
-                        }
-                        if( v3.isNull() )
-                        {
-                            v3.x = (v1.x + v2.x + v4.x) / 3.0f;
-                            v3.y = (v1.y + v2.y + v4.y) / 3.0f;
-                            v3.z = (v1.z + v2.z + v4.z) / 3.0f;
-                        }
-                        if( v4.isNull() )
-                        {
-                            v4.x = (v1.x + v2.x + v3.x) / 3.0f;
-                            v4.y = (v1.y + v2.y + v3.y) / 3.0f;
-                            v4.z = (v1.z + v2.z + v3.z) / 3.0f;
-                        }
-
-                        //Generate normal vectors (one for each triangle):
-                        QVector3D v1v2(v2.x - v1.x, v2.y - v1.y, v2.z - v1.z);
-                        QVector3D v1v4(v4.x - v1.x, v4.y - v1.y, v4.z - v1.z);
-                        QVector3D v3v2(v2.x - v3.x, v2.y - v3.y, v2.z - v3.z);
-                        QVector3D v3v4(v4.x - v3.x, v4.y - v3.y, v4.z - v3.z);
-                        QVector3D normal1 = QVector3D::crossProduct(v1v2, v1v4);
-                        QVector3D normal2 = QVector3D::crossProduct(v3v2, v3v4);
-                        float area1 = normal1.length() / 2.0f;
-                        float area2 = normal2.length() / 2.0f;
-
-                        //Measure the angle between normal and v1:
-                        QVector3D myV1(-v1.x, -v1.y, -v1.z);
-                        normal1.normalize();
-                        normal2.normalize();
-                        myV1.normalize();
-
-                        float cosine_of_angle1 = QVector3D::dotProduct(myV1, normal1);
-                        float cosine_of_angle2 = QVector3D::dotProduct(myV1, normal2);
-
-
-                        if( qAbs( cosine_of_angle1 ) < qAbs( qCos(normalAngleThreshold) ) || qAbs( cosine_of_angle2 ) < qAbs( qCos(normalAngleThreshold) ) )
-                        {
-                            //qDebug() << "face discarded due to bad angle";
-                        }
-                        else if( area1 < 0.005f || area2 < 0.005f)
-                        {
-                            //qDebug() << "face discarded due to almost degenerate face";
-                        }
-                        else
-                        {
-                            outputStream << "v " << v1.x << " " << v1.y << " " << v1.z << "\n";
-                            glWidget->addPoint(v1, panorama->getTranslationVector());
-
-                            outputStream << "v " << v2.x << " " << v2.y << " " << v2.z << "\n";
-                            glWidget->addPoint(v2, panorama->getTranslationVector());
-
-                            outputStream << "v " << v3.x << " " << v3.y << " " << v3.z << "\n";
-                            glWidget->addPoint(v3, panorama->getTranslationVector());
-
-                            outputStream << "v " << v4.x << " " << v4.y << " " << v4.z << "\n";
-                            glWidget->addPoint(v4, panorama->getTranslationVector());
-
-                            outputStream << "vt " << x / (width * 1.0f) << " " << (height - y) / (height * 1.0f) << "\n";
-                            outputStream << "vt " << (x+1) / (width * 1.0f) << " " << (height - y) / (height * 1.0f) << "\n";
-                            outputStream << "vt " << (x+1) / (width * 1.0f) << " " << ((height - y)+1) / (height * 1.0f) << "\n";
-                            outputStream << "vt " << x / (width * 1.0f) << " " << ((height - y)+1) / (height * 1.0f) << "\n";
-
-                            //FORMAT: f vertex#/textureCoord#/normal#      *3 = Triangle, *4 = Quad
-                            outputStream << "f -4/-4/ -3/-3/ -2/-2/ -1/-1/\n";
-                        }
-
-                        float percent = (x * height + y * 1.0f) / (width*height) * 100.0f;
-
-                        emit meshingStatus( percent );
+                        const Point3D &v = *corners[i];
+                        obj.vertex(v.x, v.y, v.z);
+                        viewerPoints.append(v.x, v.y, v.z, qRgb(v.r, v.g, v.b));
 
+                        vertices[i] = ++vertexCount;
+                        if(!filled[i])
+                            column->vertex[slots[i]] = vertexCount;
+                    }
+                    else
+                    {
+                        vertices[i] = column->vertex.at(slots[i]);
                     }
+
+                    if(column->uv.at(uvSlots[i]) == 0)
+                    {
+                        obj.textureCoordinate(gridX[i] / (width * 1.0f), (height - gridY[i]) / (height * 1.0f));
+                        column->uv[uvSlots[i]] = ++uvCount;
+                    }
+                    uvs[i] = column->uv.at(uvSlots[i]);
                 }
 
+                //FORMAT: f vertex#/textureCoord#/normal#      *3 = Triangle, *4 = Quad
+                obj.face(vertices, uvs, 4);
             }
+        }
+
+        if(viewerPoints.size() > 0)
+        {
+            glWidget->addPoints(viewerPoints, 0, viewerPoints.size(), translation);
+            viewerPoints.clear();
+        }
+
+        //Progress of all tiles together
+        int cells = this->cellsDone.fetchAndAddRelaxed(bottom - top) + (bottom - top);
+        float percent = cells * 100.0f / ((float)width * height);
+        emit meshingStatus( qMin(percent, 99.0f) );
+
+        //Column 0 is needed again by the last quads of the row
+        if(wrapsX && x == 0)
+            first = current;
+        qSwap(current, next);
+    }
+
+    obj.close();
+
+    writeMaterial(filename_mtl, this->panorama->mapFilename + "_colormap.jpg");
+}
+
+void MeshWorker::loadColumn(int gridX, int top, int rows, MeshColumn &column)
+{
+    int width = this->panorama->store.width();
+    int height = this->panorama->store.height();
+
+    column.position.resize(rows + 1);
+    column.vertex.fill(0, rows + 1);
+    column.uv.fill(0, rows + 1);
+
+    for(int i = 0; i <= rows; i++)
+        this->panorama->vertexAt(gridX % width, (top + i) % height, column.position[i]);
+}
+
+void MeshWorker::setTiles(int columns, int rows)
+{
+    //0: automatic
+    this->tileColumns = qMax(columns, 0);
+    this->tileRows = qMax(rows, 0);
+}
+
+void MeshWorker::setPrecision(int vertexDecimals, int textureDecimals)
+{
+    this->vertexDecimals = vertexDecimals;
+    this->textureDecimals = textureDecimals;
+}
+
+void MeshWorker::setThreadCount(int threads)
+{
+    this->threadCount = qMax(threads, 1);
+}
+
+void MeshWorker::setStructuredScans(const QList<StructuredScan*> &scans)
+{
+    this->structuredScans = scans;
+}
+
+void MeshWorker::meshScan(StructuredScan *scan, int index)
+{
+    QString name = this->panorama->mapFilename + "_scan_" + QString::number(index);
+    QString filename_obj = name + ".obj";
+    QString filename_mtl = name + ".mtl";
+    QString filename_colormap = name + "_colormap.jpg";
+
+    scan->saveColorMap(QDir::currentPath() + "/" + filename_colormap);
+
+    ObjWriter obj;
+    obj.setPrecision(this->vertexDecimals, this->textureDecimals);
+
+    if(!obj.open(QDir::currentPath() + "/" + filename_obj))
+    {
+        qDebug() << obj.errorString;
+        return;
+    }
+
+    obj.writeText("# " + QApplication::applicationName() + " v" + QApplication::applicationVersion() + " OBJ File\n");
+    obj.writeText("# http://bachelor.kalisz.co\n");
+    obj.writeText("mtllib " + filename_mtl + "\n");
+    obj.writeText("o " + filename_obj + "\n");
+    obj.writeText("usemtl panorama\n\n");
+
+    int columns = scan->columns;
+    int rows = scan->rows;
+
+    //The vertices go to the 3D viewer once per column
+    PointBuffer viewerPoints(PointBuffer::COLOR);
 
+    //Like the panorama tiles: every cell gets one vertex and one texture coordinate, written on first use,
+    //the faces reference them by index. Only the indices of the two cell columns of the current quads are kept.
+    int vertexCount = 0;
+    int uvCount = 0;
+    MeshColumn current, next;
+    current.vertex.fill(0, rows);
+    current.uv.fill(0, rows);
 
-            file.close();
+    //The cells are the vertices already (registered positions), a quad connects four neighbouring cells
+    for(int x = 0; x < columns - 1 && !this->cancelThread; x++)
+    {
+        next.vertex.fill(0, rows);
+        next.uv.fill(0, rows);
 
-            /*
-             MTL-Example
+        for(int y = 0; y < rows - 1; y++)
+        {
+            //v1 (x, y), v2 (x+1, y), v3 (x+1, y+1), v4 (x, y+1)
+            int cells[4] = { scan->index(x, y), scan->index(x + 1, y), scan->index(x + 1, y + 1), scan->index(x, y + 1) };
+            Point3D v[4];
+            int missing = -1, missingCount = 0;
 
-            newmtl panorama
-            Ns 10.0000
-            Ni 1.5000
-            d 1.0000
-            Tr 0.0000
-            Tf 1.0000 1.0000 1.0000
-            illum 2
-            Ka 0.0000 0.0000 0.0000
-            Kd 0.5880 0.5880 0.5880
-            Ks 0.0000 0.0000 0.0000
-            Ke 0.0000 0.0000 0.0000
-            map_Ka colormap.jpg
-            map_Kd colormap.jpg
+            for(int i = 0; i < 4; i++)
+            {
+                if(scan->valid.at(cells[i]))
+                {
+                    v[i].x = scan->x.at(cells[i]);
+                    v[i].y = scan->y.at(cells[i]);
+                    v[i].z = scan->z.at(cells[i]);
+                    v[i].r = qRed(scan->rgba.at(cells[i]));
+                    v[i].g = qGreen(scan->rgba.at(cells[i]));
+                    v[i].b = qBlue(scan->rgba.at(cells[i]));
+                }
+                else
+                {
+                    missing = i;
+                    missingCount++;
+                }
+            }
 
+            //Like the panorama mesh: one missing corner is filled in, more leave a hole
+            if(missingCount > 1 || missing == 0)
+                continue;
+            if(missingCount == 1)
+            {
+                int a = (missing + 1) % 4, b = (missing + 2) % 4, c = (missing + 3) % 4;
+                v[missing].x = (v[a].x + v[b].x + v[c].x) / 3.0f;
+                v[missing].y = (v[a].y + v[b].y + v[c].y) / 3.0f;
+                v[missing].z = (v[a].z + v[b].z + v[c].z) / 3.0f;
+                v[missing].r = v[a].r;
+                v[missing].g = v[a].g;
+                v[missing].b = v[a].b;
+            }
 
-              */
+            QVector3D viewRay = scan->scannerPosition - QVector3D(v[0].x, v[0].y, v[0].z);
+            if(!isGoodQuad(v[0], v[1], v[2], v[3], viewRay))
+                continue;
 
-            QFile file2( QDir::currentPath() + "/" + filename_mtl);
+            MeshColumn *cellColumns[4] = { &current, &next, &next, &current };
+            int slots[4] = { y, y, y + 1, y + 1 };
+            int cellX[4] = { x, x + 1, x + 1, x };
+            int vertices[4];
+            int uvs[4];
 
-            if(!file2.open(QIODevice::WriteOnly | QIODevice::Text))
+            for(int i = 0; i < 4; i++)
             {
-                qDebug() << "Cannot open file for writing: " << filename_mtl;
-                return;
+                MeshColumn *column = cellColumns[i];
+
+                //A filled in corner belongs to this quad only
+                if(i == missing || column->vertex.at(slots[i]) == 0)
+                {
+                    obj.vertex(v[i].x, v[i].y, v[i].z);
+                    viewerPoints.append(v[i].x, v[i].y, v[i].z, qRgb(v[i].r, v[i].g, v[i].b));
+
+                    vertices[i] = ++vertexCount;
+                    if(i != missing)
+                        column->vertex[slots[i]] = vertexCount;
+                }
+                else
+                {
+                    vertices[i] = column->vertex.at(slots[i]);
+                }
+
+                //Texture: pixel centers of the scan color map, row 0 at the bottom
+                if(column->uv.at(slots[i]) == 0)
+                {
+                    obj.textureCoordinate((cellX[i] + 0.5f) / columns, (slots[i] + 0.5f) / rows);
+                    column->uv[slots[i]] = ++uvCount;
+                }
+                uvs[i] = column->uv.at(slots[i]);
             }
 
-            QTextStream outputStream2(&file2);
-            outputStream2 << "newmtl panorama\n"
-                          << "Ns 10.0000\n"
-                          << "Ni 1.5000\n"
-                          << "d 1.0000\n"
-                          << "Tr 0.0000\n"
-                          << "Tf 1.0000 1.0000 1.0000\n"
-                          << "illum 0\n"
-                          << "Ka 0.0000 0.0000 0.0000\n"
-                          << "Kd 0.5880 0.5880 0.5880\n"
-                          << "Ks 0.0000 0.0000 0.0000\n"
-                          << "Ke 0.0000 0.0000 0.0000\n"
-                          << "map_Kd " << this->panorama->mapFilename << "_colormap.jpg\n";
-            file2.close();
+            obj.face(vertices, uvs, 4);
         }
-        this->meshing = false;
+
+        if(viewerPoints.size() > 0)
+        {
+            glWidget->addPoints(viewerPoints, 0, viewerPoints.size(), QVector3D(0, 0, 0));
+            viewerPoints.clear();
+        }
+
+        //Progress of all scans together, in quad columns
+        int done = this->cellsDone.fetchAndAddRelaxed(1) + 1;
+        float percent = done * 100.0f / qMax(this->scanColumns, 1);
+        emit meshingStatus( qMin(percent, 99.0f) );
+
+        qSwap(current, next);
     }
 
-    emit meshingStatus( 100.0f );
-    qDebug() << "Mesher just finished!";
+    obj.close();
 
-    this->deleteLater();
+    writeMaterial(filename_mtl, filename_colormap);
+}
+
+bool MeshWorker::isGoodQuad(const Point3D &v1, const Point3D &v2, const Point3D &v3, const Point3D &v4, const QVector3D &viewRay)
+{
+    float cosine, area;
+    measureQuad(v1, v2, v3, v4, viewRay, cosine, area);
+    return acceptQuad(cosine, area);
+}
+
+void MeshWorker::measureQuad(const Point3D &v1, const Point3D &v2, const Point3D &v3, const Point3D &v4, const QVector3D &viewRay, float &cosine, float &area)
+{
+    //Generate normal vectors (one for each triangle):
+    QVector3D v1v2(v2.x - v1.x, v2.y - v1.y, v2.z - v1.z);
+    QVector3D v1v4(v4.x - v1.x, v4.y - v1.y, v4.z - v1.z);
+    QVector3D v3v2(v2.x - v3.x, v2.y - v3.y, v2.z - v3.z);
+    QVector3D v3v4(v4.x - v3.x, v4.y - v3.y, v4.z - v3.z);
+    QVector3D normal1 = QVector3D::crossProduct(v1v2, v1v4);
+    QVector3D normal2 = QVector3D::crossProduct(v3v2, v3v4);
+    float area1 = normal1.length() / 2.0f;
+    float area2 = normal2.length() / 2.0f;
+
+    //Measure the angle between normal and the view ray:
+    QVector3D ray = viewRay.normalized();
+    normal1.normalize();
+    normal2.normalize();
+
+    float cosine_of_angle1 = QVector3D::dotProduct(ray, normal1);
+    float cosine_of_angle2 = QVector3D::dotProduct(ray, normal2);
+
+    //Both triangles have to pass, the worse one decides
+    cosine = qMin(qAbs(cosine_of_angle1), qAbs(cosine_of_angle2));
+    area = qMin(area1, area2);
+}
+
+bool MeshWorker::acceptQuad(float cosine, float area)
+{
+    if( cosine < this->minimumCosine )
+    {
+        //qDebug() << "face discarded due to bad angle";
+        return false;
+    }
+    else if( area < this->minimumArea )
+    {
+        //qDebug() << "face discarded due to almost degenerate face";
+        return false;
+    }
+
+    return true;
+}
+
+void MeshWorker::writeMaterial(QString fileName, QString colorMapName)
+{
+    /*
+     MTL-Example
 
+    newmtl panorama
+    Ns 10.0000
+    Ni 1.5000
+    d 1.0000
+    Tr 0.0000
+    Tf 1.0000 1.0000 1.0000
+    illum 2
+    Ka 0.0000 0.0000 0.0000
+    Kd 0.5880 0.5880 0.5880
+    Ks 0.0000 0.0000 0.0000
+    Ke 0.0000 0.0000 0.0000
+    map_Ka colormap.jpg
+    map_Kd colormap.jpg
+
+
+      */
+
+    QFile file( QDir::currentPath() + "/" + fileName);
+
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Text))
+    {
+        qDebug() << "Cannot open file for writing: " << fileName;
+        return;
+    }
+
+    QTextStream outputStream(&file);
+    outputStream << "newmtl panorama\n"
+                 << "Ns 10.0000\n"
+                 << "Ni 1.5000\n"
+                 << "d 1.0000\n"
+                 << "Tr 0.0000\n"
+                 << "Tf 1.0000 1.0000 1.0000\n"
+                 << "illum 0\n"
+                 << "Ka 0.0000 0.0000 0.0000\n"
+                 << "Kd 0.5880 0.5880 0.5880\n"
+                 << "Ks 0.0000 0.0000 0.0000\n"
+                 << "Ke 0.0000 0.0000 0.0000\n"
+                 << "map_Kd " << colorMapName << "\n";
+    file.close();
 }
 
 void MeshWorker::stopThread()
@@ -285,3 +619,25 @@ void MeshWorker::stopThread()
     this->cancelThread = true;
 }
 
+MeshTile::MeshTile(MeshWorker *mesher, int tile)
+{
+    this->mesher = mesher;
+    this->tile = tile;
+}
+
+void MeshTile::run()
+{
+    this->mesher->meshTile(this->tile);
+}
+
+MeshScan::MeshScan(MeshWorker *mesher, StructuredScan *scan, int index)
+{
+    this->mesher = mesher;
+    this->scan = scan;
+    this->index = index;
+}
+
+void MeshScan::run()
+{
+    this->mesher->meshScan(this->scan, this->index);
+}
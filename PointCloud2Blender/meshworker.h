@@ -26,8 +26,13 @@
 #include <QImage>
 #include <QColor>
 #include <QDateTime>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QVector>
 
 #include "panorama3d.h"
+#include "structuredscan.h"
+#include "objwriter.h"
 
 
 class MeshWorker : public QObject, public QRunnable
@@ -39,6 +44,31 @@ public:
 
     void run();
 
+    //The panorama is split into tileColumns x tileRows tiles (default 1 x 1), meshed concurrently into one .obj each
+    void setTiles(int columns, int rows);
+    void setThreadCount(int threads);
+    //Decimals of the vertex positions and texture coordinates in the .obj files
+    void setPrecision(int vertexDecimals, int textureDecimals);
+    void meshTile(int tile);
+
+    //One grid column of a tile: unprojected pixels and the indices of the written vertices/texture coordinates (0: not written yet)
+    struct MeshColumn
+    {
+        QVector<Point3D> position;
+        QVector<int> vertex;
+        QVector<int> uv;
+    };
+    void loadColumn(int gridX, int top, int rows, MeshColumn &column);
+
+    //Structured scans (.ptx) are meshed from their range images instead of the panorama, one .obj each
+    void setStructuredScans(const QList<StructuredScan*> &scans);
+    void meshScan(StructuredScan *scan, int index);
+    bool isGoodQuad(const Point3D &v1, const Point3D &v2, const Point3D &v3, const Point3D &v4, const QVector3D &viewRay);
+    //Split into the expensive measurement (cached per pixel) and the cheap threshold test
+    void measureQuad(const Point3D &v1, const Point3D &v2, const Point3D &v3, const Point3D &v4, const QVector3D &viewRay, float &cosine, float &area);
+    bool acceptQuad(float cosine, float area);
+    void writeMaterial(QString fileName, QString colorMapName);
+
     Panorama3D *panorama;
     GLWidget *glWidget;
 
@@ -46,8 +76,23 @@ public:
 
     int maxTiles;
     int currentTile;
+    int tileColumns;
+    int tileRows;
+    int threadCount;
+    //Progress: pixels of the panorama tiles, or quad columns of the structured scans
+    QAtomicInt cellsDone;
+    int scanColumns;
+    int vertexDecimals;
+    int textureDecimals;
+
+    //Automatic tiling: tiles of about TileSize x TileSize pixels
+    static const int TileSize = 1024;
 
     float normalAngleThreshold;
+    float minimumArea;
+    float minimumCosine;
+
+    QList<StructuredScan*> structuredScans;
 
     bool cancelThread;
 
@@ -57,4 +102,33 @@ signals:
     void meshingStatus(float percent);
 };
 
+/*
+ * One tile of the panorama, meshed on its own thread.
+ */
+class MeshTile : public QRunnable
+{
+public:
+    MeshTile(MeshWorker *mesher, int tile);
+
+    void run();
+
+    MeshWorker *mesher;
+    int tile;
+};
+
+/*
+ * One structured scan, meshed on its own thread.
+ */
+class MeshScan : public QRunnable
+{
+public:
+    MeshScan(MeshWorker *mesher, StructuredScan *scan, int index);
+
+    void run();
+
+    MeshWorker *mesher;
+    StructuredScan *scan;
+    int index;
+};
+
 #endif // MESHWORKER_H
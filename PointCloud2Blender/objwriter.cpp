@@ -0,0 +1,242 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "objwriter.h"
+
+#include <cstdio>
+
+const int ObjWriter::BufferSize;
+const int ObjWriter::BufferCount;
+const int ObjWriter::MaxLineLength;
+const int ObjWriter::MaxCorners;
+const int ObjWriter::DefaultVertexDecimals;
+const int ObjWriter::DefaultTextureDecimals;
+const int ObjWriter::MaxDecimals;
+
+ObjWriterThread::ObjWriterThread(ObjWriter *writer)
+{
+    this->writer = writer;
+}
+
+void ObjWriterThread::run()
+{
+    this->writer->writeBuffers();
+}
+
+ObjWriter::ObjWriter()
+{
+    thread = NULL;
+    head = 0;
+    writeFailed = false;
+    bufferBegin = NULL;
+    bufferLimit = NULL;
+    cursor = NULL;
+    totalBytes = 0;
+    vertexDecimals = DefaultVertexDecimals;
+    textureDecimals = DefaultTextureDecimals;
+}
+
+ObjWriter::~ObjWriter()
+{
+    if(thread != NULL)
+        close();
+}
+
+void ObjWriter::setPrecision(int vertexDecimals, int textureDecimals)
+{
+    this->vertexDecimals = qBound(0, vertexDecimals, (int)MaxDecimals);
+    this->textureDecimals = qBound(0, textureDecimals, (int)MaxDecimals);
+}
+
+bool ObjWriter::open(QString fileName)
+{
+    file.setFileName(fileName);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        errorString = "Cannot open file for writing: " + fileName;
+        return false;
+    }
+
+    for(int i = 0; i < BufferCount; i++)
+    {
+        buffers[i].resize(BufferSize);
+        sizes[i] = 0;
+    }
+
+    //The formatting owns the first buffer, the others are free
+    freeBuffers.acquire(freeBuffers.available());
+    filledBuffers.acquire(filledBuffers.available());
+    freeBuffers.release(BufferCount - 1);
+
+    head = 0;
+    writeFailed = false;
+    totalBytes = 0;
+    bufferBegin = buffers[head].data();
+    bufferLimit = bufferBegin + BufferSize - MaxLineLength;
+    cursor = bufferBegin;
+
+    thread = new ObjWriterThread(this);
+    thread->start();
+
+    return true;
+}
+
+void ObjWriter::flush()
+{
+    sizes[head] = cursor - bufferBegin;
+    totalBytes += sizes[head];
+    filledBuffers.release();
+
+    //Waits only if all other buffers are still queued for the disk
+    head = (head + 1) % BufferCount;
+    freeBuffers.acquire();
+
+    bufferBegin = buffers[head].data();
+    bufferLimit = bufferBegin + BufferSize - MaxLineLength;
+    cursor = bufferBegin;
+}
+
+void ObjWriter::writeBuffers()
+{
+    int tail = 0;
+
+    forever
+    {
+        filledBuffers.acquire();
+        if(sizes[tail] < 0)
+            break;
+
+        //After a failed write the buffers are only recycled, close() reports the error
+        if(!writeFailed && file.write(buffers[tail].constData(), sizes[tail]) != sizes[tail])
+            writeFailed = true;
+
+        tail = (tail + 1) % BufferCount;
+        freeBuffers.release();
+    }
+}
+
+bool ObjWriter::close()
+{
+    if(thread == NULL)
+        return false;
+
+    if(cursor > bufferBegin)
+        flush();
+
+    //End marker
+    sizes[head] = -1;
+    filledBuffers.release();
+
+    thread->wait();
+    delete thread;
+    thread = NULL;
+
+    file.close();
+
+    if(writeFailed)
+    {
+        errorString = "Cannot write file: " + file.fileName();
+        qDebug() << errorString;
+        return false;
+    }
+
+    return true;
+}
+
+void ObjWriter::writeText(const QString &text)
+{
+    QByteArray bytes = text.toUtf8();
+    const char *data = bytes.constData();
+    int remaining = bytes.size();
+
+    while(remaining > 0)
+    {
+        reserveLine();
+        int length = qMin(remaining, MaxLineLength);
+        memcpy(cursor, data, length);
+        cursor += length;
+        data += length;
+        remaining -= length;
+    }
+}
+
+char *ObjWriter::formatInteger(char *out, qint64 value)
+{
+    quint64 magnitude = value < 0 ? 0 - (quint64)value : (quint64)value;
+    if(value < 0)
+        *out++ = '-';
+
+    char digits[20];
+    int count = 0;
+    do
+    {
+        digits[count++] = '0' + (char)(magnitude % 10);
+        magnitude /= 10;
+    }
+    while(magnitude != 0);
+
+    while(count > 0)
+        *out++ = digits[--count];
+
+    return out;
+}
+
+char *ObjWriter::formatFixed(char *out, float value, int decimals)
+{
+    static const quint64 powers[MaxDecimals + 1] =
+    {
+        1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL
+    };
+
+    //Rounded to an integer of 10^-decimals units, exact for every float in the range of the meshes
+    double scaled = value * (double)powers[decimals];
+    if(!(qAbs(scaled) < 9.0e18))
+    {
+        //NaN, infinite or beyond 64 bit: rare, not worth a fast path
+        return out + qsnprintf(out, 32, "%g", value);
+    }
+
+    qint64 fixed = qRound64(scaled);
+    if(fixed < 0)
+    {
+        *out++ = '-';
+        fixed = -fixed;
+    }
+
+    quint64 integerPart = (quint64)fixed / powers[decimals];
+    quint64 fractionPart = (quint64)fixed % powers[decimals];
+
+    out = formatInteger(out, integerPart);
+
+    if(fractionPart != 0)
+    {
+        //Zero padded to the precision, then the trailing zeros are removed
+        *out++ = '.';
+        for(int i = decimals - 1; i >= 0; i--)
+        {
+            out[i] = '0' + (char)(fractionPart % 10);
+            fractionPart /= 10;
+        }
+        out += decimals;
+        while(out[-1] == '0')
+            out--;
+    }
+
+    return out;
+}
@@ -0,0 +1,156 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef OBJWRITER_H
+#define OBJWRITER_H
+
+#include <QDebug>
+#include <QFile>
+#include <QString>
+#include <QByteArray>
+#include <QThread>
+#include <QSemaphore>
+
+class ObjWriter;
+
+/*
+ * Writes the filled buffers of an ObjWriter to disk, while the next buffer is being formatted.
+ */
+class ObjWriterThread : public QThread
+{
+public:
+    explicit ObjWriterThread(ObjWriter *writer);
+
+    void run();
+
+    ObjWriter *writer;
+};
+
+/*
+ * Buffered writer for Wavefront .obj files.
+ *
+ * Lines are formatted straight into large buffers with a fixed precision float formatter
+ * (no locale, no stream state, trailing zeros removed) instead of one QTextStream call per token.
+ * Full buffers are handed to a background thread through a small ring, so formatting and
+ * disk writes overlap; the formatting only waits when the disk is slower.
+ */
+class ObjWriter
+{
+public:
+    ObjWriter();
+    ~ObjWriter();
+
+    bool open(QString fileName);
+    bool close();
+
+    //Decimals after the point of vertex positions (meters) and texture coordinates
+    void setPrecision(int vertexDecimals, int textureDecimals);
+
+    void writeText(const QString &text);
+
+    inline void vertex(float x, float y, float z)
+    {
+        reserveLine();
+        *cursor++ = 'v';
+        *cursor++ = ' ';
+        cursor = formatFixed(cursor, x, vertexDecimals);
+        *cursor++ = ' ';
+        cursor = formatFixed(cursor, y, vertexDecimals);
+        *cursor++ = ' ';
+        cursor = formatFixed(cursor, z, vertexDecimals);
+        *cursor++ = '\n';
+    }
+
+    inline void textureCoordinate(float u, float v)
+    {
+        reserveLine();
+        *cursor++ = 'v';
+        *cursor++ = 't';
+        *cursor++ = ' ';
+        cursor = formatFixed(cursor, u, textureDecimals);
+        *cursor++ = ' ';
+        cursor = formatFixed(cursor, v, textureDecimals);
+        *cursor++ = '\n';
+    }
+
+    //"f v/vt v/vt ...", relative (negative) indices are allowed
+    inline void face(const int *vertices, const int *textureCoordinates, int corners)
+    {
+        reserveLine();
+        *cursor++ = 'f';
+        for(int i = 0; i < corners; i++)
+        {
+            *cursor++ = ' ';
+            cursor = formatInteger(cursor, vertices[i]);
+            *cursor++ = '/';
+            cursor = formatInteger(cursor, textureCoordinates[i]);
+        }
+        *cursor++ = '\n';
+    }
+
+    qint64 bytesWritten() const { return totalBytes + (cursor - bufferBegin); }
+
+    static char *formatFixed(char *out, float value, int decimals);
+    static char *formatInteger(char *out, qint64 value);
+
+    QString errorString;
+
+    static const int BufferSize = 1024 * 1024;
+    static const int BufferCount = 4;
+    //Longest line of vertex(), textureCoordinate() or face() with up to MaxCorners corners
+    static const int MaxLineLength = 512;
+    static const int MaxCorners = 8;
+    static const int DefaultVertexDecimals = 4;
+    static const int DefaultTextureDecimals = 6;
+    static const int MaxDecimals = 9;
+
+private:
+    friend class ObjWriterThread;
+
+    inline void reserveLine()
+    {
+        if(cursor > bufferLimit)
+            flush();
+    }
+
+    void flush();
+    void writeBuffers();
+
+    QFile file;
+    ObjWriterThread *thread;
+
+    //Ring of buffers: free ones for the formatting, filled ones for the I/O thread.
+    //A negative size marks the end of the file.
+    QByteArray buffers[BufferCount];
+    int sizes[BufferCount];
+    QSemaphore freeBuffers;
+    QSemaphore filledBuffers;
+    int head;
+    bool writeFailed;
+
+    char *bufferBegin;
+    char *bufferLimit;
+    char *cursor;
+    qint64 totalBytes;
+
+    int vertexDecimals;
+    int textureDecimals;
+};
+
+#endif // OBJWRITER_H
@@ -17,6 +17,10 @@
 */
 
 #include "panorama3d.h"
+#include "xybformat.h"
+
+#include <limits>
+
 
 Panorama3D::Panorama3D(QVector3D translationVector, Orientation upVector, const int mapWidth, const int mapHeight, float maxDistance, ProjectionType projectionType, QObject *parent) :
     QObject(parent)
@@ -29,41 +33,82 @@ Panorama3D::Panorama3D(QVector3D translationVector, Orientation upVector, const
     this->maxDistance = maxDistance;
     this->projectionType = projectionType;
 
-    panoramaDepth = QImage(mapWidth, mapHeight, QImage::Format_ARGB32);
-    panoramaColor = QImage(mapWidth, mapHeight, QImage::Format_ARGB32);
+    store.resize(mapWidth, mapHeight);
+
+    scanGrid = false;
+    gridExact = false;
+    scanOrderColumnLength = 0;
+    scanOrderPhase = 0;
+    scanOrderShift = 0;
+    scanOrderAngles = NULL;
 
     minRadius = 500;
     maxRadius = 0;
-    minY = 180;
+    minY = mapHeight;
     maxY = 0;
-    minX = 360;
+    minX = mapWidth;
     maxX = 0;
+
+    selectProjection();
+    updateKernelParameters();
+    buildUnprojectionTables();
+
+    vertexGridValid = false;
+    quadMetricsValid = false;
+    qDebug() << "Projection kernel:" << ProjectionKernel::kernelName();
+}
+
+Panorama3D::~Panorama3D()
+{
+    qDeleteAll(this->vertexTiles);
+    qDeleteAll(this->quadMetrics);
 }
 
 void Panorama3D::finished()
 {
     qDebug() << "Saving panoramas into " << QDir::currentPath();
 
-    panoramaDepth.save(QDir::currentPath() + "/" + this->mapFilename + "_depthmap.jpg");
-    panoramaColor.save(QDir::currentPath() + "/" + this->mapFilename + "_colormap.jpg");
-
     //Update the images in the user interface
     refreshTextureMapsGUI();
 
-    qDebug() << "minRadius="<<minRadius<<"maxRadius="<<maxRadius<<"minX="<<minX<<"maxX="<<maxX<<"minY="<<minY<<"maxY="<<maxY;
+    //Saved from the store at full resolution, the previews may be reduced
+    store.saveTextureMaps(QDir::currentPath() + "/" + this->mapFilename, maxDistance);
+
+    //The store is complete now, the vertex grid gets built again on the next use
+    this->vertexGridMutex.lock();
+    this->vertexGridValid = false;
+    this->quadMetricsValid = false;
+    this->vertexGridMutex.unlock();
+
+    //The extents are tracked in pixels, reported in degrees
+    float degreesX = 360.0f / mapWidth;
+    float degreesY = 180.0f / mapHeight;
+    qDebug() << "minRadius="<<minRadius<<"maxRadius="<<maxRadius<<"minX="<<minX*degreesX<<"maxX="<<maxX*degreesX<<"minY="<<minY*degreesY<<"maxY="<<maxY*degreesY;
 }
 
 bool Panorama3D::convertToSpherical(Point3D &point, float &theta, float &phi, float &radius)
 {
-    //Calculate spherical coordinates
+    bool valid = convertToSpherical(point.x, point.y, point.z, theta, phi, radius);
+
+    //The point is moved into the panorama origin
     point.x += translationVector.x();
     point.y += translationVector.y();
     point.z += translationVector.z();
 
+    return valid;
+}
+
+bool Panorama3D::convertToSpherical(float x, float y, float z, float &theta, float &phi, float &radius)
+{
+    //Calculate spherical coordinates
+    x += translationVector.x();
+    y += translationVector.y();
+    z += translationVector.z();
+
     //Distance
-    radius = qSqrt( point.x*point.x + point.y*point.y + point.z*point.z );
+    radius = qSqrt( x*x + y*y + z*z );
 
-    if(!radius > 0.0f || point.x == 0.0f)
+    if(!radius > 0.0f || x == 0.0f)
         return false;
 
     //Note: There are different definitions about phi and theta (mathematical/physical). To match it with the projections, we will use the following:
@@ -73,23 +118,23 @@ bool Panorama3D::convertToSpherical(Point3D &point, float &theta, float &phi, fl
     case RIGHT_UP_Z:
     case LEFT_UP_Z:
         //Inclination (phi)
-        phi = qAcos( point.z / radius ); //Range: 0*PI <= phi <= 1*PI
+        phi = qAcos( z / radius ); //Range: 0*PI <= phi <= 1*PI
         //Azimuth (theta)
-        theta = qAtan2(point.y, point.x); //Atan2 Range is -1*PI <= theta <= 1*PI (Note: Atan Range is (-PI/2, PI/2) !!!)
+        theta = qAtan2(y, x); //Atan2 Range is -1*PI <= theta <= 1*PI (Note: Atan Range is (-PI/2, PI/2) !!!)
         break;
     case RIGHT_UP_Y:
     case LEFT_UP_Y:
         //Inclination (phi)
-        phi = qAcos( point.y / radius ); //Range: 0*PI <= phi <= 1*PI
+        phi = qAcos( y / radius ); //Range: 0*PI <= phi <= 1*PI
         //Azimuth (theta)
-        theta = qAtan2(-point.z, point.x); //Atan2 Range is -1*PI <= theta <= 1*PI (Note: Atan Range is (-PI/2, PI/2) !!!)
+        theta = qAtan2(-z, x); //Atan2 Range is -1*PI <= theta <= 1*PI (Note: Atan Range is (-PI/2, PI/2) !!!)
         break;
     case RIGHT_UP_X:
     case LEFT_UP_X:
         //Inclination (phi)
-        phi = qAcos( point.x / radius ); //Range: 0*PI <= phi <= 1*PI
+        phi = qAcos( x / radius ); //Range: 0*PI <= phi <= 1*PI
         //Azimuth (theta)
-        theta = qAtan2(point.y, -point.z); //Atan2 Range is -1*PI <= theta <= 1*PI (Note: Atan Range is (-PI/2, PI/2) !!!)
+        theta = qAtan2(y, -z); //Atan2 Range is -1*PI <= theta <= 1*PI (Note: Atan Range is (-PI/2, PI/2) !!!)
         break;
     }
 
@@ -120,22 +165,154 @@ void Panorama3D::project(float theta, float phi, float &x, float &y)
 
 void Panorama3D::unprojectPanorama3D(int x, int y, Point3D &projectedPoint)
 {
-    QColor depthValue = QColor( this->panoramaDepth.pixel(x,y) );
-    QColor colorValue = QColor( this->panoramaColor.pixel(x,y) );
-    int z_depth = depthValue.value();
+    //Depth in meters
+    float z_depth = this->store.depthAt(x, y);
+    QRgb colorValue = this->store.colorAt(x, y);
+
+    //The mesh is always built with Z up
+    projectedPoint.x = z_depth * this->verticalSin.at(y) * this->horizontalCos.at(x);
+    projectedPoint.y = z_depth * this->verticalSin.at(y) * this->horizontalSin.at(x);
+    projectedPoint.z = z_depth * this->verticalCos.at(y);
+
+    projectedPoint.r = qRed(colorValue);
+    projectedPoint.g = qGreen(colorValue);
+    projectedPoint.b = qBlue(colorValue);
+}
+
+void Panorama3D::buildUnprojectionTables()
+{
+    //sin/cos of the angles of every pixel column and row, computed once instead of per unprojected pixel
+    this->horizontalSin.resize(mapWidth);
+    this->horizontalCos.resize(mapWidth);
+    this->verticalSin.resize(mapHeight);
+    this->verticalCos.resize(mapHeight);
+
+    for(int x = 0; x < mapWidth; x++)
+    {
+        float radian_horizontal = x / this->kernelParameters.scaleX;
+        this->horizontalSin[x] = qSin(radian_horizontal);
+        this->horizontalCos[x] = qCos(radian_horizontal);
+    }
+
+    for(int y = 0; y < mapHeight; y++)
+    {
+        float projected_vertical = y / this->kernelParameters.scaleY;
+
+        //Inverse of the projection
+        float radian_vertical;
+        if(projectionType == CYLINDRICAL)
+        {
+            //projected = tan(phi) + PI
+            radian_vertical = qAtan(projected_vertical - M_PI);
+            if(radian_vertical < 0.0f)
+                radian_vertical += M_PI;
+        }
+        else if(projectionType == MERCATOR)
+        {
+            //projected = ln(tan(phi) + 1/cos(phi)), inverse: Gudermannian function
+            radian_vertical = 2.0f * qAtan(qExp(projected_vertical)) - M_PI_2;
+        }
+        else
+        {
+            radian_vertical = projected_vertical;
+        }
+
+        this->verticalSin[y] = qSin(radian_vertical);
+        this->verticalCos[y] = qCos(radian_vertical);
+    }
+}
+
+void Panorama3D::prepareVertexGrid(int threads)
+{
+    QMutexLocker locker(&this->vertexGridMutex);
+    if(this->vertexGridValid)
+        return;
+
+    QTime timer;
+    timer.start();
+
+    //Built again from the current store: tiles allocated since the last build get their vertices as well
+    qDeleteAll(this->vertexTiles);
+    this->vertexTiles.fill(NULL, store.tilesX() * store.tilesY());
+
+    //One row of tiles per task
+    QThreadPool pool;
+    pool.setMaxThreadCount(qMax(threads, 1));
+    for(int tile = 0; tile < this->vertexTiles.size(); tile += store.tilesX())
+        pool.start(new VertexGridTask(this, tile, tile + store.tilesX()));
+    pool.waitForDone();
+
+    int allocated = 0;
+    for(int tile = 0; tile < this->vertexTiles.size(); tile++)
+        if(this->vertexTiles.at(tile) != NULL)
+            allocated++;
+
+    this->vertexGridValid = true;
+    qDebug() << "Vertex grid of" << mapWidth << "x" << mapHeight << "pixels built in" << timer.elapsed() << "ms,"
+             << allocated << "of" << this->vertexTiles.size() << "tiles";
+}
+
+void Panorama3D::prepareQuadMetrics()
+{
+    QMutexLocker locker(&this->vertexGridMutex);
+    if(this->quadMetricsValid)
+        return;
 
-    float degree_horizontal = x / (mapWidth / 360.0f);
-    float degree_vertical = y / (mapHeight / 180.0f);
-    float radian_horizontal = qDegreesToRadians(degree_horizontal);
-    float radian_vertical = qDegreesToRadians(degree_vertical);
+    //Not initialized: the first meshing writes every pixel with a point before it is read
+    qDeleteAll(this->quadMetrics);
+    this->quadMetrics.fill(NULL, store.tilesX() * store.tilesY());
+    for(int tile = 0; tile < this->quadMetrics.size(); tile++)
+    {
+        if(this->store.tile(tile) != NULL)
+            this->quadMetrics[tile] = new QuadMetricsTile;
+    }
+}
 
-    projectedPoint.x = z_depth * qSin(radian_vertical) * qCos(radian_horizontal);
-    projectedPoint.y = z_depth * qSin(radian_vertical) * qSin(radian_horizontal);
-    projectedPoint.z = z_depth * qCos(radian_vertical);
+void Panorama3D::unprojectTiles(int firstTile, int lastTile)
+{
+    const int tileSize = PanoramaStore::TileSize;
 
-    projectedPoint.r = colorValue.red();
-    projectedPoint.g = colorValue.green();
-    projectedPoint.b = colorValue.blue();
+    for(int tile = firstTile; tile < lastTile; tile++)
+    {
+        //Tiles without any point stay empty
+        if(this->store.tile(tile) == NULL)
+            continue;
+
+        PointBuffer *vertices = new PointBuffer(PointBuffer::POSITION);
+        vertices->resize(tileSize * tileSize);
+        float *tileX = vertices->x.data();
+        float *tileY = vertices->y.data();
+        float *tileZ = vertices->z.data();
+
+        //The border tiles reach beyond the map, their outer pixels stay at the origin
+        int left = (tile % store.tilesX()) * tileSize;
+        int top = (tile / store.tilesX()) * tileSize;
+        int right = qMin(left + tileSize, mapWidth);
+        int bottom = qMin(top + tileSize, mapHeight);
+
+        for(int y = top; y < bottom; y++)
+        {
+            float verticalSinY = this->verticalSin.at(y);
+            float verticalCosY = this->verticalCos.at(y);
+            int offset = (y - top) * tileSize;
+
+            for(int x = left; x < right; x++, offset++)
+            {
+                float z_depth = this->store.depthAt(x, y);
+                tileX[offset] = z_depth * verticalSinY * this->horizontalCos.at(x);
+                tileY[offset] = z_depth * verticalSinY * this->horizontalSin.at(x);
+                tileZ[offset] = z_depth * verticalCosY;
+            }
+        }
+
+        //Every task fills its own entries, the vector itself is not resized
+        this->vertexTiles[tile] = vertices;
+    }
+}
+
+float Panorama3D::getMaxDistance()
+{
+    return this->maxDistance;
 }
 
 QVector3D Panorama3D::getTranslationVector()
@@ -143,82 +320,415 @@ QVector3D Panorama3D::getTranslationVector()
     return this->translationVector;
 }
 
-void Panorama3D::addPoint(Point3D point)
+void Panorama3D::setTranslationVector(QVector3D translationVector)
 {
-    float phi, theta, radius;
+    this->translationVector = translationVector;
+    updateKernelParameters();
+}
 
-    //Calculate spherical coordinates
-    if(!convertToSpherical(point, theta, phi, radius))
+void Panorama3D::addPoints(const PointBuffer &points, int first, int count, PanoramaTiles *privateTiles)
+{
+    //The channels are read directly from their arrays, no Point3D gets assembled
+    if(this->scanGrid && points.hasChannel(PointBuffer::GRID))
+    {
+        splatCells(points, first, count, points.row.constData() + first, points.column.constData() + first, privateTiles);
         return;
+    }
+
+    const QRgb *rgba = points.hasChannel(PointBuffer::COLOR) ? points.rgba.constData() + first : NULL;
 
+    splatBatch(points.x.constData() + first, points.y.constData() + first, points.z.constData() + first, rgba, count, privateTiles);
+}
+
+void Panorama3D::addPoints(const XybRecord *records, qint64 count)
+{
+    float x[ProjectionKernel::BatchSize];
+    float y[ProjectionKernel::BatchSize];
+    float z[ProjectionKernel::BatchSize];
+    QRgb rgba[ProjectionKernel::BatchSize];
 
-    //Project spherical coordinates on 2D plane and return coordinates:
-    float x, y;
-    project(theta, phi, x, y);
+    for(qint64 i = 0; i < count; i += ProjectionKernel::BatchSize)
+    {
+        int batch = qMin(count - i, (qint64)ProjectionKernel::BatchSize);
+
+        for(int j = 0; j < batch; j++)
+        {
+            const XybRecord &record = records[i + j];
+            x[j] = record.x;
+            y[j] = record.y;
+            z[j] = record.z;
+            rgba[j] = qRgb(record.r, record.g, record.b);
+        }
+
+        splatBatch(x, y, z, rgba, batch, NULL);
+    }
+}
 
-    //Convert to degrees
-    x = qRadiansToDegrees(x);
-    y = qRadiansToDegrees(y);
+void Panorama3D::addPoint(Point3D point)
+{
+    QRgb rgba = qRgb(point.r, point.g, point.b);
+    splatBatch(&point.x, &point.y, &point.z, &rgba, 1, NULL);
+}
 
-    //Bugfix: Out of Range:
-    if(x < 0.0f || x >= 360.0f) return;
-    if(y < 0.0f || y >= 180.0f) return;
+void Panorama3D::selectProjection()
+{
+    //Orientation and projection type are fixed for the whole panorama, the specialized kernels are picked once.
+    //Left and right handed scans are projected alike, only the up axis selects the kernel.
+    ProjectionKernel::UpAxis upAxis;
 
-    if(radius < minRadius)
+    switch (upVector) {
+    case LEFT_UP_X:
+    case RIGHT_UP_X:
+        upAxis = ProjectionKernel::UP_X;
+        break;
+    case LEFT_UP_Y:
+    case RIGHT_UP_Y:
+        upAxis = ProjectionKernel::UP_Y;
+        break;
+    default:
+    case LEFT_UP_Z:
+    case RIGHT_UP_Z:
+        upAxis = ProjectionKernel::UP_Z;
+        break;
+    }
+
+    this->kernelUpAxis = upAxis;
+
+    switch (projectionType) {
+    case CYLINDRICAL:
+        this->projectBatch = ProjectionKernel::batchFunction(upAxis, ProjectionKernel::CYLINDRICAL);
+        break;
+    case MERCATOR:
+        this->projectBatch = ProjectionKernel::batchFunction(upAxis, ProjectionKernel::MERCATOR);
+        break;
+    default:
+    case EQUIRECTANGULAR:
+        this->projectBatch = ProjectionKernel::batchFunction(upAxis, ProjectionKernel::EQUIRECTANGULAR);
+        break;
+    }
+}
+
+ProjectionKernel::BatchFunction Panorama3D::angleBatchFunction(ProjectionKernel::Parameters &parameters, int columns, int rows)
+{
+    //Equirectangular: the pixel coordinates are theta and phi scaled to the bins
+    parameters = this->kernelParameters;
+    parameters.scaleX = columns / (2.0f * M_PI);
+    parameters.scaleY = rows / M_PI;
+    parameters.width = columns;
+    parameters.height = rows;
+
+    return ProjectionKernel::batchFunction(this->kernelUpAxis, ProjectionKernel::EQUIRECTANGULAR);
+}
+
+void Panorama3D::updateKernelParameters()
+{
+    this->kernelParameters.translation[0] = translationVector.x();
+    this->kernelParameters.translation[1] = translationVector.y();
+    this->kernelParameters.translation[2] = translationVector.z();
+
+    //theta covers 2*PI over the width, phi PI over the height
+    this->kernelParameters.scaleX = mapWidth / (2.0f * M_PI);
+    this->kernelParameters.scaleY = mapHeight / M_PI;
+    this->kernelParameters.width = mapWidth;
+    this->kernelParameters.height = mapHeight;
+}
+
+void Panorama3D::splatBatch(const float *x, const float *y, const float *z, const QRgb *rgba, int count, PanoramaTiles *privateTiles)
+{
+    float pixelX[ProjectionKernel::BatchSize];
+    float pixelY[ProjectionKernel::BatchSize];
+    float radius[ProjectionKernel::BatchSize];
+    unsigned char valid[ProjectionKernel::BatchSize];
+
+    //Extents of this call, several threads may add points at the same time
+    float batchMinRadius = std::numeric_limits<float>::max(), batchMaxRadius = 0.0f;
+    float batchMinX = mapWidth, batchMaxX = 0.0f;
+    float batchMinY = mapHeight, batchMaxY = 0.0f;
+
+    for(int i = 0; i < count; i += ProjectionKernel::BatchSize)
     {
-        minRadius = radius;
+        int batch = qMin(count - i, ProjectionKernel::BatchSize);
+
+        //Spherical coordinates, projection and pixel position of the whole batch in one pass
+        this->projectBatch(this->kernelParameters, x + i, y + i, z + i, batch, pixelX, pixelY, radius, valid);
+
+        for(int j = 0; j < batch; j++)
+        {
+            if(!valid[j])
+                continue;
+
+            batchMinRadius = qMin(batchMinRadius, radius[j]);
+            batchMaxRadius = qMax(batchMaxRadius, radius[j]);
+            batchMinX = qMin(batchMinX, pixelX[j]);
+            batchMaxX = qMax(batchMaxX, pixelX[j]);
+            batchMinY = qMin(batchMinY, pixelY[j]);
+            batchMaxY = qMax(batchMaxY, pixelY[j]);
+
+            //Change the pixels of the panoramas respectively, the depth is kept in meters
+            QRgb color = (rgba != NULL) ? rgba[i + j] : PointBuffer::DefaultColor;
+            if(privateTiles != NULL)
+                privateTiles->plot((int)pixelX[j], (int)pixelY[j], radius[j], color);
+            else
+                this->store.plot((int)pixelX[j], (int)pixelY[j], radius[j], color);
+        }
     }
-    else if(radius > maxRadius)
+
+    QMutexLocker locker(&this->extentsMutex);
+    minRadius = qMin(minRadius, batchMinRadius);
+    maxRadius = qMax(maxRadius, batchMaxRadius);
+    minX = qMin(minX, batchMinX);
+    maxX = qMax(maxX, batchMaxX);
+    minY = qMin(minY, batchMinY);
+    maxY = qMax(maxY, batchMaxY);
+}
+
+void Panorama3D::setScanGrid(const ScanGrid &grid)
+{
+    this->scanGrid = false;
+    if(!grid.isValid())
+        return;
+
+    gridColumnPixel.resize(2 * GridLimit);
+    gridRowPixel.resize(GridLimit);
+    gridRowSide.resize(GridLimit);
+
+    //Same angles as the projection kernel: theta in [0, 2*PI), the sweep continues opposite beyond the zenith
+    for(int side = 0; side < 2; side++)
     {
-        maxRadius = radius;
+        for(int column = 0; column < GridLimit; column++)
+        {
+            double theta = fmod(grid.sweepAzimuth(column) + side * M_PI, 2.0 * M_PI);
+            if(theta < 0.0)
+                theta += 2.0 * M_PI;
+
+            gridColumnPixel[side * GridLimit + column] = qBound(0, (int)(theta * kernelParameters.scaleX), mapWidth - 1);
+        }
     }
 
-    if(x < minX)
+    for(int row = 0; row < GridLimit; row++)
     {
-        minX = x;
+        double sweep = grid.sweepAngle(row);
+        double phi = qAbs(sweep);
+        gridRowSide[row] = (sweep < 0.0) ? 1 : 0;
+        gridRowPixel[row] = -1;
+
+        if(phi > M_PI)
+            continue;
+
+        float x, y;
+        project(0.0f, phi, x, y);
+        float pixel = y * kernelParameters.scaleY;
+        if(pixel >= 0.0f && pixel < mapHeight)
+            gridRowPixel[row] = (int)pixel;
     }
-    else if(x > maxX)
+
+    this->scanOrderGrid = grid;
+    this->scanOrderAngles = angleBatchFunction(this->scanOrderParameters, ScanGrid::AngleColumns, ScanGrid::AngleRows);
+
+    this->gridExact = (projectionType == EQUIRECTANGULAR && mapWidth == grid.horizontalResolution() && mapHeight == grid.verticalResolution());
+    this->scanGrid = true;
+
+    qDebug() << "Scan grid import" << (gridExact ? "(one pixel per grid cell)" : "(depth tested)");
+}
+
+void Panorama3D::setScanOrder(int columnLength, int phase)
+{
+    this->scanOrderColumnLength = columnLength;
+    this->scanOrderPhase = phase;
+    this->scanOrderShift = 0;
+}
+
+void Panorama3D::addOrderedPoints(const PointBuffer &points, int first, int count, qint64 firstIndex)
+{
+    if(!this->scanGrid || this->scanOrderColumnLength <= 0)
     {
-        maxX = x;
+        addPoints(points, first, count);
+        return;
     }
 
-    if(y < minY)
+    qint32 rows[ProjectionKernel::BatchSize];
+    qint32 columns[ProjectionKernel::BatchSize];
+
+    for(int i = 0; i < count; i += ProjectionKernel::BatchSize)
     {
-        minY = y;
+        int batch = qMin(count - i, ProjectionKernel::BatchSize);
+
+        //Row and column of the first point by division, the rest by counting
+        qint64 sequence = firstIndex + i + this->scanOrderPhase + this->scanOrderShift;
+        qint32 row = (qint32)(sequence % this->scanOrderColumnLength);
+        qint32 column = (qint32)(sequence / this->scanOrderColumnLength);
+
+        for(int j = 0; j < batch; j++)
+        {
+            rows[j] = row;
+            columns[j] = column;
+            if(++row == this->scanOrderColumnLength)
+            {
+                row = 0;
+                column++;
+            }
+        }
+
+        if(orderedCellsMatch(points, first + i, batch, rows, columns))
+        {
+            splatCells(points, first + i, batch, rows, columns, NULL);
+            continue;
+        }
+
+        //A point is missing from the file: the cells are wrong from there on, the batch gets projected (and depth tested)
+        const QRgb *rgba = points.hasChannel(PointBuffer::COLOR) ? points.rgba.constData() + first + i : NULL;
+        splatBatch(points.x.constData() + first + i, points.y.constData() + first + i, points.z.constData() + first + i, rgba, batch, NULL);
+
+        //The cell of the last point gives the new offset between file index and grid, checked again by the next batch
+        int lastRow, lastColumn;
+        if(locateOrderedPoint(points, first + i + batch - 1, columns[batch - 1], lastRow, lastColumn))
+        {
+            qint64 cell = (qint64)lastColumn * this->scanOrderColumnLength + lastRow;
+            this->scanOrderShift = cell - (firstIndex + i + batch - 1 + this->scanOrderPhase);
+        }
     }
-    else if(y > maxY)
+}
+
+bool Panorama3D::orderedCellsMatch(const PointBuffer &points, int first, int count, const qint32 *rows, const qint32 *columns)
+{
+    //First, last and two points in between: a missing point shifts all later points by a whole cell
+    const int Samples = 4;
+    int index[Samples];
+    float x[Samples], y[Samples], z[Samples];
+    for(int s = 0; s < Samples; s++)
     {
-        maxY = y;
+        index[s] = (count - 1) * s / (Samples - 1);
+        x[s] = points.x.at(first + index[s]);
+        y[s] = points.y.at(first + index[s]);
+        z[s] = points.z.at(first + index[s]);
     }
 
-    //Change the pixels of the panoramas respectively
+    float theta[Samples], phi[Samples], radius[Samples];
+    unsigned char inside[Samples];
+    this->scanOrderAngles(this->scanOrderParameters, x, y, z, Samples, theta, phi, radius, inside);
 
-    //Depth image:
-    int depth = (radius/maxDistance)*255;
+    for(int s = 0; s < Samples; s++)
+    {
+        int row, column;
+        if(!inside[s] || !this->scanOrderGrid.locate(theta[s] * 2.0 * M_PI / ScanGrid::AngleColumns, phi[s] * M_PI / ScanGrid::AngleRows, columns[index[s]], row, column))
+            continue;
+
+        if(row != rows[index[s]] || column != columns[index[s]])
+            return false;
+    }
+
+    return true;
+}
+
+bool Panorama3D::locateOrderedPoint(const PointBuffer &points, int index, int nearColumn, int &row, int &column)
+{
+    float theta, phi, radius;
+    unsigned char inside;
+    this->scanOrderAngles(this->scanOrderParameters, points.x.constData() + index, points.y.constData() + index, points.z.constData() + index, 1, &theta, &phi, &radius, &inside);
+
+    return inside && this->scanOrderGrid.locate(theta * 2.0 * M_PI / ScanGrid::AngleColumns, phi * M_PI / ScanGrid::AngleRows, nearColumn, row, column);
+}
+
+void Panorama3D::splatCells(const PointBuffer &points, int first, int count, const qint32 *rows, const qint32 *columns, PanoramaTiles *privateTiles)
+{
+    const float tx = kernelParameters.translation[0];
+    const float ty = kernelParameters.translation[1];
+    const float tz = kernelParameters.translation[2];
+    bool color = points.hasChannel(PointBuffer::COLOR);
 
-    //Bugfix: "Depth-Modulus" -> limit depth
-    if(depth > 255) depth = 255;
+    //Points without a usable grid cell go through the projection kernel
+    PointBuffer others(color ? PointBuffer::COLOR : PointBuffer::POSITION);
 
-    QColor depthValue = QColor( qRgba( depth, depth, depth, 255 ) );
+    float batchMinRadius = std::numeric_limits<float>::max(), batchMaxRadius = 0.0f;
+    int batchMinX = mapWidth, batchMaxX = 0;
+    int batchMinY = mapHeight, batchMaxY = 0;
 
-    //Bugfix: Repeated gradients in DepthImage result in non-contigous depth:
-    //TODO: BETTER in future, save as float instead of int!
-    QColor depthMapValue = QColor( panoramaDepth.pixel(x*(mapWidth / 360.0f), y*(mapHeight / 180.0f)));
-    if( depthMapValue.value() != 0 && depthMapValue.value() < depthValue.value())
+    for(int i = first; i < first + count; i++)
     {
-        return;
+        qint32 row = rows[i - first];
+        qint32 column = columns[i - first];
+        QRgb rgba = color ? points.rgba.at(i) : PointBuffer::DefaultColor;
+
+        if(row < 0 || column < 0 || row >= GridLimit || column >= GridLimit || gridRowPixel.at(row) < 0)
+        {
+            others.append(points.x.at(i), points.y.at(i), points.z.at(i), rgba);
+            continue;
+        }
+
+        float x = points.x.at(i) + tx;
+        float y = points.y.at(i) + ty;
+        float z = points.z.at(i) + tz;
+        float radius = qSqrt(x * x + y * y + z * z);
+        if(radius <= 0.0f)
+            continue;
+
+        int pixelX = gridColumnPixel.at(gridRowSide.at(row) * GridLimit + column);
+        int pixelY = gridRowPixel.at(row);
+
+        batchMinRadius = qMin(batchMinRadius, radius);
+        batchMaxRadius = qMax(batchMaxRadius, radius);
+        batchMinX = qMin(batchMinX, pixelX);
+        batchMaxX = qMax(batchMaxX, pixelX);
+        batchMinY = qMin(batchMinY, pixelY);
+        batchMaxY = qMax(batchMaxY, pixelY);
+
+        if(privateTiles != NULL)
+            privateTiles->plot(pixelX, pixelY, radius, rgba);
+        else if(this->gridExact)
+            this->store.write(pixelX, pixelY, radius, rgba);
+        else
+            this->store.plot(pixelX, pixelY, radius, rgba);
     }
 
-    panoramaDepth.setPixel(x*(mapWidth / 360.0f), y*(mapHeight / 180.0f), depthValue.rgba());
+    {
+        QMutexLocker locker(&this->extentsMutex);
+        minRadius = qMin(minRadius, batchMinRadius);
+        maxRadius = qMax(maxRadius, batchMaxRadius);
+        minX = qMin(minX, (float)batchMinX);
+        maxX = qMax(maxX, (float)batchMaxX);
+        minY = qMin(minY, (float)batchMinY);
+        maxY = qMax(maxY, (float)batchMaxY);
+    }
+
+    if(others.size() > 0)
+        splatBatch(others.x.constData(), others.y.constData(), others.z.constData(), color ? others.rgba.constData() : NULL, others.size(), privateTiles);
+}
 
-    //Color image:
-    QColor colorValue = QColor( qRgba( point.r, point.g, point.b, 255 ));
-    panoramaColor.setPixel(x*(mapWidth / 360.0f), y*(mapHeight / 180.0f), colorValue.rgba());
+PanoramaTiles *Panorama3D::createPrivateTiles()
+{
+    return new PanoramaTiles(mapWidth, mapHeight);
+}
+
+void Panorama3D::mergePrivateTiles(const QList<PanoramaTiles*> &privateTiles, int threads)
+{
+    this->store.merge(privateTiles, threads);
 }
 
 void Panorama3D::refreshTextureMapsGUI()
 {
     qDebug() << "Refreshing Texture Maps";
-    emit updateDepthMap(&panoramaDepth);
-    emit updateColorMap(&panoramaColor);
+
+    //The images are only created for display, very large panoramas are reduced
+    int step = 1;
+    while(mapWidth / step > PreviewWidth)
+        step *= 2;
+
+    QRect area(0, 0, mapWidth, mapHeight);
+    depthPreview = store.depthImage(maxDistance, area, step);
+    colorPreview = store.colorImage(area, step);
+
+    emit updateDepthMap(&depthPreview);
+    emit updateColorMap(&colorPreview);
+}
+
+VertexGridTask::VertexGridTask(Panorama3D *panorama, int firstTile, int lastTile)
+{
+    this->panorama = panorama;
+    this->firstTile = firstTile;
+    this->lastTile = lastTile;
+}
+
+void VertexGridTask::run()
+{
+    this->panorama->unprojectTiles(this->firstTile, this->lastTile);
 }
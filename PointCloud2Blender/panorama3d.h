@@ -26,8 +26,15 @@
 #include <QDir>
 #include <QVector3D>
 #include <QColor>
+#include <QMutex>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QTime>
 
-#include "importworker.h"
+#include "pointbuffer.h"
+#include "projectionkernel.h"
+#include "panoramastore.h"
+#include "scangrid.h"
 
 class Point3D
 {
@@ -65,6 +72,10 @@ public:
     }
 };
 
+//Note: included after Point3D, the import chunks store points by value
+#include "importworker.h"
+
+struct XybRecord;
 
 class Panorama3D : public QObject
 {
@@ -89,6 +100,7 @@ public:
     };
 
     explicit Panorama3D(QVector3D translationVector, Orientation upVector, const int mapWidth, const int mapHeight, float maxDistance, ProjectionType projectionType, QObject *parent = 0);
+    ~Panorama3D();
     void finished();
 
 private:
@@ -109,15 +121,144 @@ private:
     float minY;
     float maxY;
 
+    //Specialized for the orientation and projection type, selected in the constructor
+    ProjectionKernel::Parameters kernelParameters;
+    ProjectionKernel::BatchFunction projectBatch;
+    ProjectionKernel::UpAxis kernelUpAxis;
+
+    void selectProjection();
+    void updateKernelParameters();
+
+    //Unprojection: sin/cos of every pixel column (horizontal angle) and row (vertical angle)
+    QVector<float> horizontalSin;
+    QVector<float> horizontalCos;
+    QVector<float> verticalSin;
+    QVector<float> verticalCos;
+    void buildUnprojectionTables();
+
+    //Unprojected position of every pixel, in the tiles of the store (index (y % TileSize) * TileSize + x % TileSize).
+    //Only the tiles the store allocated get a vertex tile, the others stay NULL like the store tiles.
+    QVector<PointBuffer*> vertexTiles;
+    bool vertexGridValid;
+    QMutex vertexGridMutex;
+    QMutex extentsMutex;
+
+    void splatBatch(const float *x, const float *y, const float *z, const QRgb *rgba, int count, PanoramaTiles *privateTiles);
+
+    //Scan grid: pixel of every column (per sweep side) and row, -1 outside of the panorama
+    bool scanGrid;
+    bool gridExact;
+    QVector<int> gridColumnPixel;
+    QVector<int> gridRowPixel;
+    QVector<uchar> gridRowSide;
+
+    int scanOrderColumnLength;
+    int scanOrderPhase;
+    //Points missing from the file before the current one (no return: sky, glass), found by resynchronizing
+    qint64 scanOrderShift;
+    ScanGrid scanOrderGrid;
+    ProjectionKernel::Parameters scanOrderParameters;
+    ProjectionKernel::BatchFunction scanOrderAngles;
+
+    bool orderedCellsMatch(const PointBuffer &points, int first, int count, const qint32 *rows, const qint32 *columns);
+    bool locateOrderedPoint(const PointBuffer &points, int index, int nearColumn, int &row, int &column);
+
+    void splatCells(const PointBuffer &points, int first, int count, const qint32 *rows, const qint32 *columns, PanoramaTiles *privateTiles);
+
 public:
     bool convertToSpherical(Point3D &point, float &theta, float &phi, float &radius);
+    bool convertToSpherical(float x, float y, float z, float &theta, float &phi, float &radius);
     void project(float theta, float phi, float &x, float &y);
     void unprojectPanorama3D(int x, int y, Point3D &projectedPoint);
 
+    //The mesher and exporters read the vertices from a grid, unprojected once in parallel after the import.
+    //It is kept (e.g. for meshing again with other thresholds) until the panorama changes.
+    void prepareVertexGrid(int threads);
+    void unprojectTiles(int firstTile, int lastTile);
+    inline void vertexAt(int x, int y, Point3D &point) const
+    {
+        const PointBuffer *tile = this->vertexTiles.at((y / PanoramaStore::TileSize) * this->store.tilesX() + x / PanoramaStore::TileSize);
+        if(tile == NULL)
+        {
+            //No point landed in the tile: empty pixel
+            point = Point3D();
+            point.r = point.g = point.b = 0;
+            return;
+        }
+
+        int offset = (y % PanoramaStore::TileSize) * PanoramaStore::TileSize + x % PanoramaStore::TileSize;
+        point.x = tile->x.at(offset);
+        point.y = tile->y.at(offset);
+        point.z = tile->z.at(offset);
+
+        QRgb colorValue = this->store.colorAt(x, y);
+        point.r = qRed(colorValue);
+        point.g = qGreen(colorValue);
+        point.b = qBlue(colorValue);
+    }
+
+    //Per pixel metrics of the quad the mesher anchors at the pixel: the smaller absolute cosine between a face
+    //normal and the view ray, and the smaller triangle area. Filled by the first meshing, meshing again with
+    //another threshold or minimum area only filters them. Quads are only anchored at pixels with a point, so
+    //the metrics are kept in the tiles of the store (same offsets as the vertex grid), 6 bytes per pixel.
+    struct QuadMetricsTile
+    {
+        quint16 cosine[PanoramaStore::TileSize * PanoramaStore::TileSize];
+        float area[PanoramaStore::TileSize * PanoramaStore::TileSize];
+    };
+    QVector<QuadMetricsTile*> quadMetrics;
+    bool quadMetricsValid;
+
+    //Allocates a metrics tile for every allocated store tile, unless the metrics are valid
+    void prepareQuadMetrics();
+    inline QuadMetricsTile *quadMetricsTile(int x, int y) const
+    {
+        return this->quadMetrics.at((y / PanoramaStore::TileSize) * this->store.tilesX() + x / PanoramaStore::TileSize);
+    }
+    static inline int quadMetricsOffset(int x, int y)
+    {
+        return (y % PanoramaStore::TileSize) * PanoramaStore::TileSize + x % PanoramaStore::TileSize;
+    }
+
+    //The cosine is in [0, 1], 16 bits resolve it far finer than any useful angle threshold
+    static inline quint16 quantizeCosine(float cosine)
+    {
+        return (quint16)qRound(qBound(0.0f, cosine, 1.0f) * 65535.0f);
+    }
+    static inline float dequantizeCosine(quint16 cosine)
+    {
+        return cosine / 65535.0f;
+    }
+
+    //Concurrent splatting: addPoints() may be called from several threads. Either every thread
+    //writes into the shared store (atomic compare-exchange per pixel) or into its own private tiles,
+    //which get merged once all threads are done.
+    PanoramaTiles *createPrivateTiles();
+    void mergePrivateTiles(const QList<PanoramaTiles*> &privateTiles, int threads);
+
+    //Kernel for the scanner angles of this orientation and translation, binned into columns x rows over the full sphere
+    ProjectionKernel::BatchFunction angleBatchFunction(ProjectionKernel::Parameters &parameters, int columns, int rows);
+
+    //Points with grid indices are placed by lookup tables instead of the projection kernel.
+    //If the panorama has the resolution of the grid, every cell owns a pixel and the depth test is skipped.
+    void setScanGrid(const ScanGrid &grid);
+    //Scan line ordered files: the grid cell follows from the index of the point in the file.
+    //A few points of every batch are checked against the angles of their cells. After a point
+    //missing from the file the batch is projected, and the index resynchronized from its last point.
+    void setScanOrder(int columnLength, int phase);
+    static const int GridLimit = 65536;
+
     QVector3D getTranslationVector();
+    void setTranslationVector(QVector3D translationVector);
+
+    float getMaxDistance();
 
-    QImage panoramaDepth;
-    QImage panoramaColor;
+    PanoramaStore store;
+
+    //Created from the store for the user interface, at most PreviewWidth pixels wide
+    static const int PreviewWidth = 8192;
+    QImage depthPreview;
+    QImage colorPreview;
 
 signals:
     void updateDepthMap(QImage *depthMap);
@@ -125,9 +266,27 @@ signals:
 
 public slots:
     void addPoint(Point3D point);
+    void addPoints(const PointBuffer &points, int first, int count, PanoramaTiles *privateTiles = NULL);
+    void addPoints(const XybRecord *records, qint64 count);
+    void addOrderedPoints(const PointBuffer &points, int first, int count, qint64 firstIndex);
     void refreshTextureMapsGUI();
 
 
 };
 
+/*
+ * A row of tiles of the vertex grid, unprojected on its own thread.
+ */
+class VertexGridTask : public QRunnable
+{
+public:
+    VertexGridTask(Panorama3D *panorama, int firstTile, int lastTile);
+
+    void run();
+
+    Panorama3D *panorama;
+    int firstTile;
+    int lastTile;
+};
+
 #endif // PANORAMA3D_H
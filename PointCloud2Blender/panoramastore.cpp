@@ -0,0 +1,284 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "panoramastore.h"
+
+#include <QThreadPool>
+#include <QDebug>
+
+const quint64 PanoramaStore::Empty;
+
+PanoramaStore::PanoramaStore()
+{
+    this->mapWidth = 0;
+    this->mapHeight = 0;
+    this->tileColumns = 0;
+    this->tileRows = 0;
+    this->tiles = NULL;
+}
+
+PanoramaStore::~PanoramaStore()
+{
+    clear();
+    delete[] this->tiles;
+}
+
+void PanoramaStore::resize(int width, int height)
+{
+    clear();
+    delete[] this->tiles;
+
+    this->mapWidth = width;
+    this->mapHeight = height;
+    this->tileColumns = (width + TileSize - 1) / TileSize;
+    this->tileRows = (height + TileSize - 1) / TileSize;
+
+    //Only the tile pointers, the pixels follow the points
+    this->tiles = new QAtomicPointer<Pixel>[this->tileColumns * this->tileRows];
+}
+
+void PanoramaStore::clear()
+{
+    for(int i = 0; i < this->tileColumns * this->tileRows; i++)
+    {
+        delete[] this->tiles[i].load();
+        this->tiles[i].store(NULL);
+    }
+}
+
+PanoramaStore::Pixel *PanoramaStore::allocateTile(int index)
+{
+    Pixel *tile = this->tiles[index].loadAcquire();
+    if(tile != NULL)
+        return tile;
+
+    tile = new Pixel[TileSize * TileSize];
+    for(int i = 0; i < TileSize * TileSize; i++)
+        tile[i].store(Empty);
+
+    //Another thread may have been faster, then its tile is used
+    if(!this->tiles[index].testAndSetOrdered(NULL, tile))
+    {
+        delete[] tile;
+        tile = this->tiles[index].loadAcquire();
+    }
+
+    return tile;
+}
+
+int PanoramaStore::allocatedTiles() const
+{
+    int count = 0;
+    for(int i = 0; i < this->tileColumns * this->tileRows; i++)
+    {
+        if(tile(i) != NULL)
+            count++;
+    }
+
+    return count;
+}
+
+bool PanoramaStore::isAreaEmpty(const QRect &area) const
+{
+    QRect bounds = area.intersected(QRect(0, 0, this->mapWidth, this->mapHeight));
+    if(bounds.isEmpty())
+        return true;
+
+    for(int tileY = bounds.top() / TileSize; tileY <= bounds.bottom() / TileSize; tileY++)
+    {
+        for(int tileX = bounds.left() / TileSize; tileX <= bounds.right() / TileSize; tileX++)
+        {
+            if(tile(tileY * this->tileColumns + tileX) != NULL)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+void PanoramaStore::merge(const QList<PanoramaTiles*> &privateTiles, int threads)
+{
+    if(privateTiles.isEmpty())
+        return;
+
+    //Every task owns every n-th tile, so no two tasks touch the same pixel
+    QThreadPool mergePool;
+    mergePool.setMaxThreadCount(qMax(threads, 1));
+
+    for(int i = 0; i < qMax(threads, 1); i++)
+        mergePool.start(new PanoramaMergeTask(this, privateTiles, i, qMax(threads, 1)));
+
+    mergePool.waitForDone();
+}
+
+QImage PanoramaStore::depthImage(float maxDistance) const
+{
+    return depthImage(maxDistance, QRect(0, 0, this->mapWidth, this->mapHeight));
+}
+
+QImage PanoramaStore::depthImage(float maxDistance, const QRect &area, int step) const
+{
+    QImage image((area.width() + step - 1) / step, (area.height() + step - 1) / step, QImage::Format_RGB32);
+    image.fill(qRgb(0, 0, 0));
+    float scale = (maxDistance > 0.0f) ? 255.0f / maxDistance : 0.0f;
+
+    for(int y = 0; y < image.height(); y++)
+    {
+        int row = area.top() + y * step;
+        QRgb *line = (QRgb *)image.scanLine(y);
+
+        for(int x = 0; x < image.width(); x++)
+        {
+            quint64 word = wordAt(area.left() + x * step, row);
+            if(word == Empty)
+                continue;
+
+            //Limit the depth, the store keeps the full range
+            int value = (int)(unpackDepth(word) * scale);
+            if(value > 255) value = 255;
+
+            line[x] = qRgb(value, value, value);
+        }
+    }
+
+    return image;
+}
+
+QImage PanoramaStore::colorImage() const
+{
+    return colorImage(QRect(0, 0, this->mapWidth, this->mapHeight));
+}
+
+QImage PanoramaStore::colorImage(const QRect &area, int step) const
+{
+    QImage image((area.width() + step - 1) / step, (area.height() + step - 1) / step, QImage::Format_RGB32);
+
+    for(int y = 0; y < image.height(); y++)
+    {
+        int row = area.top() + y * step;
+        QRgb *line = (QRgb *)image.scanLine(y);
+
+        for(int x = 0; x < image.width(); x++)
+            line[x] = colorAt(area.left() + x * step, row);
+    }
+
+    return image;
+}
+
+bool PanoramaStore::fitsImage() const
+{
+    //QImage addresses its bytes with an int
+    return (qint64)this->mapWidth * this->mapHeight * 4 < Q_INT64_C(0x7FFFFFFF) && this->mapWidth < 32768 && this->mapHeight < 32768;
+}
+
+void PanoramaStore::saveTextureMaps(QString baseName, float maxDistance, int exportTileSize) const
+{
+    qDebug() << "Panorama store:" << allocatedTiles() << "of" << this->tileColumns * this->tileRows << "tiles allocated,"
+             << (qint64)allocatedTiles() * TileSize * TileSize * sizeof(quint64) / (1024 * 1024) << "MB";
+
+    if(fitsImage())
+    {
+        depthImage(maxDistance).save(baseName + "_depthmap.jpg");
+        colorImage().save(baseName + "_colormap.jpg");
+        return;
+    }
+
+    //Full resolution in tiles, only where the scan has points
+    for(int top = 0; top < this->mapHeight; top += exportTileSize)
+    {
+        for(int left = 0; left < this->mapWidth; left += exportTileSize)
+        {
+            QRect area(left, top, qMin(exportTileSize, this->mapWidth - left), qMin(exportTileSize, this->mapHeight - top));
+            if(isAreaEmpty(area))
+                continue;
+
+            QString suffix = QString("_%1_%2.jpg").arg(left / exportTileSize).arg(top / exportTileSize);
+            depthImage(maxDistance, area).save(baseName + "_depthmap" + suffix);
+            colorImage(area).save(baseName + "_colormap" + suffix);
+        }
+    }
+
+    //Reduced maps for the materials of the mesh
+    int step = 2;
+    while(this->mapWidth / step >= 32768 || this->mapHeight / step >= 32768 || (qint64)(this->mapWidth / step) * (this->mapHeight / step) * 4 >= Q_INT64_C(0x7FFFFFFF))
+        step *= 2;
+
+    QRect all(0, 0, this->mapWidth, this->mapHeight);
+    depthImage(maxDistance, all, step).save(baseName + "_depthmap.jpg");
+    colorImage(all, step).save(baseName + "_colormap.jpg");
+
+    qDebug() << "Panorama store: texture maps saved in tiles of" << exportTileSize << "pixels, reduced by" << step << "for the materials";
+}
+
+PanoramaTiles::PanoramaTiles(int width, int height)
+{
+    this->tilesX = (width + TileSize - 1) / TileSize;
+    this->tilesY = (height + TileSize - 1) / TileSize;
+    this->tiles.fill(NULL, this->tilesX * this->tilesY);
+}
+
+PanoramaTiles::~PanoramaTiles()
+{
+    for(int i = 0; i < this->tiles.size(); i++)
+        delete[] this->tiles[i];
+}
+
+quint64 *PanoramaTiles::allocateTile(int index)
+{
+    quint64 *tile = new quint64[TileSize * TileSize];
+    for(int i = 0; i < TileSize * TileSize; i++)
+        tile[i] = PanoramaStore::Empty;
+
+    this->tiles[index] = tile;
+    return tile;
+}
+
+PanoramaMergeTask::PanoramaMergeTask(PanoramaStore *store, const QList<PanoramaTiles*> &privateTiles, int first, int step)
+{
+    this->store = store;
+    this->privateTiles = privateTiles;
+    this->first = first;
+    this->step = step;
+}
+
+void PanoramaMergeTask::run()
+{
+    const int tileSize = PanoramaTiles::TileSize;
+
+    for(int index = this->first; index < this->store->tilesX() * this->store->tilesY(); index += this->step)
+    {
+        PanoramaStore::Pixel *target = NULL;
+
+        for(int i = 0; i < this->privateTiles.size(); i++)
+        {
+            const quint64 *tile = this->privateTiles.at(i)->tiles.at(index);
+            if(tile == NULL)
+                continue;
+
+            //Same layout, the tiles are combined word by word
+            if(target == NULL)
+                target = this->store->allocateTile(index);
+
+            for(int offset = 0; offset < tileSize * tileSize; offset++)
+            {
+                if(tile[offset] != PanoramaStore::Empty)
+                    PanoramaStore::plotTileWord(target, offset, tile[offset]);
+            }
+        }
+    }
+}
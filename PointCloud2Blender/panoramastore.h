@@ -0,0 +1,233 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PANORAMASTORE_H
+#define PANORAMASTORE_H
+
+#include <QVector>
+#include <QList>
+#include <QImage>
+#include <QColor>
+#include <QAtomicInteger>
+#include <QAtomicPointer>
+#include <QRect>
+#include <QRunnable>
+
+#include <cstring>
+
+class PanoramaTiles;
+
+/*
+ * Pixel storage of a panorama: one 64 bit word per pixel, float depth in meters in the upper
+ * and RGBA8 color in the lower half. Positive floats compare like integers, so the nearest
+ * point is the smallest word and the depth test is an atomic compare-exchange minimum.
+ * Several threads can splat into the same store without locks, and because equal depths are
+ * decided by the color the result does not depend on the order of the points.
+ *
+ * The pixels live in tiles of TileSize x TileSize (32 KB, cache and page friendly), which are
+ * only allocated when the first point lands in them. Memory grows with the area the scan
+ * actually covers (the cone below the scanner stays unallocated), and the resolution is not
+ * bound by the 2 GB limit of QImage. Two threads allocating the same tile race with a
+ * compare-exchange on the tile pointer, the loser frees its copy.
+ *
+ * QImages are only created for the user interface and for saving the texture maps, either of
+ * the whole panorama or of a part of it (saveTextureMaps() splits too large maps into tiles).
+ */
+class PanoramaStore
+{
+public:
+    enum { TileSize = 64 };
+
+    //Larger than every packed point, the depth half is not a valid float
+    static const quint64 Empty = Q_UINT64_C(0xFFFFFFFFFFFFFFFF);
+
+    typedef QAtomicInteger<quint64> Pixel;
+
+    PanoramaStore();
+    ~PanoramaStore();
+
+    void resize(int width, int height);
+    void clear();
+
+    int width() const { return this->mapWidth; }
+    int height() const { return this->mapHeight; }
+    int tilesX() const { return this->tileColumns; }
+    int tilesY() const { return this->tileRows; }
+
+    static inline quint64 pack(float depth, QRgb color)
+    {
+        quint32 bits;
+        memcpy(&bits, &depth, sizeof(bits));
+        return ((quint64)bits << 32) | (color | 0xFF000000);
+    }
+
+    static inline float unpackDepth(quint64 word)
+    {
+        if(word == Empty)
+            return 0.0f;
+
+        quint32 bits = (quint32)(word >> 32);
+        float depth;
+        memcpy(&depth, &bits, sizeof(depth));
+        return depth;
+    }
+
+    static inline QRgb unpackColor(quint64 word)
+    {
+        return (word == Empty) ? 0 : (QRgb)word;
+    }
+
+    //Thread-safe, the nearest point wins
+    inline void plot(int column, int row, float depth, QRgb color)
+    {
+        plotWord(column, row, pack(depth, color));
+    }
+
+    inline void plotWord(int column, int row, quint64 value)
+    {
+        int index = (row / TileSize) * this->tileColumns + column / TileSize;
+        Pixel *tile = this->tiles[index].loadAcquire();
+        if(tile == NULL)
+            tile = allocateTile(index);
+
+        plotTileWord(tile, (row % TileSize) * TileSize + column % TileSize, value);
+    }
+
+    //Thread-safe, without depth test: for pixels written by exactly one point
+    inline void write(int column, int row, float depth, QRgb color)
+    {
+        int index = (row / TileSize) * this->tileColumns + column / TileSize;
+        Pixel *tile = this->tiles[index].loadAcquire();
+        if(tile == NULL)
+            tile = allocateTile(index);
+
+        tile[(row % TileSize) * TileSize + column % TileSize].store(pack(depth, color));
+    }
+
+    static inline void plotTileWord(Pixel *tile, int offset, quint64 value)
+    {
+        Pixel &pixel = tile[offset];
+        quint64 current = pixel.load();
+
+        //Retry only while the new point is still nearer than what another thread stored
+        while(value < current && !pixel.testAndSetRelaxed(current, value, current))
+        {
+        }
+    }
+
+    inline quint64 wordAt(int x, int y) const
+    {
+        const Pixel *tile = this->tiles[(y / TileSize) * this->tileColumns + x / TileSize].loadAcquire();
+        if(tile == NULL)
+            return Empty;
+
+        return tile[(y % TileSize) * TileSize + x % TileSize].load();
+    }
+
+    inline bool isEmpty(int x, int y) const { return wordAt(x, y) == Empty; }
+    inline float depthAt(int x, int y) const { return unpackDepth(wordAt(x, y)); }
+    inline QRgb colorAt(int x, int y) const { return unpackColor(wordAt(x, y)); }
+
+    //NULL if no point has landed in the tile yet
+    inline const Pixel *tile(int index) const { return this->tiles[index].loadAcquire(); }
+    Pixel *allocateTile(int index);
+
+    int allocatedTiles() const;
+    bool isAreaEmpty(const QRect &area) const;
+
+    //Minimum of the private tiles of all producer threads, the tiles are split over the given number of threads
+    void merge(const QList<PanoramaTiles*> &privateTiles, int threads);
+
+    //8 bit gray scale depth (0 = empty, 255 = maxDistance or further) and color for display and saving.
+    //Every step-th pixel of the area is taken, step > 1 gives a reduced preview.
+    QImage depthImage(float maxDistance) const;
+    QImage depthImage(float maxDistance, const QRect &area, int step = 1) const;
+    QImage colorImage() const;
+    QImage colorImage(const QRect &area, int step = 1) const;
+
+    //Whether the whole map fits into a single QImage (32 bit, below 2 GB)
+    bool fitsImage() const;
+
+    //Saves <baseName>_depthmap.jpg and <baseName>_colormap.jpg. Maps too large for one image
+    //are reduced for these files and saved at full resolution as <baseName>_depthmap_<column>_<row>.jpg
+    //tiles of exportTileSize pixels, tiles without any point are skipped.
+    void saveTextureMaps(QString baseName, float maxDistance, int exportTileSize = 8192) const;
+
+private:
+    Q_DISABLE_COPY(PanoramaStore)
+
+    int mapWidth;
+    int mapHeight;
+    int tileColumns;
+    int tileRows;
+
+    QAtomicPointer<Pixel> *tiles;
+};
+
+/*
+ * Private pixels of one producer thread, for splatting without any atomic operation.
+ * The tiles have the layout of the store tiles and are only allocated when the first point
+ * lands in them, PanoramaStore::merge() combines the tiles of all threads afterwards.
+ */
+class PanoramaTiles
+{
+public:
+    enum { TileSize = PanoramaStore::TileSize };
+
+    PanoramaTiles(int width, int height);
+    ~PanoramaTiles();
+
+    inline void plot(int column, int row, float depth, QRgb color)
+    {
+        int index = (row / TileSize) * this->tilesX + column / TileSize;
+        quint64 *tile = this->tiles[index];
+        if(tile == NULL)
+            tile = allocateTile(index);
+
+        quint64 &pixel = tile[(row % TileSize) * TileSize + column % TileSize];
+        quint64 value = PanoramaStore::pack(depth, color);
+        if(value < pixel)
+            pixel = value;
+    }
+
+    int tilesX;
+    int tilesY;
+
+    //NULL until a point lands in the tile
+    QVector<quint64*> tiles;
+
+private:
+    Q_DISABLE_COPY(PanoramaTiles)
+
+    quint64 *allocateTile(int index);
+};
+
+class PanoramaMergeTask : public QRunnable
+{
+public:
+    PanoramaMergeTask(PanoramaStore *store, const QList<PanoramaTiles*> &privateTiles, int first, int step);
+    void run();
+
+private:
+    PanoramaStore *store;
+    QList<PanoramaTiles*> privateTiles;
+    int first;
+    int step;
+};
+
+#endif // PANORAMASTORE_H
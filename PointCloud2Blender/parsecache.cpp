@@ -0,0 +1,186 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "parsecache.h"
+#include "xybformat.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QDebug>
+
+ParseCache::ParseCache(QString sourceFile, QString cacheDirectory)
+{
+    this->source = QFileInfo(sourceFile);
+    this->validity = 0;
+
+    if(cacheDirectory.isEmpty())
+    {
+        this->baseName = this->source.absoluteFilePath() + ".pc2b";
+    }
+    else
+    {
+        //Files of the same name in different directories must not share a cache
+        QByteArray pathHash = QCryptographicHash::hash(this->source.absoluteFilePath().toUtf8(), QCryptographicHash::Sha1).toHex().left(8);
+        this->baseName = QDir(cacheDirectory).absoluteFilePath(this->source.fileName() + "_" + pathHash + ".pc2b");
+    }
+
+    this->keyFile = this->baseName;
+}
+
+bool ParseCache::isValid()
+{
+    if(this->validity != 0)
+        return this->validity > 0;
+
+    this->validity = -1;
+    if(!QFileInfo(this->keyFile).exists() || !this->source.exists())
+        return false;
+
+    QSettings key(this->keyFile, QSettings::IniFormat);
+
+    //The sampled hash alone misses most same size edits, a touched or moved source is parsed again
+    if(key.value("source/size", -1).toLongLong() != this->source.size()
+            || key.value("source/path").toString() != this->source.absoluteFilePath()
+            || key.value("source/modified", -1).toLongLong() != this->source.lastModified().toMSecsSinceEpoch()
+            || key.value("source/hash").toByteArray() != sampledHash(this->source.absoluteFilePath()))
+        return false;
+
+    this->validity = 1;
+    return true;
+}
+
+bool ParseCache::hasPoints()
+{
+    if(!isValid())
+        return false;
+
+    QSettings key(this->keyFile, QSettings::IniFormat);
+    qint64 pointCount = key.value("points/count", -1).toLongLong();
+
+    //A truncated data file would import garbage
+    return pointCount >= 0 && QFileInfo(dataFileName()).size() == (qint64)sizeof(XybHeader) + pointCount * (qint64)sizeof(XybRecord);
+}
+
+void ParseCache::storePoints(qint64 pointCount, int columnLength, int phase)
+{
+    writeKey(isValid());
+
+    QSettings key(this->keyFile, QSettings::IniFormat);
+    key.setValue("points/count", pointCount);
+    key.setValue("points/columnLength", columnLength);
+    key.setValue("points/phase", phase);
+    this->validity = 1;
+
+    qDebug() << "Parse cache:" << pointCount << "points stored in" << dataFileName();
+}
+
+int ParseCache::scanOrder(int &phase)
+{
+    phase = 0;
+    if(!isValid())
+        return 0;
+
+    QSettings key(this->keyFile, QSettings::IniFormat);
+    phase = key.value("points/phase", 0).toInt();
+    return key.value("points/columnLength", 0).toInt();
+}
+
+bool ParseCache::originalResolution(QVector3D translation, int orientation, bool sampled, int &horizontal, int &vertical, float &confidence)
+{
+    if(!isValid())
+        return false;
+
+    QSettings key(this->keyFile, QSettings::IniFormat);
+
+    //Analyzed from another scanner position, orientation or with the other mode
+    if(key.value("analysis/translation").toString() != translationKey(translation)
+            || key.value("analysis/orientation", -1).toInt() != orientation
+            || key.value("analysis/mode").toString() != (sampled ? "sampled" : "full"))
+        return false;
+
+    horizontal = key.value("analysis/originalHorizontalResolution", -1).toInt();
+    vertical = key.value("analysis/originalVerticalResolution", horizontal / 2).toInt();
+    confidence = key.value("analysis/confidence", 0.0f).toFloat();
+
+    return horizontal > 0 && vertical > 0;
+}
+
+void ParseCache::storeOriginalResolution(QVector3D translation, int orientation, bool sampled, int horizontal, int vertical, float confidence)
+{
+    writeKey(isValid());
+
+    QSettings key(this->keyFile, QSettings::IniFormat);
+    key.setValue("analysis/translation", translationKey(translation));
+    key.setValue("analysis/orientation", orientation);
+    key.setValue("analysis/mode", sampled ? "sampled" : "full");
+    key.setValue("analysis/originalHorizontalResolution", horizontal);
+    key.setValue("analysis/originalVerticalResolution", vertical);
+    key.setValue("analysis/confidence", confidence);
+    this->validity = 1;
+}
+
+QString ParseCache::translationKey(QVector3D translation)
+{
+    return QString("%1 %2 %3").arg(translation.x()).arg(translation.y()).arg(translation.z());
+}
+
+void ParseCache::writeKey(bool keepResults)
+{
+    QSettings key(this->keyFile, QSettings::IniFormat);
+
+    //Results of another version of the source are dropped
+    if(!keepResults)
+        key.clear();
+
+    key.setValue("source/path", this->source.absoluteFilePath());
+    key.setValue("source/size", this->source.size());
+    key.setValue("source/modified", this->source.lastModified().toMSecsSinceEpoch());
+    key.setValue("source/hash", sampledHash(this->source.absoluteFilePath()));
+    key.sync();
+}
+
+QByteArray ParseCache::sampledHash(QString fileName)
+{
+    const int samples = 64;
+    const qint64 sampleSize = 64 * 1024;
+
+    QFile file(fileName);
+    if(!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    qint64 size = file.size();
+    hash.addData(QByteArray::number(size));
+
+    if(size <= samples * sampleSize)
+    {
+        hash.addData(file.readAll());
+    }
+    else
+    {
+        //The first and the last sample are the head and the tail of the file
+        for(int i = 0; i < samples; i++)
+        {
+            file.seek((size - sampleSize) * i / (samples - 1));
+            hash.addData(file.read(sampleSize));
+        }
+    }
+
+    return hash.result().toHex();
+}
@@ -0,0 +1,79 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PARSECACHE_H
+#define PARSECACHE_H
+
+#include <QString>
+#include <QFileInfo>
+#include <QSettings>
+#include <QVector3D>
+
+/*
+ * Persistent cache of a parsed point cloud file, reused across runs and machines.
+ *
+ * Two files are written next to the source file, or into a cache directory:
+ *  - <name>.pc2b.xyb: the decoded points as a regular .xyb file, imported zero-copy
+ *    (with a .grid sidecar holding the cells of a scan grid import)
+ *  - <name>.pc2b: the key (path, size, modification time and a sampled content hash
+ *    of the source), the column length and phase of a scan line ordered file and the
+ *    results of the analysis, in the ini format. The original
+ *    resolution depends on the scanner position and orientation the points were seen
+ *    from and on the analysis mode, it is only reused with the same settings.
+ *
+ * A cache is only valid if path, size, modification time and content hash all match.
+ * The content hash covers the size and 64 evenly spaced samples of 64 KB, so it reads
+ * at most 4 MB even of very large exports. It catches a source replaced within the
+ * resolution of the modification time, but not an edit between its samples: a moved
+ * or touched source is parsed again.
+ */
+class ParseCache
+{
+public:
+    ParseCache(QString sourceFile, QString cacheDirectory = QString());
+
+    QString keyFileName() const { return this->keyFile; }
+    QString dataFileName() const { return this->baseName + ".xyb"; }
+
+    //Whether the key belongs to the current source file
+    bool isValid();
+
+    bool hasPoints();
+    //Column length 0: the points are not in scan line order
+    void storePoints(qint64 pointCount, int columnLength, int phase);
+    int scanOrder(int &phase);
+
+    //false if the analysis was not stored or was made with other settings
+    bool originalResolution(QVector3D translation, int orientation, bool sampled, int &horizontal, int &vertical, float &confidence);
+    void storeOriginalResolution(QVector3D translation, int orientation, bool sampled, int horizontal, int vertical, float confidence);
+
+    static QByteArray sampledHash(QString fileName);
+
+private:
+    void writeKey(bool keepResults);
+    static QString translationKey(QVector3D translation);
+
+    QFileInfo source;
+    QString baseName;
+    QString keyFile;
+
+    //0: unknown, 1: valid, -1: invalid
+    int validity;
+};
+
+#endif // PARSECACHE_H
@@ -0,0 +1,304 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "plyschema.h"
+
+PlySchema::PlySchema()
+{
+    format = ASCII;
+    vertexElement = -1;
+    dataOffset = 0;
+
+    for(int c = 0; c < CHANNEL_COUNT; c++)
+    {
+        channels[c].present = false;
+        channels[c].type = INVALID;
+        channels[c].offset = 0;
+        channels[c].column = 0;
+    }
+}
+
+bool PlySchema::parseHeader(QFile &file)
+{
+    /*
+    PLY Header definitions:
+
+    ply
+    format ascii 1.0
+    format binary_little_endian 1.0
+    format binary_big_endian 1.0
+    element vertex 12
+    property float x
+    property float y
+    property float z
+    property uchar red
+    property uchar green
+    property uchar blue
+    property uchar alpha
+    element face 10
+    property list uchar int vertex_indices
+    end_header
+
+    */
+    elements.clear();
+    vertexElement = -1;
+
+    QString magic = QString::fromLatin1(file.readLine()).trimmed();
+    if(magic != "ply")
+    {
+        errorString = "The file is not a .ply file (missing 'ply' signature)!";
+        return false;
+    }
+
+    bool endHeader = false;
+
+    while(!file.atEnd())
+    {
+        QString line = QString::fromLatin1(file.readLine()).trimmed();
+        QStringList lineparts = line.split(" ", QString::SkipEmptyParts);
+
+        if(lineparts.isEmpty())
+            continue;
+
+        if(lineparts.at(0) == "format" && lineparts.size() >= 2)
+        {
+            if(lineparts.at(1) == "ascii")
+                format = ASCII;
+            else if(lineparts.at(1) == "binary_little_endian")
+                format = BINARY_LITTLE_ENDIAN;
+            else if(lineparts.at(1) == "binary_big_endian")
+                format = BINARY_BIG_ENDIAN;
+            else
+            {
+                errorString = "Unknown .ply format: " + lineparts.at(1);
+                return false;
+            }
+            qDebug() << "PLY: HEADER format" << lineparts.at(1);
+        }
+        else if(lineparts.at(0) == "element" && lineparts.size() >= 3)
+        {
+            Element element;
+            element.name = lineparts.at(1);
+            element.count = lineparts.at(2).toLongLong();
+            element.stride = 0;
+            elements.append(element);
+
+            if(element.name == "vertex")
+            {
+                vertexElement = elements.size() - 1;
+                qDebug() << "PLY: HEADER maxVertices = " << element.count;
+            }
+        }
+        else if(lineparts.at(0) == "property" && lineparts.size() >= 3 && !elements.isEmpty())
+        {
+            Property property;
+            property.name = lineparts.last();
+            property.list = (lineparts.at(1) == "list");
+            property.offset = 0;
+
+            if(property.list && lineparts.size() >= 5)
+            {
+                property.listCountType = typeFromName(lineparts.at(2));
+                property.type = typeFromName(lineparts.at(3));
+            }
+            else
+            {
+                property.listCountType = INVALID;
+                property.type = typeFromName(lineparts.at(1));
+            }
+
+            if(property.type == INVALID)
+            {
+                errorString = "Unknown .ply property type in line: " + line;
+                return false;
+            }
+
+            elements.last().properties.append(property);
+        }
+        else if(lineparts.at(0) == "end_header")
+        {
+            endHeader = true;
+            break;
+        }
+    }
+
+    if(!endHeader)
+    {
+        errorString = "The .ply header has no end_header line!";
+        return false;
+    }
+
+    if(vertexElement < 0)
+    {
+        errorString = "The .ply file has no vertex element!";
+        return false;
+    }
+
+    dataOffset = file.pos();
+
+    compile();
+
+    if(!channels[X].present || !channels[Y].present || !channels[Z].present)
+    {
+        errorString = "The .ply vertices have no x, y and z properties!";
+        return false;
+    }
+
+    return true;
+}
+
+void PlySchema::compile()
+{
+    //Byte offsets (binary) and columns (ascii) of all properties
+    for(int e = 0; e < elements.size(); e++)
+    {
+        Element &element = elements[e];
+        int offset = 0;
+
+        for(int p = 0; p < element.properties.size(); p++)
+        {
+            Property &property = element.properties[p];
+            property.offset = offset;
+
+            //Lists have a variable size, so the element has no fixed stride
+            if(property.list || offset < 0)
+                offset = -1;
+            else
+                offset += typeSize(property.type);
+        }
+
+        element.stride = offset;
+    }
+
+    const Element &vertex = elements.at(vertexElement);
+
+    for(int c = 0; c < CHANNEL_COUNT; c++)
+        channels[c].present = false;
+
+    for(int p = 0; p < vertex.properties.size(); p++)
+    {
+        const Property &property = vertex.properties.at(p);
+        int channel = -1;
+
+        if(property.name == "x")
+            channel = X;
+        else if(property.name == "y")
+            channel = Y;
+        else if(property.name == "z")
+            channel = Z;
+        else if(property.name.contains("red"))
+            channel = RED;
+        else if(property.name.contains("green"))
+            channel = GREEN;
+        else if(property.name.contains("blue"))
+            channel = BLUE;
+
+        //Only the first match counts, extra properties (alpha, normals, ...) are skipped
+        if(channel >= 0 && !channels[channel].present && !property.list)
+        {
+            channels[channel].present = true;
+            channels[channel].type = property.type;
+            channels[channel].offset = property.offset;
+            channels[channel].column = p;
+            qDebug() << "PLY: HEADER property =" << property.name << "offset" << property.offset << "column" << p;
+        }
+    }
+}
+
+qint64 PlySchema::vertexCount() const
+{
+    return vertexElement >= 0 ? elements.at(vertexElement).count : 0;
+}
+
+int PlySchema::vertexStride() const
+{
+    return vertexElement >= 0 ? elements.at(vertexElement).stride : -1;
+}
+
+bool PlySchema::hasColor() const
+{
+    return channels[RED].present && channels[GREEN].present && channels[BLUE].present;
+}
+
+bool PlySchema::vertexElementIsLast() const
+{
+    return vertexElement == elements.size() - 1;
+}
+
+qint64 PlySchema::linesBeforeVertices() const
+{
+    //Ascii: one line per element entry
+    qint64 lines = 0;
+    for(int e = 0; e < vertexElement; e++)
+        lines += elements.at(e).count;
+    return lines;
+}
+
+bool PlySchema::binaryVertexOffset(qint64 &offset) const
+{
+    offset = dataOffset;
+    for(int e = 0; e < vertexElement; e++)
+    {
+        if(elements.at(e).stride < 0)
+            return false;
+        offset += elements.at(e).count * elements.at(e).stride;
+    }
+    return true;
+}
+
+PlySchema::Type PlySchema::typeFromName(const QString &name)
+{
+    if(name == "char" || name == "int8")
+        return CHAR;
+    if(name == "uchar" || name == "uint8")
+        return UCHAR;
+    if(name == "short" || name == "int16")
+        return SHORT;
+    if(name == "ushort" || name == "uint16")
+        return USHORT;
+    if(name == "int" || name == "int32")
+        return INT;
+    if(name == "uint" || name == "uint32")
+        return UINT;
+    if(name == "float" || name == "float32")
+        return FLOAT;
+    if(name == "double" || name == "float64")
+        return DOUBLE;
+    return INVALID;
+}
+
+int PlySchema::typeSize(Type type)
+{
+    switch(type)
+    {
+    case CHAR:
+    case UCHAR:
+        return 1;
+    case SHORT:
+    case USHORT:
+        return 2;
+    case INT:
+    case UINT:
+    case FLOAT:
+        return 4;
+    case DOUBLE:
+        return 8;
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,208 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PLYSCHEMA_H
+#define PLYSCHEMA_H
+
+#include <QDebug>
+#include <QFile>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QtEndian>
+
+#include <cstring>
+
+#include "asciiparser.h"
+
+/*
+ * The vertex layout of a PLY file, compiled from its header.
+ *
+ * The header is parsed once, afterwards every vertex record (binary) or line (ascii)
+ * is decoded with the precomputed byte offsets/column positions of x, y, z, red, green, blue.
+ */
+class PlySchema
+{
+public:
+    enum Format
+    {
+        ASCII,
+        BINARY_LITTLE_ENDIAN,
+        BINARY_BIG_ENDIAN
+    };
+
+    enum Type
+    {
+        INVALID,
+        CHAR,
+        UCHAR,
+        SHORT,
+        USHORT,
+        INT,
+        UINT,
+        FLOAT,
+        DOUBLE
+    };
+
+    enum ChannelName
+    {
+        X,
+        Y,
+        Z,
+        RED,
+        GREEN,
+        BLUE,
+        CHANNEL_COUNT
+    };
+
+    struct Property
+    {
+        QString name;
+        Type type;
+        bool list;
+        Type listCountType;
+        int offset;
+    };
+
+    struct Element
+    {
+        QString name;
+        qint64 count;
+        QVector<Property> properties;
+        int stride;
+    };
+
+    struct Channel
+    {
+        bool present;
+        Type type;
+        int offset; //binary: byte offset inside the record
+        int column; //ascii: index of the column
+    };
+
+    PlySchema();
+
+    bool parseHeader(QFile &file);
+
+    Format format;
+    QVector<Element> elements;
+    int vertexElement;
+    qint64 dataOffset;
+    QString errorString;
+
+    Channel channels[CHANNEL_COUNT];
+
+    qint64 vertexCount() const;
+    int vertexStride() const;
+    bool hasColor() const;
+    bool vertexElementIsLast() const;
+    qint64 linesBeforeVertices() const;
+    bool binaryVertexOffset(qint64 &offset) const;
+
+    static Type typeFromName(const QString &name);
+    static int typeSize(Type type);
+
+    //Decode one binary vertex record
+    inline void decodeBinary(const uchar *record, float *xyz, quint16 *rgb) const
+    {
+        for(int c = X; c <= Z; c++)
+        {
+            xyz[c - X] = channels[c].present ? (float)readBinary(record + channels[c].offset, channels[c].type) : 0.0f;
+        }
+        for(int c = RED; c <= BLUE; c++)
+        {
+            rgb[c - RED] = channels[c].present ? colorValue(readBinary(record + channels[c].offset, channels[c].type), channels[c].type) : 0;
+        }
+    }
+
+    //Decode one tokenized ascii vertex line
+    inline bool decodeAscii(const char **tokens, int count, const char *end, float *xyz, quint16 *rgb) const
+    {
+        if(count < 3)
+            return false;
+
+        for(int c = X; c <= Z; c++)
+        {
+            xyz[c - X] = 0.0f;
+            if(channels[c].present && channels[c].column < count)
+                AsciiParser::parseFloat(tokens[channels[c].column], end, xyz[c - X]);
+        }
+        for(int c = RED; c <= BLUE; c++)
+        {
+            float value = 0.0f;
+            if(channels[c].present && channels[c].column < count)
+                AsciiParser::parseFloat(tokens[channels[c].column], end, value);
+            rgb[c - RED] = colorValue(value, channels[c].type);
+        }
+
+        return true;
+    }
+
+private:
+    void compile();
+
+    inline double readBinary(const uchar *data, Type type) const
+    {
+        bool little = (format != BINARY_BIG_ENDIAN);
+
+        switch(type)
+        {
+        case CHAR:
+            return (qint8)data[0];
+        case UCHAR:
+            return data[0];
+        case SHORT:
+            return (qint16)(little ? qFromLittleEndian<quint16>(data) : qFromBigEndian<quint16>(data));
+        case USHORT:
+            return little ? qFromLittleEndian<quint16>(data) : qFromBigEndian<quint16>(data);
+        case INT:
+            return (qint32)(little ? qFromLittleEndian<quint32>(data) : qFromBigEndian<quint32>(data));
+        case UINT:
+            return little ? qFromLittleEndian<quint32>(data) : qFromBigEndian<quint32>(data);
+        case FLOAT:
+        {
+            quint32 bits = little ? qFromLittleEndian<quint32>(data) : qFromBigEndian<quint32>(data);
+            float value;
+            memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+        case DOUBLE:
+        {
+            quint64 bits = little ? qFromLittleEndian<quint64>(data) : qFromBigEndian<quint64>(data);
+            double value;
+            memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+        default:
+            return 0.0;
+        }
+    }
+
+    //16 bit colors are scaled down, everything else is expected in 0..255
+    static inline quint16 colorValue(double value, Type type)
+    {
+        if(type == USHORT || type == SHORT)
+            value /= 257.0;
+
+        if(value < 0.0) return 0;
+        if(value > 255.0) return 255;
+        return (quint16)value;
+    }
+};
+
+#endif // PLYSCHEMA_H
@@ -0,0 +1,92 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pointbuffer.h"
+#include "panorama3d.h"
+
+const QRgb PointBuffer::DefaultColor;
+
+PointBuffer::PointBuffer(int channels)
+{
+    channelFlags = channels;
+}
+
+void PointBuffer::setChannels(int channels)
+{
+    clear();
+    channelFlags = channels;
+}
+
+void PointBuffer::reserve(int points)
+{
+    x.reserve(points);
+    y.reserve(points);
+    z.reserve(points);
+    if(channelFlags & COLOR)
+        rgba.reserve(points);
+    if(channelFlags & GRID)
+    {
+        row.reserve(points);
+        column.reserve(points);
+    }
+}
+
+void PointBuffer::resize(int points)
+{
+    x.resize(points);
+    y.resize(points);
+    z.resize(points);
+    if(channelFlags & COLOR)
+        rgba.resize(points);
+    if(channelFlags & GRID)
+    {
+        row.resize(points);
+        column.resize(points);
+    }
+}
+
+void PointBuffer::clear()
+{
+    //resize(0) keeps the allocated capacity for the next block
+    x.resize(0);
+    y.resize(0);
+    z.resize(0);
+    rgba.resize(0);
+    row.resize(0);
+    column.resize(0);
+}
+
+void PointBuffer::append(const Point3D &point)
+{
+    append(point.x, point.y, point.z, qRgb(point.r, point.g, point.b));
+}
+
+Point3D PointBuffer::point(int index) const
+{
+    Point3D point;
+    point.x = x.at(index);
+    point.y = y.at(index);
+    point.z = z.at(index);
+
+    QRgb value = color(index);
+    point.r = qRed(value);
+    point.g = qGreen(value);
+    point.b = qBlue(value);
+
+    return point;
+}
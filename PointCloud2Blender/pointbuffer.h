@@ -0,0 +1,100 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef POINTBUFFER_H
+#define POINTBUFFER_H
+
+#include <QVector>
+#include <QColor>
+
+class Point3D;
+
+/*
+ * Structure-of-arrays storage for points in the import, projection and viewer hot paths.
+ *
+ * x, y and z are separate contiguous arrays, the color is packed into one QRgb (0xAARRGGBB).
+ * Optional channels (color, scan grid row/column) only take memory when enabled:
+ * a point of an xyz-only file needs 12 bytes, a colored point 16 bytes (Point3D: 20 bytes).
+ */
+class PointBuffer
+{
+public:
+    enum Channel
+    {
+        POSITION = 0,
+        COLOR = 1,
+        GRID = 2
+    };
+
+    //Color of points without color channel
+    static const QRgb DefaultColor = 0xFF808080;
+
+    explicit PointBuffer(int channels = COLOR);
+
+    int channels() const { return channelFlags; }
+    void setChannels(int channels);
+    bool hasChannel(Channel channel) const { return (channelFlags & channel) != 0; }
+
+    int size() const { return x.size(); }
+    bool isEmpty() const { return x.isEmpty(); }
+    void reserve(int points);
+    //Grows or shrinks every enabled channel, decoders fill the new points through the arrays
+    void resize(int points);
+    void clear();
+
+    inline void append(float px, float py, float pz, QRgb color)
+    {
+        x.append(px);
+        y.append(py);
+        z.append(pz);
+        if(channelFlags & COLOR)
+            rgba.append(color);
+    }
+
+    inline void appendGrid(qint32 gridRow, qint32 gridColumn)
+    {
+        if(channelFlags & GRID)
+        {
+            row.append(gridRow);
+            column.append(gridColumn);
+        }
+    }
+
+    inline QRgb color(int index) const
+    {
+        return (channelFlags & COLOR) ? rgba.at(index) : DefaultColor;
+    }
+
+    void append(const Point3D &point);
+    Point3D point(int index) const;
+
+    //Position data
+    QVector<float> x;
+    QVector<float> y;
+    QVector<float> z;
+
+    //Optional channels
+    QVector<QRgb> rgba;
+    QVector<qint32> row;
+    QVector<qint32> column;
+
+private:
+    int channelFlags;
+};
+
+#endif // POINTBUFFER_H
@@ -0,0 +1,203 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "pointcache.h"
+
+#include <QFileInfo>
+#include <QDir>
+#include <QCoreApplication>
+#include <QDebug>
+
+const int PointCache::SegmentSize;
+
+PointCache::PointCache()
+{
+    this->fileSize = 0;
+    this->complete = false;
+    this->memoryLimit = Q_INT64_C(2048) * 1024 * 1024;
+    this->pointCount = 0;
+    this->orderColumnLength = 0;
+    this->orderPhase = 0;
+    this->spilled = false;
+    this->spillWriter = NULL;
+    this->spillShared = false;
+}
+
+PointCache::~PointCache()
+{
+    clear();
+}
+
+void PointCache::setMemoryLimit(qint64 bytes)
+{
+    this->memoryLimit = bytes;
+}
+
+bool PointCache::isValidFor(QString fileName) const
+{
+    if(!this->complete || this->fileName != fileName)
+        return false;
+
+    QFileInfo info(fileName);
+    return info.size() == this->fileSize && info.lastModified() == this->fileModified;
+}
+
+void PointCache::begin(QString fileName)
+{
+    clear();
+
+    QFileInfo info(fileName);
+    this->fileName = fileName;
+    this->fileSize = info.size();
+    this->fileModified = info.lastModified();
+
+    //Without a limit the file is always parsed again
+    if(this->memoryLimit <= 0)
+        this->fileName.clear();
+}
+
+void PointCache::shareFile(QString xybFileName)
+{
+    this->sharedFile = xybFileName;
+}
+
+void PointCache::setScanOrder(int columnLength, int phase)
+{
+    this->orderColumnLength = columnLength;
+    this->orderPhase = phase;
+}
+
+void PointCache::addPoints(const PointBuffer &points, int first, int count)
+{
+    if(this->fileName.isEmpty())
+        return;
+
+    if(this->spilled)
+    {
+        if(this->spillWriter != NULL)
+            this->spillWriter->addPoints(points, first, count);
+        this->pointCount += count;
+        return;
+    }
+
+    //Scan grid imports are replayed by their cells
+    bool grid = points.hasChannel(PointBuffer::GRID);
+
+    for(int i = first; i < first + count; i++)
+    {
+        if(this->pointSegments.isEmpty() || this->pointSegments.last().size() >= SegmentSize)
+        {
+            this->pointSegments.append(PointBuffer(grid ? PointBuffer::COLOR | PointBuffer::GRID : PointBuffer::COLOR));
+            this->pointSegments.last().reserve(SegmentSize);
+        }
+
+        PointBuffer &segment = this->pointSegments.last();
+        segment.append(points.x.at(i), points.y.at(i), points.z.at(i), points.color(i));
+        if(segment.hasChannel(PointBuffer::GRID))
+            segment.appendGrid(grid ? points.row.at(i) : -1, grid ? points.column.at(i) : -1);
+    }
+    this->pointCount += count;
+
+    //x, y, z and color, row and column
+    qint64 pointSize = (!this->pointSegments.isEmpty() && this->pointSegments.first().hasChannel(PointBuffer::GRID)) ? 24 : 16;
+    if(this->pointCount * pointSize > this->memoryLimit && !spill())
+    {
+        qDebug() << "Point cache: cannot spill into" << this->spillFile << ", the points are not cached";
+        clear();
+    }
+}
+
+bool PointCache::spill()
+{
+    //The parse cache holds the same points: a second copy would double the disk space and the write time
+    if(!this->sharedFile.isEmpty())
+    {
+        qDebug() << "Point cache: more than" << this->memoryLimit / (1024 * 1024) << "MB, using the parse cache" << this->sharedFile;
+        this->spillFile = this->sharedFile;
+        this->spillShared = true;
+        this->pointSegments.clear();
+        this->spilled = true;
+        return true;
+    }
+
+    this->spillFile = QDir::tempPath() + QString("/PointCloud2Blender_%1.xyb").arg(QCoreApplication::applicationPid());
+    this->spillWriter = new XybWriter();
+    this->spillWriter->keepGrid();
+
+    if(!this->spillWriter->open(this->spillFile, QVector3D()))
+        return false;
+
+    qDebug() << "Point cache: more than" << this->memoryLimit / (1024 * 1024) << "MB, spilling into" << this->spillFile;
+
+    for(int i = 0; i < this->pointSegments.size(); i++)
+        this->spillWriter->addPoints(this->pointSegments.at(i), 0, this->pointSegments.at(i).size());
+
+    this->pointSegments.clear();
+    this->spilled = true;
+    return true;
+}
+
+void PointCache::finish(bool complete)
+{
+    if(this->fileName.isEmpty())
+        return;
+
+    if(this->spillWriter != NULL)
+    {
+        complete = this->spillWriter->close() && complete;
+        delete this->spillWriter;
+        this->spillWriter = NULL;
+    }
+
+    //The parse cache is only renamed to its final name after a complete import
+    if(this->spillShared && !QFileInfo(this->spillFile).exists())
+        complete = false;
+
+    //A cancelled import must not be replayed as the whole file
+    if(!complete)
+    {
+        clear();
+        return;
+    }
+
+    this->complete = true;
+    qDebug() << "Point cache:" << this->pointCount << "points of" << this->fileName << (this->spilled ? "on disk" : "in memory");
+}
+
+void PointCache::clear()
+{
+    delete this->spillWriter;
+    this->spillWriter = NULL;
+
+    if(!this->spillFile.isEmpty() && !this->spillShared)
+    {
+        QFile::remove(this->spillFile);
+        QFile::remove(XybFile::gridFileName(this->spillFile));
+    }
+
+    this->spillFile.clear();
+    this->sharedFile.clear();
+    this->spillShared = false;
+    this->spilled = false;
+    this->pointSegments.clear();
+    this->pointCount = 0;
+    this->orderColumnLength = 0;
+    this->orderPhase = 0;
+    this->complete = false;
+    this->fileName.clear();
+}
@@ -0,0 +1,105 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef POINTCACHE_H
+#define POINTCACHE_H
+
+#include <QList>
+#include <QString>
+#include <QDateTime>
+#include <QFile>
+
+#include "pointbuffer.h"
+#include "xybformat.h"
+
+/*
+ * The parsed points of the last import, kept for re-projection with new panorama settings.
+ *
+ * A new translation, up axis, projection or resolution does not change the points, only
+ * their projection, so the file is parsed once and every further import splats the cached
+ * points in parallel. The points are kept as PointBuffer segments (16 bytes per point, 24 with
+ * the cells of a scan grid import) up to the memory limit. Larger clouds are spilled into a temporary .xyb file, which is memory
+ * mapped for the re-projection and read from the page cache instead of being parsed again.
+ * If the importer writes the same points into a parse cache anyway, that file is used instead
+ * of a spill file of its own.
+ *
+ * The cache only belongs to one file and is dropped when the size or modification time of the
+ * file changes. Spherical coordinates are not cached: they depend on the translation, and the
+ * projection kernel is far cheaper than reading them back.
+ */
+class PointCache
+{
+public:
+    //Points per in-memory segment
+    static const int SegmentSize = 1024 * 1024;
+
+    PointCache();
+    ~PointCache();
+
+    void setMemoryLimit(qint64 bytes);
+    bool isEnabled() const { return this->memoryLimit > 0; }
+
+    //Whether a complete import of this file is cached
+    bool isValidFor(QString fileName) const;
+
+    //Called by the importer on its thread, in file order
+    void begin(QString fileName);
+    //.xyb file with exactly the points passed to addPoints(), complete when finish() is called
+    void shareFile(QString xybFileName);
+    void addPoints(const PointBuffer &points, int first, int count);
+    void finish(bool complete);
+    void clear();
+
+    qint64 size() const { return this->pointCount; }
+
+    //Scan line ordered points are replayed in order, their cells follow from the index
+    void setScanOrder(int columnLength, int phase);
+    int scanOrderColumnLength() const { return this->orderColumnLength; }
+    int scanOrderPhase() const { return this->orderPhase; }
+
+    //In memory: the segments, spilled: the .xyb file
+    bool isSpilled() const { return this->spilled; }
+    const QList<PointBuffer> &segments() const { return this->pointSegments; }
+    QString spillFileName() const { return this->spillFile; }
+
+private:
+    Q_DISABLE_COPY(PointCache)
+
+    bool spill();
+
+    QString fileName;
+    qint64 fileSize;
+    QDateTime fileModified;
+    bool complete;
+
+    qint64 memoryLimit;
+    qint64 pointCount;
+    QList<PointBuffer> pointSegments;
+    int orderColumnLength;
+    int orderPhase;
+
+    bool spilled;
+    QString spillFile;
+    XybWriter *spillWriter;
+
+    //Owned by the parse cache, never written or removed here
+    QString sharedFile;
+    bool spillShared;
+};
+
+#endif // POINTCACHE_H
@@ -0,0 +1,186 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "projectionkernel.h"
+
+#include <QtMath>
+#include <QDebug>
+#include <QByteArray>
+
+#if defined(PROJECTION_KERNEL_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+    typedef ProjectionKernel::BatchFunction (*SelectFunction)(ProjectionKernel::UpAxis, ProjectionKernel::Projection);
+
+    struct Kernel
+    {
+        SelectFunction select;
+        const char *name;
+    };
+
+    Kernel selectKernel()
+    {
+        Kernel scalar = { ProjectionKernel::scalarBatchFunction, "scalar" };
+
+#ifdef PROJECTION_KERNEL_X86
+        Kernel sse2 = { ProjectionKernel::sse2BatchFunction, "SSE2" };
+        Kernel avx2 = { ProjectionKernel::avx2BatchFunction, "AVX2" };
+        Kernel avx512 = { ProjectionKernel::avx512BatchFunction, "AVX-512" };
+
+        bool hasSSE2, hasAVX2, hasAVX512;
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+        __cpuid(info, 1);
+        hasSSE2 = (info[3] & (1 << 26)) != 0;
+        bool hasFMA = (info[2] & (1 << 12)) != 0;
+        bool hasOSXSAVE = (info[2] & (1 << 27)) != 0;
+
+        //The OS has to save the YMM/ZMM registers as well
+        unsigned long long xcr0 = hasOSXSAVE ? _xgetbv(0) : 0;
+        hasAVX2 = false;
+        hasAVX512 = false;
+        if(maxLeaf >= 7)
+        {
+            __cpuidex(info, 7, 0);
+            hasAVX2 = hasFMA && (info[1] & (1 << 5)) != 0 && (xcr0 & 0x06) == 0x06;
+            hasAVX512 = (info[1] & (1 << 16)) != 0 && (xcr0 & 0xe6) == 0xe6;
+        }
+#else
+        __builtin_cpu_init();
+        hasSSE2 = __builtin_cpu_supports("sse2");
+        hasAVX2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        hasAVX512 = __builtin_cpu_supports("avx512f");
+#endif
+
+        //Forced kernel, e.g. to compare the results with the reference implementation
+        QByteArray forced = qgetenv("PC2B_PROJECTION_KERNEL").toLower();
+        if(forced == "scalar")
+            return scalar;
+        if(forced == "sse2" && hasSSE2)
+            return sse2;
+        if(forced == "avx2" && hasAVX2)
+            return avx2;
+        if(forced == "avx512" && hasAVX512)
+            return avx512;
+        if(!forced.isEmpty())
+            qDebug() << "Projection kernel" << forced << "is not available on this CPU";
+
+        if(hasAVX512)
+            return avx512;
+        if(hasAVX2)
+            return avx2;
+        if(hasSSE2)
+            return sse2;
+#endif
+
+        return scalar;
+    }
+
+    const Kernel &kernel()
+    {
+        static const Kernel selected = selectKernel();
+        return selected;
+    }
+
+    template<ProjectionKernel::UpAxis Up, ProjectionKernel::Projection P>
+    void projectBatchScalarT(const ProjectionKernel::Parameters &parameters, const float *x, const float *y, const float *z, int count,
+                             float *pixelX, float *pixelY, float *radius, unsigned char *valid)
+    {
+        using namespace ProjectionKernel;
+
+        for(int i = 0; i < count; i++)
+        {
+            float px = x[i] + parameters.translation[0];
+            float py = y[i] + parameters.translation[1];
+            float pz = z[i] + parameters.translation[2];
+
+            //Azimuth theta = atan2(b, a), inclination phi = angle to the up axis u
+            float a, b, u;
+            if(Up == UP_X)
+            {
+                a = -pz;
+                b = py;
+                u = px;
+            }
+            else if(Up == UP_Y)
+            {
+                a = px;
+                b = -pz;
+                u = py;
+            }
+            else
+            {
+                a = px;
+                b = py;
+                u = pz;
+            }
+
+            float r = qSqrt( px*px + py*py + pz*pz );
+            float theta = qAtan2(b, a) + M_PI;
+            float phi = qAcos(u / r);
+
+            float vertical;
+            if(P == CYLINDRICAL)
+                vertical = qTan(phi) + M_PI;
+            else if(P == MERCATOR)
+                vertical = qLn( qTan(phi) + (1/qCos(phi)) );
+            else
+                vertical = phi;
+
+            pixelX[i] = theta * parameters.scaleX;
+            pixelY[i] = vertical * parameters.scaleY;
+            radius[i] = r;
+
+            valid[i] = r > 0.0f && px != 0.0f &&
+                       pixelX[i] >= 0.0f && pixelX[i] < parameters.width &&
+                       pixelY[i] >= 0.0f && pixelY[i] < parameters.height;
+        }
+    }
+}
+
+ProjectionKernel::BatchFunction ProjectionKernel::batchFunction(UpAxis upAxis, Projection projection)
+{
+    return kernel().select(upAxis, projection);
+}
+
+const char *ProjectionKernel::kernelName()
+{
+    return kernel().name;
+}
+
+ProjectionKernel::BatchFunction ProjectionKernel::scalarBatchFunction(UpAxis upAxis, Projection projection)
+{
+#define PROJECTION_KERNEL_VARIANTS(up) \
+    { &projectBatchScalarT<up, EQUIRECTANGULAR>, &projectBatchScalarT<up, CYLINDRICAL>, &projectBatchScalarT<up, MERCATOR> }
+
+    static const BatchFunction variants[3][3] =
+    {
+        PROJECTION_KERNEL_VARIANTS(UP_X),
+        PROJECTION_KERNEL_VARIANTS(UP_Y),
+        PROJECTION_KERNEL_VARIANTS(UP_Z)
+    };
+
+#undef PROJECTION_KERNEL_VARIANTS
+
+    return variants[upAxis][projection];
+}
@@ -0,0 +1,89 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "projectionkernel.h"
+
+#ifdef PROJECTION_KERNEL_X86
+
+#include <immintrin.h>
+
+//Note: nothing but the kernel may follow the target switch, see projectionkernel_impl.h
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+
+namespace ProjectionKernel
+{
+    struct AVX2
+    {
+        typedef __m256 F;
+        typedef __m256 M;
+        enum { Width = 8 };
+
+        static inline F set1(float value) { return _mm256_set1_ps(value); }
+        static inline F zero() { return _mm256_setzero_ps(); }
+        static inline F load(const float *p) { return _mm256_loadu_ps(p); }
+        static inline void store(float *p, F a) { _mm256_storeu_ps(p, a); }
+
+        static inline F add(F a, F b) { return _mm256_add_ps(a, b); }
+        static inline F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+        static inline F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+        static inline F div(F a, F b) { return _mm256_div_ps(a, b); }
+        static inline F fmadd(F a, F b, F c) { return _mm256_fmadd_ps(a, b, c); }
+        static inline F sqrt(F a) { return _mm256_sqrt_ps(a); }
+        static inline F min(F a, F b) { return _mm256_min_ps(a, b); }
+        static inline F max(F a, F b) { return _mm256_max_ps(a, b); }
+        static inline F abs(F a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+        static inline F copySign(F a, F sign) { return _mm256_or_ps(a, _mm256_and_ps(sign, _mm256_set1_ps(-0.0f))); }
+
+        static inline M cmplt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+        static inline M cmpgt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+        static inline M cmpge(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+        static inline M cmpneq(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+        static inline M maskAnd(M a, M b) { return _mm256_and_ps(a, b); }
+        static inline int maskBits(M m) { return _mm256_movemask_ps(m); }
+        static inline F select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+
+        static inline F frexp(F x, F &exponent)
+        {
+            __m256i bits = _mm256_castps_si256(x);
+            __m256i e = _mm256_srli_epi32(_mm256_and_si256(bits, _mm256_set1_epi32(0x7f800000)), 23);
+            exponent = _mm256_cvtepi32_ps(_mm256_sub_epi32(e, _mm256_set1_epi32(126)));
+            bits = _mm256_or_si256(_mm256_andnot_si256(_mm256_set1_epi32(0x7f800000), bits), _mm256_set1_epi32(0x3f000000));
+            return _mm256_castsi256_ps(bits);
+        }
+    };
+}
+
+#include "projectionkernel_impl.h"
+
+ProjectionKernel::BatchFunction ProjectionKernel::avx2BatchFunction(UpAxis upAxis, Projection projection)
+{
+    return selectBatchT<AVX2>(upAxis, projection);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#endif // PROJECTION_KERNEL_X86
@@ -0,0 +1,103 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "projectionkernel.h"
+
+#ifdef PROJECTION_KERNEL_X86
+
+#include <immintrin.h>
+
+//Note: nothing but the kernel may follow the target switch, see projectionkernel_impl.h
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx512f"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+//The unmasked AVX-512 intrinsics pass _mm512_undefined_ps() as the unused source, which GCC 12
+//reports once per inlined call as maybe uninitialized
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+namespace ProjectionKernel
+{
+    struct AVX512
+    {
+        typedef __m512 F;
+        typedef __mmask16 M;
+        enum { Width = 16 };
+
+        static inline F set1(float value) { return _mm512_set1_ps(value); }
+        static inline F zero() { return _mm512_setzero_ps(); }
+        static inline F load(const float *p) { return _mm512_loadu_ps(p); }
+        static inline void store(float *p, F a) { _mm512_storeu_ps(p, a); }
+
+        static inline F add(F a, F b) { return _mm512_add_ps(a, b); }
+        static inline F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+        static inline F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+        static inline F div(F a, F b) { return _mm512_div_ps(a, b); }
+        static inline F fmadd(F a, F b, F c) { return _mm512_fmadd_ps(a, b, c); }
+        static inline F sqrt(F a) { return _mm512_sqrt_ps(a); }
+        static inline F min(F a, F b) { return _mm512_min_ps(a, b); }
+        static inline F max(F a, F b) { return _mm512_max_ps(a, b); }
+
+        //The float logic instructions need AVX-512DQ, the integer ones are part of AVX-512F
+        static inline F abs(F a)
+        {
+            return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x7fffffff)));
+        }
+        static inline F copySign(F a, F sign)
+        {
+            __m512i signBit = _mm512_and_si512(_mm512_castps_si512(sign), _mm512_set1_epi32(0x80000000));
+            return _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(a), signBit));
+        }
+
+        static inline M cmplt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+        static inline M cmpgt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+        static inline M cmpge(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+        static inline M cmpneq(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_NEQ_UQ); }
+        static inline M maskAnd(M a, M b) { return (M)(a & b); }
+        static inline int maskBits(M m) { return (int)m; }
+        static inline F select(M m, F a, F b) { return _mm512_mask_blend_ps(m, b, a); }
+
+        static inline F frexp(F x, F &exponent)
+        {
+            __m512i bits = _mm512_castps_si512(x);
+            __m512i e = _mm512_srli_epi32(_mm512_and_si512(bits, _mm512_set1_epi32(0x7f800000)), 23);
+            exponent = _mm512_cvtepi32_ps(_mm512_sub_epi32(e, _mm512_set1_epi32(126)));
+            bits = _mm512_or_si512(_mm512_andnot_si512(_mm512_set1_epi32(0x7f800000), bits), _mm512_set1_epi32(0x3f000000));
+            return _mm512_castsi512_ps(bits);
+        }
+    };
+}
+
+#include "projectionkernel_impl.h"
+
+ProjectionKernel::BatchFunction ProjectionKernel::avx512BatchFunction(UpAxis upAxis, Projection projection)
+{
+    return selectBatchT<AVX512>(upAxis, projection);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+#endif
+
+#endif // PROJECTION_KERNEL_X86
@@ -0,0 +1,216 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROJECTIONKERNEL_IMPL_H
+#define PROJECTIONKERNEL_IMPL_H
+
+/*
+ * The projection kernel written once against a small set of vector operations (V).
+ * Every SIMD translation unit defines V for its instruction set and includes this file
+ * after enabling the target, so this header must not include anything (no Qt, no STL):
+ * inline functions from other headers would otherwise get compiled for AVX as well.
+ */
+namespace ProjectionKernel
+{
+    template<class V>
+    inline typename V::F atan2Poly(typename V::F num, typename V::F den)
+    {
+        typedef typename V::F F;
+
+        //Reduce to atan(t) with t in [0,1]
+        F absNum = V::abs(num);
+        F absDen = V::abs(den);
+        F t = V::div(V::min(absNum, absDen), V::max(V::max(absNum, absDen), V::set1(1.17549435e-38f)));
+        F s = V::mul(t, t);
+
+        //Max. absolute error 1.8e-6 rad on [0,1]
+        F p = V::set1(-0.01172120f);
+        p = V::fmadd(p, s, V::set1(0.05265332f));
+        p = V::fmadd(p, s, V::set1(-0.11643287f));
+        p = V::fmadd(p, s, V::set1(0.19354346f));
+        p = V::fmadd(p, s, V::set1(-0.33262347f));
+        p = V::fmadd(p, s, V::set1(0.99997726f));
+        p = V::mul(p, t);
+
+        //Back to the full circle
+        p = V::select(V::cmpgt(absNum, absDen), V::sub(V::set1(1.57079633f), p), p);
+        p = V::select(V::cmplt(den, V::zero()), V::sub(V::set1(3.14159265f), p), p);
+        return V::copySign(p, num);
+    }
+
+    template<class V>
+    inline typename V::F logPoly(typename V::F x)
+    {
+        typedef typename V::F F;
+
+        //x = m * 2^e with m in [0.5,1), then shifted to [sqrt(0.5), sqrt(2))
+        F e;
+        F m = V::frexp(x, e);
+        typename V::M small = V::cmplt(m, V::set1(0.707106781f));
+        e = V::sub(e, V::select(small, V::set1(1.0f), V::zero()));
+        m = V::sub(V::add(m, V::select(small, m, V::zero())), V::set1(1.0f));
+
+        F z = V::mul(m, m);
+        F y = V::set1(7.0376836292E-2f);
+        y = V::fmadd(y, m, V::set1(-1.1514610310E-1f));
+        y = V::fmadd(y, m, V::set1(1.1676998740E-1f));
+        y = V::fmadd(y, m, V::set1(-1.2420140846E-1f));
+        y = V::fmadd(y, m, V::set1(1.4249322787E-1f));
+        y = V::fmadd(y, m, V::set1(-1.6668057665E-1f));
+        y = V::fmadd(y, m, V::set1(2.0000714765E-1f));
+        y = V::fmadd(y, m, V::set1(-2.4999993993E-1f));
+        y = V::fmadd(y, m, V::set1(3.3333331174E-1f));
+        y = V::mul(V::mul(y, m), z);
+
+        y = V::fmadd(e, V::set1(-2.12194440e-4f), y);
+        y = V::fmadd(z, V::set1(-0.5f), y);
+        F result = V::add(m, y);
+        return V::fmadd(e, V::set1(0.693359375f), result);
+    }
+
+    //Converts exactly V::Width points, the orientation and projection are compile time constants
+    template<class V, UpAxis Up, Projection P>
+    inline void projectLanes(const Parameters &parameters, const float *x, const float *y, const float *z,
+                             float *pixelX, float *pixelY, float *radius, unsigned char *valid)
+    {
+        typedef typename V::F F;
+        typedef typename V::M M;
+
+        F px = V::add(V::load(x), V::set1(parameters.translation[0]));
+        F py = V::add(V::load(y), V::set1(parameters.translation[1]));
+        F pz = V::add(V::load(z), V::set1(parameters.translation[2]));
+
+        //theta = atan2(b, a), phi = angle to the up axis u
+        F a, b, u;
+        if(Up == UP_X)
+        {
+            a = V::sub(V::zero(), pz);
+            b = py;
+            u = px;
+        }
+        else if(Up == UP_Y)
+        {
+            a = px;
+            b = V::sub(V::zero(), pz);
+            u = py;
+        }
+        else
+        {
+            a = px;
+            b = py;
+            u = pz;
+        }
+
+        F horizontal = V::sqrt(V::fmadd(a, a, V::mul(b, b)));
+        F r = V::sqrt(V::fmadd(u, u, V::mul(horizontal, horizontal)));
+
+        F theta = V::add(atan2Poly<V>(b, a), V::set1(3.14159265f));
+        F vertical;
+        M inside = V::cmpgt(r, V::zero());
+
+        if(P == CYLINDRICAL)
+        {
+            //tan(phi) + PI
+            vertical = V::add(V::div(horizontal, u), V::set1(3.14159265f));
+        }
+        else if(P == MERCATOR)
+        {
+            //ln(tan(phi) + 1/cos(phi))
+            F argument = V::div(V::add(horizontal, r), u);
+            inside = V::maskAnd(inside, V::cmpgt(argument, V::zero()));
+            vertical = logPoly<V>(argument);
+        }
+        else
+        {
+            vertical = atan2Poly<V>(horizontal, u);
+        }
+
+        F column = V::mul(theta, V::set1(parameters.scaleX));
+        F row = V::mul(vertical, V::set1(parameters.scaleY));
+
+        //Points exactly on the x axis were always skipped by the panorama
+        inside = V::maskAnd(inside, V::cmpneq(px, V::zero()));
+        inside = V::maskAnd(inside, V::maskAnd(V::cmpge(column, V::zero()), V::cmplt(column, V::set1(parameters.width))));
+        inside = V::maskAnd(inside, V::maskAnd(V::cmpge(row, V::zero()), V::cmplt(row, V::set1(parameters.height))));
+
+        V::store(pixelX, column);
+        V::store(pixelY, row);
+        V::store(radius, r);
+
+        int bits = V::maskBits(inside);
+        for(int i = 0; i < V::Width; i++)
+            valid[i] = (bits >> i) & 1;
+    }
+
+    template<class V, UpAxis Up, Projection P>
+    void projectBatchT(const Parameters &parameters, const float *x, const float *y, const float *z, int count,
+                              float *pixelX, float *pixelY, float *radius, unsigned char *valid)
+    {
+        int i = 0;
+        for(; i + V::Width <= count; i += V::Width)
+        {
+            projectLanes<V, Up, P>(parameters, x + i, y + i, z + i, pixelX + i, pixelY + i, radius + i, valid + i);
+        }
+
+        if(i < count)
+        {
+            //The remaining points are padded to a full vector
+            float tail[6][V::Width];
+            unsigned char tailValid[V::Width];
+            int rest = count - i;
+
+            for(int j = 0; j < V::Width; j++)
+            {
+                tail[0][j] = (j < rest) ? x[i + j] : 0.0f;
+                tail[1][j] = (j < rest) ? y[i + j] : 0.0f;
+                tail[2][j] = (j < rest) ? z[i + j] : 0.0f;
+            }
+
+            projectLanes<V, Up, P>(parameters, tail[0], tail[1], tail[2], tail[3], tail[4], tail[5], tailValid);
+
+            for(int j = 0; j < rest; j++)
+            {
+                pixelX[i + j] = tail[3][j];
+                pixelY[i + j] = tail[4][j];
+                radius[i + j] = tail[5][j];
+                valid[i + j] = tailValid[j];
+            }
+        }
+    }
+
+    //All 9 specializations of one instruction set
+    template<class V>
+    inline BatchFunction selectBatchT(UpAxis upAxis, Projection projection)
+    {
+#define PROJECTION_KERNEL_VARIANTS(up) \
+        { &projectBatchT<V, up, EQUIRECTANGULAR>, &projectBatchT<V, up, CYLINDRICAL>, &projectBatchT<V, up, MERCATOR> }
+
+        static const BatchFunction variants[3][3] =
+        {
+            PROJECTION_KERNEL_VARIANTS(UP_X),
+            PROJECTION_KERNEL_VARIANTS(UP_Y),
+            PROJECTION_KERNEL_VARIANTS(UP_Z)
+        };
+
+#undef PROJECTION_KERNEL_VARIANTS
+
+        return variants[upAxis][projection];
+    }
+}
+
+#endif // PROJECTIONKERNEL_IMPL_H
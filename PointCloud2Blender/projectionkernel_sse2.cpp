@@ -0,0 +1,89 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "projectionkernel.h"
+
+#ifdef PROJECTION_KERNEL_X86
+
+#include <emmintrin.h>
+
+//Note: nothing but the kernel may follow the target switch, see projectionkernel_impl.h
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("sse2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#endif
+
+namespace ProjectionKernel
+{
+    struct SSE2
+    {
+        typedef __m128 F;
+        typedef __m128 M;
+        enum { Width = 4 };
+
+        static inline F set1(float value) { return _mm_set1_ps(value); }
+        static inline F zero() { return _mm_setzero_ps(); }
+        static inline F load(const float *p) { return _mm_loadu_ps(p); }
+        static inline void store(float *p, F a) { _mm_storeu_ps(p, a); }
+
+        static inline F add(F a, F b) { return _mm_add_ps(a, b); }
+        static inline F sub(F a, F b) { return _mm_sub_ps(a, b); }
+        static inline F mul(F a, F b) { return _mm_mul_ps(a, b); }
+        static inline F div(F a, F b) { return _mm_div_ps(a, b); }
+        static inline F fmadd(F a, F b, F c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+        static inline F sqrt(F a) { return _mm_sqrt_ps(a); }
+        static inline F min(F a, F b) { return _mm_min_ps(a, b); }
+        static inline F max(F a, F b) { return _mm_max_ps(a, b); }
+        static inline F abs(F a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+        static inline F copySign(F a, F sign) { return _mm_or_ps(a, _mm_and_ps(sign, _mm_set1_ps(-0.0f))); }
+
+        static inline M cmplt(F a, F b) { return _mm_cmplt_ps(a, b); }
+        static inline M cmpgt(F a, F b) { return _mm_cmpgt_ps(a, b); }
+        static inline M cmpge(F a, F b) { return _mm_cmpge_ps(a, b); }
+        static inline M cmpneq(F a, F b) { return _mm_cmpneq_ps(a, b); }
+        static inline M maskAnd(M a, M b) { return _mm_and_ps(a, b); }
+        static inline int maskBits(M m) { return _mm_movemask_ps(m); }
+        static inline F select(M m, F a, F b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+
+        static inline F frexp(F x, F &exponent)
+        {
+            __m128i bits = _mm_castps_si128(x);
+            __m128i e = _mm_srli_epi32(_mm_and_si128(bits, _mm_set1_epi32(0x7f800000)), 23);
+            exponent = _mm_cvtepi32_ps(_mm_sub_epi32(e, _mm_set1_epi32(126)));
+            bits = _mm_or_si128(_mm_andnot_si128(_mm_set1_epi32(0x7f800000), bits), _mm_set1_epi32(0x3f000000));
+            return _mm_castsi128_ps(bits);
+        }
+    };
+}
+
+#include "projectionkernel_impl.h"
+
+ProjectionKernel::BatchFunction ProjectionKernel::sse2BatchFunction(UpAxis upAxis, Projection projection)
+{
+    return selectBatchT<SSE2>(upAxis, projection);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#endif // PROJECTION_KERNEL_X86
@@ -0,0 +1,204 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "resolutionestimator.h"
+#include "panorama3d.h"
+
+#include <QtMath>
+
+ResolutionEstimator::Histogram::Histogram() :
+    azimuth(AzimuthBins, 0),
+    inclination(InclinationBins, 0)
+{
+    this->points = 0;
+}
+
+ResolutionEstimator::ResolutionEstimator(Panorama3D *panorama)
+{
+    this->panorama = panorama;
+}
+
+ResolutionEstimator::~ResolutionEstimator()
+{
+    qDeleteAll(this->threadHistograms);
+}
+
+void ResolutionEstimator::addPoints(const PointBuffer &points, int first, int count)
+{
+    Histogram *histogram;
+    {
+        QMutexLocker locker(&this->histogramsMutex);
+        histogram = this->threadHistograms.value(QThread::currentThread(), NULL);
+        if(histogram == NULL)
+        {
+            histogram = new Histogram();
+            this->threadHistograms.insert(QThread::currentThread(), histogram);
+        }
+    }
+
+    addPoints(*histogram, points, first, count);
+}
+
+void ResolutionEstimator::addPoints(Histogram &histogram, const PointBuffer &points, int first, int count)
+{
+    //Taken per call, the translation of the panorama may change before the first points
+    ProjectionKernel::Parameters parameters;
+    ProjectionKernel::BatchFunction angles = this->panorama->angleBatchFunction(parameters, AzimuthBins, InclinationBins);
+
+    float column[ProjectionKernel::BatchSize];
+    float row[ProjectionKernel::BatchSize];
+    float radius[ProjectionKernel::BatchSize];
+    unsigned char valid[ProjectionKernel::BatchSize];
+
+    for(int i = 0; i < count; i += ProjectionKernel::BatchSize)
+    {
+        int batch = qMin(count - i, ProjectionKernel::BatchSize);
+        angles(parameters, points.x.constData() + first + i, points.y.constData() + first + i, points.z.constData() + first + i,
+               batch, column, row, radius, valid);
+
+        for(int j = 0; j < batch; j++)
+        {
+            if(!valid[j])
+                continue;
+
+            histogram.azimuth[(int)column[j]]++;
+            histogram.inclination[(int)row[j]]++;
+            histogram.points++;
+        }
+    }
+}
+
+ResolutionEstimator::Result ResolutionEstimator::estimate()
+{
+    QMutexLocker locker(&this->histogramsMutex);
+
+    Histogram total;
+    foreach(const Histogram *histogram, this->threadHistograms)
+    {
+        for(int i = 0; i < AzimuthBins; i++)
+            total.azimuth[i] += histogram->azimuth.at(i);
+        for(int i = 0; i < InclinationBins; i++)
+            total.inclination[i] += histogram->inclination.at(i);
+        total.points += histogram->points;
+    }
+
+    return estimate(total);
+}
+
+ResolutionEstimator::Result ResolutionEstimator::estimate(const Histogram &histogram)
+{
+    Result result;
+    float horizontalConfidence, verticalConfidence;
+
+    //The scanner turns around the up axis, the azimuth wraps around at 360 degrees
+    result.horizontal = axisResolution(histogram.azimuth, true, horizontalConfidence);
+    result.vertical = axisResolution(histogram.inclination, false, verticalConfidence);
+    result.confidence = qMin(horizontalConfidence, verticalConfidence);
+    result.points = histogram.points;
+
+    return result;
+}
+
+int ResolutionEstimator::axisResolution(const QVector<quint32> &bins, bool wrapAround, float &confidence)
+{
+    //Runs of occupied bins are one line, the jitter of a line stays within neighbouring bins
+    int lines = 0, singletons = 0, doubletons = 0;
+    int firstLine = -1, lastLine = -1, previousLine = -1, largestGap = 0;
+    quint32 hits = 0;
+
+    for(int i = 0; i <= bins.size(); i++)
+    {
+        quint32 value = (i < bins.size()) ? bins.at(i) : 0;
+        if(value != 0)
+        {
+            if(hits == 0)
+            {
+                //A new line starts
+                if(previousLine >= 0)
+                    largestGap = qMax(largestGap, i - previousLine);
+                if(firstLine < 0)
+                    firstLine = i;
+                previousLine = lastLine = i;
+                lines++;
+            }
+            hits += value;
+        }
+        else if(hits != 0)
+        {
+            if(hits == 1) singletons++;
+            if(hits == 2) doubletons++;
+            hits = 0;
+        }
+    }
+
+    confidence = 0.0f;
+    if(lines < 2)
+        return 0;
+
+    //Chao1: lines which got no point at all, estimated from the lines with one or two points
+    float unseen = (doubletons > 0) ? singletons * singletons / (2.0f * doubletons) : singletons * (singletons - 1) / 2.0f;
+    confidence = lines / (lines + unseen);
+
+    //Angular range covered by the lines, a full circle only misses its largest gap
+    int span = lastLine - firstLine;
+    if(wrapAround)
+    {
+        largestGap = qMax(largestGap, bins.size() - lastLine + firstLine);
+        span = bins.size() - largestGap;
+    }
+
+    return qRound((double)(lines - 1) * bins.size() / qMax(span, 1));
+}
+
+ResolutionEstimator::Result ResolutionEstimator::combineSamples(const QList<Result> &samples)
+{
+    Result result;
+    double sumHorizontal = 0.0, sumVertical = 0.0, squaresHorizontal = 0.0, squaresVertical = 0.0;
+    int n = 0;
+
+    foreach(const Result &sample, samples)
+    {
+        if(!sample.isValid())
+            continue;
+
+        sumHorizontal += sample.horizontal;
+        sumVertical += sample.vertical;
+        squaresHorizontal += (double)sample.horizontal * sample.horizontal;
+        squaresVertical += (double)sample.vertical * sample.vertical;
+        result.points += sample.points;
+        n++;
+    }
+
+    if(n < 2)
+        return result;
+
+    double meanHorizontal = sumHorizontal / n;
+    double meanVertical = sumVertical / n;
+    double varianceHorizontal = qMax(0.0, (squaresHorizontal - n * meanHorizontal * meanHorizontal) / (n - 1));
+    double varianceVertical = qMax(0.0, (squaresVertical - n * meanVertical * meanVertical) / (n - 1));
+
+    //Half width of the 95% confidence interval of the mean, relative to the mean
+    double errorHorizontal = 1.96 * qSqrt(varianceHorizontal / n) / meanHorizontal;
+    double errorVertical = 1.96 * qSqrt(varianceVertical / n) / meanVertical;
+
+    result.horizontal = qRound(meanHorizontal);
+    result.vertical = qRound(meanVertical);
+    result.confidence = qBound(0.0, 1.0 - qMax(errorHorizontal, errorVertical), 1.0);
+
+    return result;
+}
@@ -0,0 +1,106 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RESOLUTIONESTIMATOR_H
+#define RESOLUTIONESTIMATOR_H
+
+#include <QVector>
+#include <QList>
+#include <QHash>
+#include <QMutex>
+#include <QThread>
+
+#include "pointbuffer.h"
+#include "projectionkernel.h"
+
+class Panorama3D;
+
+/*
+ * Estimates the angular resolution of the scanner (points per 360 degrees horizontally and
+ * per 180 degrees vertically) from the azimuth and inclination of the points.
+ *
+ * The angles are binned with 1/4 of the finest scanner step (30000 points per 360 degrees),
+ * the projection kernel computes the bins of a whole batch at once. Every scan line fills a
+ * run of neighbouring bins (a single bin without noise), the lines per degree over the covered
+ * angular range give the resolution. Both axes are measured, the vertical one is no longer
+ * assumed to be half of the horizontal one.
+ *
+ * Full analysis: every thread counts into its own histogram, estimate() merges them. The
+ * confidence compares the observed lines with the Chao1 estimate of all lines, i.e. how
+ * likely it is that lines were missed because they got too few points.
+ *
+ * Sampled analysis: every window of the file gets its own histogram and estimate (scan files
+ * are ordered by lines, so a window covers a few complete lines). combineSamples() averages
+ * the windows, the confidence is 1 - the relative 95% confidence interval of the mean.
+ */
+class ResolutionEstimator
+{
+public:
+    enum
+    {
+        AzimuthBins = 120000,
+        InclinationBins = 60000
+    };
+
+    struct Result
+    {
+        int horizontal;
+        int vertical;
+        float confidence;
+        qint64 points;
+
+        Result() : horizontal(0), vertical(0), confidence(0.0f), points(0) {}
+        bool isValid() const { return horizontal > 0 && vertical > 0; }
+    };
+
+    class Histogram
+    {
+    public:
+        Histogram();
+
+        QVector<quint32> azimuth;
+        QVector<quint32> inclination;
+        qint64 points;
+    };
+
+    explicit ResolutionEstimator(Panorama3D *panorama);
+    ~ResolutionEstimator();
+
+    //Thread-safe, the points are counted into a histogram of the calling thread
+    void addPoints(const PointBuffer &points, int first, int count);
+    void addPoints(Histogram &histogram, const PointBuffer &points, int first, int count);
+
+    //Merges the histograms of all threads
+    Result estimate();
+    static Result estimate(const Histogram &histogram);
+
+    static Result combineSamples(const QList<Result> &samples);
+
+private:
+    Q_DISABLE_COPY(ResolutionEstimator)
+
+    //Lines per full range of the axis, plus the Chao1 ratio of observed to estimated lines
+    static int axisResolution(const QVector<quint32> &bins, bool wrapAround, float &confidence);
+
+    Panorama3D *panorama;
+
+    QMutex histogramsMutex;
+    QHash<QThread*, Histogram*> threadHistograms;
+};
+
+#endif // RESOLUTIONESTIMATOR_H
@@ -0,0 +1,299 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "scangrid.h"
+#include "panorama3d.h"
+
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+
+const int ScanGrid::AngleColumns;
+const int ScanGrid::AngleRows;
+
+//Orders point indices by their grid index
+struct GridIndexLess
+{
+    const QVector<double> &index;
+    GridIndexLess(const QVector<double> &index) : index(index) {}
+    bool operator()(int a, int b) const { return index.at(a) < index.at(b); }
+};
+
+ScanGrid::ScanGrid()
+{
+    this->valid = false;
+    this->columnSlope = 0.0;
+    this->columnOffset = 0.0;
+    this->rowSlope = 0.0;
+    this->rowOffset = 0.0;
+    this->fitConfidence = 0.0f;
+}
+
+int ScanGrid::horizontalResolution() const
+{
+    return this->valid ? qRound(2.0 * M_PI / qAbs(this->columnSlope)) : 0;
+}
+
+int ScanGrid::verticalResolution() const
+{
+    return this->valid ? qRound(M_PI / qAbs(this->rowSlope)) : 0;
+}
+
+bool ScanGrid::calibrate(Panorama3D *panorama, const PointBuffer &points)
+{
+    this->valid = false;
+    if(!points.hasChannel(PointBuffer::GRID) || points.size() < 100)
+        return false;
+
+    ProjectionKernel::Parameters parameters;
+    ProjectionKernel::BatchFunction angles = panorama->angleBatchFunction(parameters, AngleColumns, AngleRows);
+
+    QVector<double> columns, thetas, phis;
+    QVector<int> rows;
+    float pixelX[ProjectionKernel::BatchSize];
+    float pixelY[ProjectionKernel::BatchSize];
+    float radius[ProjectionKernel::BatchSize];
+    unsigned char inside[ProjectionKernel::BatchSize];
+
+    for(int i = 0; i < points.size(); i += ProjectionKernel::BatchSize)
+    {
+        int batch = qMin(points.size() - i, ProjectionKernel::BatchSize);
+        angles(parameters, points.x.constData() + i, points.y.constData() + i, points.z.constData() + i, batch, pixelX, pixelY, radius, inside);
+
+        for(int j = 0; j < batch; j++)
+        {
+            if(!inside[j] || points.row.at(i + j) < 0 || points.column.at(i + j) < 0)
+                continue;
+
+            columns.append(points.column.at(i + j));
+            rows.append(points.row.at(i + j));
+            thetas.append(pixelX[j] * 2.0 * M_PI / AngleColumns);
+            phis.append(pixelY[j] * M_PI / AngleRows);
+        }
+    }
+
+    //Sweep plane: the azimuth modulo 180 degrees (doubled to get a full circle)
+    QVector<double> doubled(thetas.size());
+    for(int i = 0; i < thetas.size(); i++)
+        doubled[i] = fmod(2.0 * thetas.at(i), 2.0 * M_PI);
+
+    QVector<double> fitColumns = columns;
+    float columnInliers;
+    if(!fitLine(fitColumns, doubled, true, this->columnSlope, this->columnOffset, columnInliers))
+        return false;
+    snapSlope(fitColumns, doubled, 4.0 * M_PI, this->columnSlope, this->columnOffset, columnInliers);
+    this->columnSlope /= 2.0;
+    this->columnOffset /= 2.0;
+
+    //Points opposite of the sweep azimuth were measured beyond the zenith
+    QVector<double> sweepRows(rows.size()), sweep(rows.size());
+    for(int i = 0; i < rows.size(); i++)
+    {
+        double difference = fmod(thetas.at(i) - sweepAzimuth(columns.at(i)), 2.0 * M_PI);
+        if(difference < 0.0) difference += 2.0 * M_PI;
+        bool opposite = (difference > M_PI / 2.0 && difference < 1.5 * M_PI);
+
+        sweepRows[i] = rows.at(i);
+        sweep[i] = opposite ? -phis.at(i) : phis.at(i);
+    }
+
+    float rowInliers;
+    if(!fitLine(sweepRows, sweep, false, this->rowSlope, this->rowOffset, rowInliers))
+        return false;
+    snapSlope(sweepRows, sweep, M_PI, this->rowSlope, this->rowOffset, rowInliers);
+
+    this->fitConfidence = qMin(columnInliers, rowInliers);
+    this->valid = this->fitConfidence >= 0.95f;
+
+    qDebug() << "Scan grid:" << horizontalResolution() << "x" << verticalResolution() << "steps, confidence" << this->fitConfidence
+             << (this->valid ? "" : "(not used)");
+
+    return this->valid;
+}
+
+bool ScanGrid::locate(double theta, double phi, int nearColumn, int &row, int &column) const
+{
+    //Close to the poles the azimuth says nothing about the column
+    if(!this->valid || qSin(phi) < 0.1)
+        return false;
+
+    //The sweep plane repeats every half turn: the column nearest to nearColumn
+    double fractionalColumn = nearColumn + std::remainder(theta - sweepAzimuth(nearColumn), M_PI) / this->columnSlope;
+    column = qRound(fractionalColumn);
+
+    //Points opposite of the sweep azimuth were measured beyond the zenith
+    bool opposite = qAbs(std::remainder(theta - sweepAzimuth(column), 2.0 * M_PI)) > M_PI / 2.0;
+    double fractionalRow = ((opposite ? -phi : phi) - this->rowOffset) / this->rowSlope;
+    row = qRound(fractionalRow);
+
+    //Between two cells the point could belong to either
+    return row >= 0 && column >= 0 && qAbs(fractionalColumn - column) < 0.4 && qAbs(fractionalRow - row) < 0.4;
+}
+
+void ScanGrid::snapSlope(const QVector<double> &index, const QVector<double> &angle, double turn, double &slope, double &offset, float &inliers)
+{
+    //Scanners step by a whole fraction of a turn: the fit of a few thousand points is extrapolated over
+    //tens of thousands of steps, the exact step keeps the last columns on their pixels
+    double whole = qRound(turn / qAbs(slope));
+    if(whole < 1.0)
+        return;
+
+    double snappedSlope = (slope < 0.0 ? -turn : turn) / whole;
+    double sum = 0.0;
+    for(int i = 0; i < index.size(); i++)
+        sum += angle.at(i) - snappedSlope * index.at(i);
+    double snappedOffset = sum / index.size();
+
+    //Only if the sample agrees
+    float snappedInliers = inlierShare(index, angle, snappedSlope, snappedOffset);
+    if(snappedInliers >= inliers)
+    {
+        slope = snappedSlope;
+        offset = snappedOffset;
+        inliers = snappedInliers;
+    }
+}
+
+float ScanGrid::inlierShare(const QVector<double> &index, const QVector<double> &angle, double slope, double offset)
+{
+    int good = 0;
+    for(int i = 0; i < index.size(); i++)
+    {
+        if(qAbs(angle.at(i) - (slope * index.at(i) + offset)) < 0.25 * qAbs(slope))
+            good++;
+    }
+
+    return (float)good / index.size();
+}
+
+int ScanGrid::inferColumnLength(const PointBuffer &points, const QVector3D &translation, int &phase)
+{
+    int n = points.size();
+    phase = 0;
+    if(n < 1000)
+        return 0;
+
+    //Angle between the directions of consecutive points (1 - cos, monotonic in the angle)
+    QVector<double> steps(n - 1);
+    QVector3D previous = (QVector3D(points.x.at(0), points.y.at(0), points.z.at(0)) + translation).normalized();
+    for(int i = 1; i < n; i++)
+    {
+        QVector3D direction = (QVector3D(points.x.at(i), points.y.at(i), points.z.at(i)) + translation).normalized();
+        steps[i - 1] = 1.0 - QVector3D::dotProduct(previous, direction);
+        previous = direction;
+    }
+
+    //Within a column the scanner advances by one step, a new column starts at the other end of the sweep
+    QVector<double> sorted = steps;
+    std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+    double typical = sorted.at(sorted.size() / 2);
+    if(typical <= 0.0)
+        return 0;
+
+    //(1 - cos) grows with the square of the angle: 100 = ten steps
+    QVector<int> boundaries;
+    for(int i = 0; i < steps.size(); i++)
+    {
+        if(steps.at(i) > 100.0 * typical)
+            boundaries.append(i + 1);
+    }
+
+    //Every complete column of the sample has to have the same length
+    if(boundaries.size() < 3)
+        return 0;
+
+    int length = boundaries.at(1) - boundaries.at(0);
+    for(int i = 2; i < boundaries.size(); i++)
+    {
+        if(boundaries.at(i) - boundaries.at(i - 1) != length)
+            return 0;
+    }
+
+    if(length < 8 || boundaries.at(0) > length || n - boundaries.last() > length)
+        return 0;
+
+    phase = (length - boundaries.at(0)) % length;
+    return length;
+}
+
+void ScanGrid::assignSequence(PointBuffer &points, qint64 firstIndex, int columnLength, int phase)
+{
+    points.row.resize(points.size());
+    points.column.resize(points.size());
+
+    for(int i = 0; i < points.size(); i++)
+    {
+        qint64 sequence = firstIndex + i + phase;
+        points.row[i] = (qint32)(sequence % columnLength);
+        points.column[i] = (qint32)(sequence / columnLength);
+    }
+}
+
+bool ScanGrid::fitLine(QVector<double> &index, QVector<double> &angle, bool wrapAround, double &slope, double &offset, float &inliers)
+{
+    int n = index.size();
+    if(n < 2)
+        return false;
+
+    if(wrapAround)
+    {
+        //Unwrap along the index: neighbouring indices never differ by more than half a turn
+        QVector<int> order(n);
+        for(int i = 0; i < n; i++)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), GridIndexLess(index));
+
+        double turns = 0.0;
+        for(int i = 1; i < n; i++)
+        {
+            double previous = angle.at(order.at(i - 1));
+            double current = angle.at(order.at(i)) + turns;
+            if(current - previous > M_PI) turns -= 2.0 * M_PI;
+            else if(current - previous < -M_PI) turns += 2.0 * M_PI;
+            angle[order.at(i)] += turns;
+        }
+    }
+
+    //Least squares
+    double meanIndex = 0.0, meanAngle = 0.0;
+    for(int i = 0; i < n; i++)
+    {
+        meanIndex += index.at(i);
+        meanAngle += angle.at(i);
+    }
+    meanIndex /= n;
+    meanAngle /= n;
+
+    double covariance = 0.0, variance = 0.0;
+    for(int i = 0; i < n; i++)
+    {
+        covariance += (index.at(i) - meanIndex) * (angle.at(i) - meanAngle);
+        variance += (index.at(i) - meanIndex) * (index.at(i) - meanIndex);
+    }
+
+    //All points in one row or column: the step is unknown
+    if(variance <= 0.0 || covariance == 0.0)
+        return false;
+
+    slope = covariance / variance;
+    offset = meanAngle - slope * meanIndex;
+
+    inliers = inlierShare(index, angle, slope, offset);
+
+    return true;
+}
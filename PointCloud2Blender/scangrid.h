@@ -0,0 +1,89 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCANGRID_H
+#define SCANGRID_H
+
+#include <QVector>
+#include <QVector3D>
+
+#include "pointbuffer.h"
+
+class Panorama3D;
+
+/*
+ * The scan grid of a Faro Scene LT export: every point carries the row and column of its
+ * measurement, the scanner steps both by constant angles.
+ *
+ * calibrate() fits these steps against the angles of a few thousand points as seen from the
+ * panorama origin. The column gives the azimuth of the vertical sweep, the row the sweep angle
+ * within it. A sweep over the zenith continues on the opposite side (azimuth + 180 degrees),
+ * so the sweep angle is signed and the fit works for half turn scanners as well.
+ * The calibration fails (and the import projects the points as usual) if less than 95% of the
+ * points lie within a quarter of a grid step of the fit, e.g. when the panorama origin is not
+ * the scanner position.
+ */
+class ScanGrid
+{
+public:
+    ScanGrid();
+
+    bool calibrate(Panorama3D *panorama, const PointBuffer &points);
+
+    //Files without grid columns written in scan line order (Faro Scene 6 column exports):
+    //the points per column from the jumps of the direction between consecutive points of
+    //a sample from the start of the file, 0 if the sample is not ordered. phase is the row
+    //of the first point.
+    static int inferColumnLength(const PointBuffer &points, const QVector3D &translation, int &phase);
+    static void assignSequence(PointBuffer &points, qint64 firstIndex, int columnLength, int phase);
+
+    bool isValid() const { return this->valid; }
+
+    //Cell of a point at the angles theta and phi of the calibration (see AngleColumns), the column
+    //nearest to nearColumn. False close to the poles and between two cells, where it is ambiguous.
+    bool locate(double theta, double phi, int nearColumn, int &row, int &column) const;
+
+    //Grid steps per 360 degrees azimuth and per 180 degrees inclination
+    int horizontalResolution() const;
+    int verticalResolution() const;
+
+    //Share of the calibration points within a quarter of a grid step
+    float confidence() const { return this->fitConfidence; }
+
+    //Azimuth of the sweep plane of a column and the signed sweep angle of a row (radians)
+    double sweepAzimuth(int column) const { return this->columnSlope * column + this->columnOffset; }
+    double sweepAngle(int row) const { return this->rowSlope * row + this->rowOffset; }
+
+    //Angular resolution of the calibration, far below the finest scanner step
+    static const int AngleColumns = 1 << 22;
+    static const int AngleRows = 1 << 21;
+
+private:
+    static bool fitLine(QVector<double> &index, QVector<double> &angle, bool wrapAround, double &slope, double &offset, float &inliers);
+    static void snapSlope(const QVector<double> &index, const QVector<double> &angle, double turn, double &slope, double &offset, float &inliers);
+    static float inlierShare(const QVector<double> &index, const QVector<double> &angle, double slope, double offset);
+
+    bool valid;
+    double columnSlope;
+    double columnOffset;
+    double rowSlope;
+    double rowOffset;
+    float fitConfidence;
+};
+
+#endif // SCANGRID_H
@@ -0,0 +1,69 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "structuredscan.h"
+
+#include <QImage>
+#include <QDebug>
+
+StructuredScan::StructuredScan()
+{
+    this->columns = 0;
+    this->rows = 0;
+
+    for(int i = 0; i < 16; i++)
+        this->transform[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+}
+
+void StructuredScan::resize(int columns, int rows)
+{
+    this->columns = columns;
+    this->rows = rows;
+
+    int cells = columns * rows;
+    this->x.resize(cells);
+    this->y.resize(cells);
+    this->z.resize(cells);
+    this->rgba.resize(cells);
+    this->valid.fill(0, cells);
+}
+
+bool StructuredScan::saveColorMap(QString fileName) const
+{
+    QImage image(this->columns, this->rows, QImage::Format_RGB32);
+    image.fill(Qt::black);
+
+    for(int row = 0; row < this->rows; row++)
+    {
+        QRgb *line = (QRgb*)image.scanLine(this->rows - 1 - row);
+        for(int column = 0; column < this->columns; column++)
+        {
+            int cell = index(column, row);
+            if(this->valid.at(cell))
+                line[column] = this->rgba.at(cell);
+        }
+    }
+
+    if(!image.save(fileName))
+    {
+        qDebug() << "Cannot save the scan color map" << fileName;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,69 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STRUCTUREDSCAN_H
+#define STRUCTUREDSCAN_H
+
+#include <QVector>
+#include <QVector3D>
+#include <QColor>
+#include <QString>
+
+/*
+ * One scan of a structured point cloud (.ptx): a range image of columns x rows cells
+ * in the order of the file (column by column), each holding the registered position
+ * and the color of its measurement. Cells without a measurement stay empty.
+ */
+class StructuredScan
+{
+public:
+    StructuredScan();
+
+    void resize(int columns, int rows);
+
+    inline int index(int column, int row) const { return column * this->rows + row; }
+    inline bool isEmpty(int column, int row) const { return this->valid.at(index(column, row)) == 0; }
+
+    inline void set(int cell, float px, float py, float pz, QRgb color)
+    {
+        this->x[cell] = px;
+        this->y[cell] = py;
+        this->z[cell] = pz;
+        this->rgba[cell] = color;
+        this->valid[cell] = 1;
+    }
+
+    //Row 0 is the lowest row of the scan, it becomes the bottom of the image
+    bool saveColorMap(QString fileName) const;
+
+    int columns;
+    int rows;
+
+    //Scanner position after the registration, the view rays of the mesh start here
+    QVector3D scannerPosition;
+    //Registration (PTX: row vectors, p' = p * M), row-major
+    float transform[16];
+
+    QVector<float> x;
+    QVector<float> y;
+    QVector<float> z;
+    QVector<QRgb> rgba;
+    QVector<quint8> valid;
+};
+
+#endif // STRUCTUREDSCAN_H
@@ -0,0 +1,201 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "xybformat.h"
+#include "pointbuffer.h"
+
+#include <QDebug>
+
+#include <cstring>
+
+bool XybFile::readHeader(QFile &file, XybHeader &header, QString &errorString)
+{
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+    errorString = "The .xyb format is only supported on little endian machines!";
+    return false;
+#endif
+
+    if(file.read((char *)&header, sizeof(header)) != sizeof(header))
+    {
+        errorString = "The .xyb file is too small!";
+        return false;
+    }
+
+    if(memcmp(header.magic, "XYB1", 4) != 0 || header.version != 1)
+    {
+        errorString = "The file is not a .xyb file (unknown signature or version)!";
+        return false;
+    }
+
+    if(header.headerSize < sizeof(XybHeader) || header.recordSize != sizeof(XybRecord))
+    {
+        errorString = "The .xyb file has an unsupported header or record size!";
+        return false;
+    }
+
+    //Divided instead of multiplied: a corrupt point count must not overflow the check
+    quint64 fileSize = (quint64)file.size();
+    if(header.headerSize > fileSize || header.pointCount > (fileSize - header.headerSize) / header.recordSize)
+    {
+        errorString = "The .xyb file is truncated!";
+        return false;
+    }
+
+    return true;
+}
+
+const qint32 *XybFile::mapGrid(QFile &gridFile, qint64 pointCount)
+{
+    if(pointCount <= 0 || !gridFile.open(QIODevice::ReadOnly) || gridFile.size() != pointCount * 2 * (qint64)sizeof(qint32))
+        return NULL;
+
+    return (const qint32 *)gridFile.map(0, gridFile.size());
+}
+
+XybWriter::XybWriter()
+{
+    memset(&header, 0, sizeof(header));
+    gridRequested = false;
+}
+
+XybWriter::~XybWriter()
+{
+    if(file.isOpen())
+        close();
+}
+
+bool XybWriter::open(QString fileName, QVector3D origin)
+{
+    file.setFileName(fileName);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        errorString = "Cannot open file for writing: " + fileName;
+        return false;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "XYB1", 4);
+    header.version = 1;
+    header.headerSize = sizeof(XybHeader);
+    header.recordSize = sizeof(XybRecord);
+    header.origin[0] = origin.x();
+    header.origin[1] = origin.y();
+    header.origin[2] = origin.z();
+
+    //The header gets rewritten with count and bounds when closing the file
+    file.write((const char *)&header, sizeof(header));
+
+    buffer.reserve(65536);
+
+    return true;
+}
+
+void XybWriter::setOrigin(QVector3D origin)
+{
+    header.origin[0] = origin.x();
+    header.origin[1] = origin.y();
+    header.origin[2] = origin.z();
+}
+
+void XybWriter::addPoint(float x, float y, float z, QRgb color)
+{
+    XybRecord record;
+    record.x = x;
+    record.y = y;
+    record.z = z;
+    record.r = qRed(color);
+    record.g = qGreen(color);
+    record.b = qBlue(color);
+    record.flags = 0;
+
+    const float position[3] = { x, y, z };
+    bool first = (header.pointCount == 0 && buffer.isEmpty());
+
+    for(int i = 0; i < 3; i++)
+    {
+        header.boundsMin[i] = first ? position[i] : qMin(header.boundsMin[i], position[i]);
+        header.boundsMax[i] = first ? position[i] : qMax(header.boundsMax[i], position[i]);
+    }
+
+    buffer.append(record);
+
+    if(buffer.size() >= 65536)
+        flush();
+}
+
+void XybWriter::addPoints(const PointBuffer &points, int first, int count)
+{
+    //The sidecar is started with the first points, all records need a cell then
+    bool grid = points.hasChannel(PointBuffer::GRID);
+    if(gridRequested && grid && count > 0 && !gridFile.isOpen() && header.pointCount == 0 && buffer.isEmpty())
+    {
+        gridFile.setFileName(XybFile::gridFileName(file.fileName()));
+        if(!gridFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            qDebug() << "Cannot open file for writing:" << gridFile.fileName();
+    }
+
+    for(int i = first; i < first + count; i++)
+    {
+        if(gridFile.isOpen())
+        {
+            gridBuffer.append(grid ? points.row[i] : -1);
+            gridBuffer.append(grid ? points.column[i] : -1);
+        }
+
+        addPoint(points.x[i], points.y[i], points.z[i], points.color(i));
+    }
+}
+
+void XybWriter::flush()
+{
+    file.write((const char *)buffer.constData(), buffer.size() * sizeof(XybRecord));
+    header.pointCount += buffer.size();
+    buffer.resize(0);
+
+    if(gridFile.isOpen())
+        gridFile.write((const char *)gridBuffer.constData(), gridBuffer.size() * sizeof(qint32));
+    gridBuffer.resize(0);
+}
+
+bool XybWriter::close()
+{
+    flush();
+
+    file.seek(0);
+    file.write((const char *)&header, sizeof(header));
+
+    bool ok = (file.error() == QFile::NoError);
+    if(!ok)
+        errorString = file.errorString();
+
+    file.close();
+
+    if(gridFile.isOpen())
+    {
+        if(gridFile.error() != QFile::NoError)
+        {
+            ok = false;
+            errorString = gridFile.errorString();
+        }
+        gridFile.close();
+    }
+
+    qDebug() << "Wrote" << header.pointCount << "points into" << file.fileName();
+
+    return ok;
+}
@@ -0,0 +1,108 @@
+/*
+    PointCloud2Blender - convert point cloud files to a textured 3D mesh
+    Copyright (C) 2015 Adam Kalisz (Bachelor@Kalisz.co)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef XYBFORMAT_H
+#define XYBFORMAT_H
+
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <QVector3D>
+#include <QColor>
+
+class PointBuffer;
+
+/*
+ * The .xyb binary point format (little endian):
+ *
+ * XybHeader (64 bytes)
+ * XybRecord (16 bytes) * pointCount
+ *
+ * The records are 16 byte aligned inside a memory mapped file,
+ * so they can be handed to the projection without copying.
+ *
+ * Caches of scan grid imports keep the grid cell of every record in the
+ * sidecar file <name>.grid: qint32 row and column per record, in record order.
+ */
+struct XybHeader
+{
+    char magic[4];          //"XYB1"
+    quint32 version;        //1
+    quint32 headerSize;     //sizeof(XybHeader)
+    quint32 recordSize;     //sizeof(XybRecord)
+    quint64 pointCount;
+    float boundsMin[3];
+    float boundsMax[3];
+    float origin[3];        //scanner position in file coordinates
+    quint32 reserved;
+};
+
+struct XybRecord
+{
+    float x, y, z;
+    quint8 r, g, b;
+    quint8 flags;           //reserved, always 0
+};
+
+Q_STATIC_ASSERT(sizeof(XybHeader) == 64);
+Q_STATIC_ASSERT(sizeof(XybRecord) == 16);
+
+class XybFile
+{
+public:
+    static bool readHeader(QFile &file, XybHeader &header, QString &errorString);
+
+    static QString gridFileName(QString fileName) { return fileName + ".grid"; }
+    //Mapped row, column pairs of the sidecar, NULL if there is none for pointCount records
+    static const qint32 *mapGrid(QFile &gridFile, qint64 pointCount);
+};
+
+class XybWriter
+{
+public:
+    XybWriter();
+    ~XybWriter();
+
+    bool open(QString fileName, QVector3D origin);
+    //The header is rewritten when closing, so the origin can still follow points moved to a local origin
+    QVector3D origin() const { return QVector3D(header.origin[0], header.origin[1], header.origin[2]); }
+    void setOrigin(QVector3D origin);
+    //Points with grid cells get a .grid sidecar (only caches, a converted file is projected)
+    void keepGrid() { gridRequested = true; }
+    bool hasGrid() const { return gridFile.isOpen(); }
+    void addPoint(float x, float y, float z, QRgb color);
+    void addPoints(const PointBuffer &points, int first, int count);
+    bool close();
+
+    qint64 count() const { return header.pointCount + buffer.size(); }
+
+    QString errorString;
+
+private:
+    void flush();
+
+    QFile file;
+    XybHeader header;
+    QVector<XybRecord> buffer;
+
+    bool gridRequested;
+    QFile gridFile;
+    QVector<qint32> gridBuffer;
+};
+
+#endif // XYBFORMAT_H